@@ -1,4 +1,3 @@
-from ngsolve import *
 from time import time
 
 # for Development
@@ -6,14 +5,13 @@ from time import time
 import sys
 import os
 sys.path.append(os.path.join(os.path.dirname(__file__), "../build"))
-from ASCsoft.bla import Vector
+from ASCsoft.bla import Matrix, matmul
 # ~ for Development
 
-#from ASCsoft.bla import Matrix
+backends = ["native", "parallel", "lapack", "auto"]
+data = { b : [] for b in backends }
 
 n = 1
-
-data = []
 while n <= 1024:
     n = 2*n
 
@@ -21,22 +19,23 @@ while n <= 1024:
     B = Matrix(n,n)
     runs =  1+int(min( 1e8 / n**3, 1000))
 
-    ts = time()
-    for i in range(runs):
-        C = A*B
-    te = time()
-    print ('n = ', n, ' time = ', (te-ts)/runs)
-    data.append( (n, (te-ts)/runs) )
+    for b in backends:
+        ts = time()
+        for i in range(runs):
+            C = matmul(A, B, backend=b)
+        te = time()
+        print ('n = ', n, b, ' time = ', (te-ts)/runs)
+        data[b].append( (n, (te-ts)/runs) )
 
 print (data)
 
 
 import matplotlib.pyplot as plt
 
-sizes, times = zip(*data)
-
 plt.figure(figsize=(8,6))
-plt.plot(sizes, times, marker='o', linestyle='-', color='b', label='Execution time')
+for b in backends:
+    sizes, times = zip(*data[b])
+    plt.plot(sizes, times, marker='o', linestyle='-', label=b)
 
 plt.xscale('log') # , base=2)
 plt.yscale('log')
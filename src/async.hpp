@@ -0,0 +1,178 @@
+#ifndef FILE_ASYNC
+#define FILE_ASYNC
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "matrix.hpp"
+
+// Asynchronous execution: auto h = (A*B | Async).Into(C) starts the product on a
+// background thread and returns at once. The operands are referenced, not copied,
+// and must stay alive (and unchanged) until h.Wait() returns.
+//
+// Every operation records the memory it reads and writes. A new operation first
+// waits for the pending ones it depends on: it reads or writes memory a pending
+// one writes, or it writes memory a pending one reads. So
+//     (A*B | Async).Into(C);  (C*D | Async).Into(E);
+// computes E from the finished C, while independent operations run concurrently.
+// Work done outside of Async (C(0,0) = 1, C = A*B, ...) is not ordered, call
+// AsyncWait(C) or the handle's Wait() first.
+//
+// Operations run on threads of their own (std::async), not on the task manager.
+// Their kernels use the worker pool when it is free, see partition.hpp.
+
+namespace Mathlib {
+
+    // Tag for asynchronous evaluation: (A*B | Async).Into(C)
+    class T_Async { };
+    static constexpr T_Async Async;
+
+    // Completion of an asynchronous operation. Wait() rethrows an exception of the
+    // operation, or of an operation it depended on.
+    class AsyncHandle {
+        std::shared_future<void> done;
+
+    public:
+        AsyncHandle() = default;
+        explicit AsyncHandle(std::shared_future<void> _done) : done(std::move(_done)) { }
+
+        bool Ready() const {
+            return !done.valid() || done.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        }
+
+        void Wait() const {
+            if (done.valid()) done.get();
+        }
+    };
+
+    namespace detail {
+        // Memory [first, next) of an operand, as addresses
+        struct AsyncRange {
+            std::uintptr_t first, next;
+
+            bool Intersects(const AsyncRange& other) const {
+                return first < other.next && other.first < next;
+            }
+        };
+
+        template <typename T, ORDERING ORD>
+        AsyncRange RangeOf(const MatrixView<T, ORD>& m) {
+            const size_t inner = (ORD == ColMajor) ? m.Rows() : m.Cols();
+            const size_t outer = (ORD == ColMajor) ? m.Cols() : m.Rows();
+            const T* end = m.Data() + (inner && outer ? (outer - 1) * m.Dist() + inner : 0);
+            return { std::uintptr_t(m.Data()), std::uintptr_t(end) };
+        }
+
+        // The operations not known to be finished, with their operands
+        class AsyncRegistry {
+            struct Entry {
+                std::vector<AsyncRange> reads, writes;
+                std::shared_future<void> done;
+            };
+
+            std::mutex mutex;
+            std::vector<Entry> pending;
+
+            static bool Finished(const Entry& e) {
+                return e.done.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+            }
+
+            static bool Touches(const std::vector<AsyncRange>& ranges, const AsyncRange& r) {
+                for (auto& q : ranges)
+                    if (q.Intersects(r)) return true;
+                return false;
+            }
+
+        public:
+            // Starts func on a new thread after the pending operations it conflicts with
+            template <typename FUNC>
+            std::shared_future<void> Launch(FUNC func, std::vector<AsyncRange> reads, std::vector<AsyncRange> writes) {
+                std::lock_guard<std::mutex> guard(mutex);
+                pending.erase(std::remove_if(pending.begin(), pending.end(), Finished), pending.end());
+
+                std::vector<std::shared_future<void>> deps;
+                for (auto& e : pending) {
+                    bool conflict = false;
+                    for (auto& r : reads)  conflict = conflict || Touches(e.writes, r);
+                    for (auto& w : writes) conflict = conflict || Touches(e.writes, w) || Touches(e.reads, w);
+                    if (conflict) deps.push_back(e.done);
+                }
+
+                std::shared_future<void> done = std::async(std::launch::async, [deps, func]() {
+                    for (auto& d : deps) d.get();
+                    func();
+                }).share();
+                pending.push_back({ std::move(reads), std::move(writes), done });
+                return done;
+            }
+
+            // Waits for the pending operations touching r, or for all of them
+            void Wait(const AsyncRange* r = nullptr) {
+                std::vector<std::shared_future<void>> wait;
+                {
+                    std::lock_guard<std::mutex> guard(mutex);
+                    for (auto& e : pending)
+                        if (!r || Touches(e.reads, *r) || Touches(e.writes, *r))
+                            wait.push_back(e.done);
+                }
+                for (auto& d : wait) d.get();
+            }
+        };
+
+        inline AsyncRegistry& GetAsyncRegistry() {
+            static AsyncRegistry registry;
+            return registry;
+        }
+    }
+
+    // Waits for the asynchronous operations reading or writing m
+    template <typename T, ORDERING ORD>
+    void AsyncWait(const MatrixView<T, ORD>& m) {
+        auto r = detail::RangeOf(m);
+        detail::GetAsyncRegistry().Wait(&r);
+    }
+
+    // Waits for all asynchronous operations
+    inline void AsyncWaitAll() {
+        detail::GetAsyncRegistry().Wait();
+    }
+
+
+    template <typename T1, typename T2, ORDERING OA, ORDERING OB>
+    class AsyncMultExpr {
+    public:
+        MatrixView<T1, OA> a;
+        MatrixView<T2, OB> b;
+
+        AsyncMultExpr(const MatrixView<T1, OA>& _a, const MatrixView<T2, OB>& _b)
+            : a(_a), b(_b) { }
+
+        // Starts c = a*b with the backend chosen by MultMatMatAuto
+        template <typename T, ORDERING OC>
+        AsyncHandle Into(MatrixView<T, OC> c) const {
+            if (a.Cols() != b.Rows() || c.Rows() != a.Rows() || c.Cols() != b.Cols())
+                throw std::invalid_argument("Matrix dimensions do not match for multiplication");
+            auto ra = detail::RangeOf(a), rb = detail::RangeOf(b), rc = detail::RangeOf(c);
+            if (rc.Intersects(ra) || rc.Intersects(rb))
+                throw std::invalid_argument("Result of an asynchronous product must not overlap its factors");
+
+            auto fa = a;
+            auto fb = b;
+            return AsyncHandle(detail::GetAsyncRegistry().Launch(
+                [fa, fb, c]() { MultMatMatAuto(fa, fb, c); }, { ra, rb }, { rc }));
+        }
+    };
+
+    template <typename T1, typename T2, ORDERING OA, ORDERING OB>
+    auto operator|(const MatExprMul<MatrixView<T1, OA>, MatrixView<T2, OB>>& expr, T_Async) {
+        return AsyncMultExpr<T1, T2, OA, OB>(expr.Left(), expr.Right());
+    }
+}
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef FILE_BATCHED
+#define FILE_BATCHED
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "matrix.hpp"
+#include "partition.hpp"
+
+// Operations on stacks of independent small problems. A single call processes
+// the whole batch, split over tasks along the batch, so that the setup cost of
+// a call (Python dispatch in the bindings, thread startup) is paid once and not
+// per item. Each item runs sequentially inside its task; items may differ in
+// size, idle tasks steal items from the others (ParallelFor).
+
+namespace Mathlib {
+
+    // Below this many floating point operations in total, a batch runs on the calling thread
+    constexpr size_t BATCH_PARALLEL_FLOPS = size_t(1) << 18;
+
+    // From this size on, batched solves factor with Lapack instead of plain elimination
+    constexpr size_t BATCH_LAPACK_MIN = 32;
+
+    namespace detail {
+        inline size_t BatchTasks(size_t items, double flops, size_t ntasks) {
+            if (ntasks) return std::min(ntasks, items);
+            return flops < double(BATCH_PARALLEL_FLOPS) ? 1 : std::min(DEFAULT_NTASKS, items);
+        }
+
+        template <typename TA, typename TB>
+        void CheckBatch(const std::vector<TA>& a, const std::vector<TB>& b) {
+            if (a.size() != b.size()) throw std::invalid_argument("Batch sizes do not match");
+        }
+
+        // x = A^{-1} x by Gaussian elimination with partial pivoting, a is overwritten.
+        // Returns 0, or k+1 if the k-th pivot is zero (like Lapack's info).
+        template <typename T, ORDERING ORD, typename TDIST>
+        size_t SolveInPlace(MatrixView<T, ORD> a, VectorView<T, TDIST> x) {
+            using std::abs;
+            const size_t n = a.Rows();
+            for (size_t k = 0; k < n; ++k) {
+                size_t p = k;
+                for (size_t i = k + 1; i < n; ++i)
+                    if (abs(a(i, k)) > abs(a(p, k))) p = i;
+                if (a(p, k) == T(0)) return k + 1;
+                if (p != k) {
+                    for (size_t j = k; j < n; ++j) std::swap(a(k, j), a(p, j));
+                    std::swap(x(k), x(p));
+                }
+                for (size_t i = k + 1; i < n; ++i) {
+                    const T l = a(i, k) / a(k, k);
+                    for (size_t j = k + 1; j < n; ++j)
+                        a(i, j) -= l * a(k, j);
+                    x(i) -= l * x(k);
+                }
+            }
+            for (size_t k = n; k-- > 0; ) {
+                T sum = x(k);
+                for (size_t j = k + 1; j < n; ++j)
+                    sum -= a(k, j) * x(j);
+                x(k) = sum / a(k, k);
+            }
+            return 0;
+        }
+    }
+
+
+    // c[i] = a[i] * b[i] for every item, ntasks == 0 choosing from the total work.
+    // Items large enough use the native kernel, the others plain loops.
+    template <typename T, ORDERING OA, ORDERING OB, ORDERING OC>
+    void BatchedMultiply(const std::vector<MatrixView<T, OA>>& a, const std::vector<MatrixView<T, OB>>& b,
+                         const std::vector<MatrixView<T, OC>>& c, size_t ntasks = 0) {
+        detail::CheckBatch(a, b);
+        detail::CheckBatch(a, c);
+        double flops = 0;
+        for (size_t i = 0; i < a.size(); ++i) {
+            if (a[i].Cols() != b[i].Rows() || c[i].Rows() != a[i].Rows() || c[i].Cols() != b[i].Cols())
+                throw std::invalid_argument("Matrix dimensions do not match in batch item " + std::to_string(i));
+            flops += 2.0 * double(a[i].Rows()) * double(a[i].Cols()) * double(b[i].Cols());
+        }
+
+        const size_t small = GetDispatchThresholds().small;
+        ParallelFor(a.size(), detail::BatchTasks(a.size(), flops, ntasks), [&](size_t first, size_t next) {
+            for (size_t i = first; i < next; ++i) {
+                const double size = std::cbrt(double(c[i].Rows()) * double(c[i].Cols()) * double(a[i].Cols()));
+                if constexpr (NativeMultSupported<T, T, T, OA, OB, OC>()) {
+                    if (size >= small) {
+                        MultMatMatNative<OC>(a[i], b[i], c[i]);
+                        continue;
+                    }
+                }
+                MultMatMatSmall(a[i], b[i], c[i]);
+            }
+        });
+    }
+
+
+    // x[i] = a[i]^{-1} b[i] for every item, a[i] is not changed.
+    // Returns info per item: 0, or k > 0 if a[i] is singular (x[i] is then undefined).
+    template <typename T, ORDERING ORD, typename TDIST>
+    std::vector<size_t> BatchedSolve(const std::vector<MatrixView<T, ORD>>& a, const std::vector<VectorView<T, TDIST>>& b,
+                                     const std::vector<VectorView<T, TDIST>>& x, size_t ntasks = 0) {
+        detail::CheckBatch(a, b);
+        detail::CheckBatch(a, x);
+        double flops = 0;
+        for (size_t i = 0; i < a.size(); ++i) {
+            const size_t n = a[i].Rows();
+            if (a[i].Cols() != n || b[i].Size() != n || x[i].Size() != n)
+                throw std::invalid_argument("Matrix and vector sizes do not match in batch item " + std::to_string(i));
+            flops += 2.0 / 3.0 * double(n) * double(n) * double(n);
+        }
+
+        std::vector<size_t> info(a.size(), 0);
+        ParallelFor(a.size(), detail::BatchTasks(a.size(), flops, ntasks), [&](size_t first, size_t next) {
+            Matrix<T, ColMajor> work(0, 0, WorkspaceAllocator());
+            for (size_t i = first; i < next; ++i) {
+                const size_t n = a[i].Rows();
+                VectorView<T, TDIST> xi = x[i];
+                xi = static_cast<const VecExpr<VectorView<T, TDIST>>&>(b[i]);   // copies, plain assignment would rebind
+                if constexpr (std::is_same_v<T, double> || std::is_same_v<T, float>) {
+                    if (n >= BATCH_LAPACK_MIN) {
+                        LapackLU<ColMajor, T> lu{ Matrix<T, ColMajor>(a[i]) };
+                        info[i] = size_t(std::max<integer>(lu.Info(), 0));
+                        if (info[i] == 0) {
+                            Vector<T> y(xi);
+                            lu.Solve(y);
+                            xi = static_cast<const VecExpr<VectorView<T>>&>(y);
+                        }
+                        continue;
+                    }
+                }
+                work.Resize(n, n);
+                work = a[i];
+                info[i] = detail::SolveInPlace(MatrixView<T, ColMajor>(work), xi);
+            }
+        });
+        return info;
+    }
+
+
+    // Dot(x[i], y[i]) for every item
+    template <typename T, typename TDIST>
+    std::vector<T> BatchedDot(const std::vector<VectorView<T, TDIST>>& x, const std::vector<VectorView<T, TDIST>>& y,
+                              size_t ntasks = 0) {
+        detail::CheckBatch(x, y);
+        double flops = 0;
+        for (size_t i = 0; i < x.size(); ++i) {
+            if (x[i].Size() != y[i].Size())
+                throw std::invalid_argument("Vector sizes do not match in batch item " + std::to_string(i));
+            flops += 2.0 * double(x[i].Size());
+        }
+
+        std::vector<T> res(x.size());
+        ParallelFor(x.size(), detail::BatchTasks(x.size(), flops, ntasks), [&](size_t first, size_t next) {
+            for (size_t i = first; i < next; ++i)
+                res[i] = Dot(x[i], y[i]);
+        });
+        return res;
+    }
+}
+
+#endif
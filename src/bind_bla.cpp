@@ -1,23 +1,783 @@
+#include <optional>
 #include <sstream>
 #include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
 
 #include "vector.hpp"
 #include "matrix.hpp"
+#include "lapack_interface.hpp"
+#include "lazy.hpp"
+#include "batched.hpp"
+#include "async.hpp"
+#include "profile.hpp"
 
 using namespace Mathlib;
 using namespace std;
 namespace py = pybind11;
 
 
+// Buffer protocol: NumPy sees the data of vectors and matrices in place,
+// np.asarray(x) shares memory with x in both directions.
+template <typename TDIST>
+py::buffer_info VectorBuffer(const VectorView<double, TDIST> & v) {
+	return py::buffer_info(v.Data(), sizeof(double), py::format_descriptor<double>::format(), 1,
+		{ py::ssize_t(v.Size()) }, { py::ssize_t(size_t(v.Dist()) * sizeof(double)) });
+}
+
+template <ORDERING ORD>
+py::buffer_info MatrixBuffer(const MatrixView<double, ORD> & m) {
+	const size_t rstride = (ORD == RowMajor) ? m.Dist() : 1;
+	const size_t cstride = (ORD == RowMajor) ? 1 : m.Dist();
+	return py::buffer_info(m.Data(), sizeof(double), py::format_descriptor<double>::format(), 2,
+		{ py::ssize_t(m.Rows()), py::ssize_t(m.Cols()) },
+		{ py::ssize_t(rstride * sizeof(double)), py::ssize_t(cstride * sizeof(double)) });
+}
+
+// Float64 buffer of the given dimension, writable by default, with non-negative element strides
+py::buffer_info RequestBuffer(py::buffer b, py::ssize_t ndim, bool writable = true) {
+	py::buffer_info info = b.request(writable);
+	if (info.format != py::format_descriptor<double>::format() || info.itemsize != sizeof(double))
+		throw py::type_error("array must have dtype float64");
+	if (info.ndim != ndim)
+		throw py::value_error("array must have " + std::to_string(ndim) + " dimension(s)");
+	for (auto s : info.strides)
+		if (s < 0 || s % py::ssize_t(sizeof(double)) != 0)
+			throw py::value_error("negative or unaligned strides are not supported");
+	return info;
+}
+
+// Views of NumPy arrays without copying. The inner dimension needs unit stride:
+// C-contiguous rows give a RowMajor view, Fortran-contiguous columns a ColMajor view.
+VectorView<double, size_t> WrapVector(py::buffer b) {
+	py::buffer_info info = RequestBuffer(b, 1);
+	return VectorView<double, size_t>(info.shape[0], info.strides[0] / sizeof(double), static_cast<double*>(info.ptr));
+}
+
+template <ORDERING ORD>
+MatrixView<double, ORD> WrapMatrix(py::buffer b) {
+	py::buffer_info info = RequestBuffer(b, 2);
+	const size_t rows = info.shape[0], cols = info.shape[1];
+	const size_t rstride = info.strides[0] / sizeof(double), cstride = info.strides[1] / sizeof(double);
+	const size_t inner = (ORD == RowMajor) ? cstride : rstride;
+	size_t dist = (ORD == RowMajor) ? rstride : cstride;
+	// a single row or column has any stride along the unused dimension
+	if ((ORD == RowMajor ? rows : cols) <= 1) dist = (ORD == RowMajor) ? cols : rows;
+	if ((inner != 1 && (ORD == RowMajor ? cols : rows) > 1) || dist < (ORD == RowMajor ? cols : rows))
+		throw py::value_error(ORD == RowMajor ? "array is not C-contiguous along its rows"
+		                                      : "array is not Fortran-contiguous along its columns");
+	return MatrixView<double, ORD>(rows, cols, dist, static_cast<double*>(info.ptr));
+}
+
+// Copy of a 1-d or 2-d array
+Vector<double> VectorFromArray(py::array_t<double, py::array::forcecast> a) {
+	if (a.ndim() != 1) throw py::value_error("array must have 1 dimension");
+	auto u = a.unchecked<1>();
+	Vector<double> v(u.shape(0));
+	for (py::ssize_t i = 0; i < u.shape(0); ++i)
+		v(i) = u(i);
+	return v;
+}
+
+Matrix<double, RowMajor> MatrixFromArray(py::array_t<double, py::array::forcecast> a) {
+	if (a.ndim() != 2) throw py::value_error("array must have 2 dimensions");
+	auto u = a.unchecked<2>();
+	Matrix<double, RowMajor> m(u.shape(0), u.shape(1));
+	for (py::ssize_t i = 0; i < u.shape(0); ++i)
+		for (py::ssize_t j = 0; j < u.shape(1); ++j)
+			m(i, j) = u(i, j);
+	return m;
+}
+
+// Element access shared by the matrix classes
+template <typename TM>
+double & MatrixItem(TM & self, std::tuple<int, int> ind) {
+	int i = std::get<0>(ind);
+	int j = std::get<1>(ind);
+	if (i < 0) i += self.Rows();
+	if (j < 0) j += self.Cols();
+	if (i < 0 || i >= int(self.Rows()) || j < 0 || j >= int(self.Cols()))
+		throw py::index_error("matrix index out of range");
+	return self(i, j);
+}
+
+// Zero-copy views of parts of vectors and matrices. Python slices with a
+// positive step map onto the strides; a matrix needs unit step along its
+// contiguous dimension. Methods returning views keep their parent alive.
+struct SliceInfo {
+	size_t start, step, length;
+};
+
+SliceInfo SliceOf(py::slice s, size_t n) {
+	py::ssize_t start, stop, step, length;
+	if (!s.compute(py::ssize_t(n), &start, &stop, &step, &length))
+		throw py::error_already_set();
+	if (step < 1) throw py::value_error("negative slice steps are not supported");
+	return { size_t(start), size_t(step), size_t(length) };
+}
+
+size_t CheckedIndex(int i, size_t n) {
+	if (i < 0) i += n;
+	if (i < 0 || i >= int(n)) throw py::index_error("index out of range");
+	return size_t(i);
+}
+
+template <typename TDIST>
+VectorView<double, size_t> VectorSlice(const VectorView<double, TDIST> & v, py::slice s) {
+	SliceInfo sl = SliceOf(s, v.Size());
+	const size_t dist = v.Dist();
+	return VectorView<double, size_t>(sl.length, dist * sl.step, v.Data() + sl.start * dist);
+}
+
+// dest = src, through a copy if the two share memory
+template <typename TDIST>
+void AssignVector(VectorView<double, size_t> dest, const VectorView<double, TDIST> & src) {
+	if (dest.Size() != src.Size()) throw py::value_error("vector sizes do not match");
+	if (dest.Size() == 0) return;
+	const double * dend = dest.Data() + (dest.Size()-1) * dest.Dist() + 1;
+	const double * send = src.Data() + (src.Size()-1) * size_t(src.Dist()) + 1;
+	// through the expression base, plain view assignment would rebind dest
+	if (dest.Data() < send && src.Data() < dend)
+		dest = static_cast<const VecExpr<VectorView<double>>&>(Vector<double>(src));
+	else
+		dest = static_cast<const VecExpr<VectorView<double, TDIST>>&>(src);
+}
+
+template <ORDERING ORD>
+MatrixView<double, ORD> MatrixSlice(const MatrixView<double, ORD> & a, py::slice rows, py::slice cols) {
+	SliceInfo r = SliceOf(rows, a.Rows()), c = SliceOf(cols, a.Cols());
+	const SliceInfo & inner = (ORD == RowMajor) ? c : r;
+	const SliceInfo & outer = (ORD == RowMajor) ? r : c;
+	if (inner.step != 1 && inner.length > 1)
+		throw py::value_error(ORD == RowMajor ? "column slices of a row-major matrix need step 1"
+		                                      : "row slices of a column-major matrix need step 1");
+	double * data = a.Data() + outer.start * a.Dist() + inner.start;
+	return MatrixView<double, ORD>(r.length, c.length, std::max(a.Dist() * outer.step, inner.length), data);
+}
+
+template <ORDERING ORD>
+MatrixView<double, ORD> RowRangeOf(const MatrixView<double, ORD> & a, size_t first, size_t next) {
+	if (first > next || next > a.Rows()) throw py::index_error("row range out of range");
+	if (first == next) return MatrixView<double, ORD>(0, a.Cols(), a.Dist(), a.Data());
+	return a.RowRange(first, next);
+}
+
+template <ORDERING ORD>
+MatrixView<double, ORD> ColRangeOf(const MatrixView<double, ORD> & a, size_t first, size_t next) {
+	if (first > next || next > a.Cols()) throw py::index_error("column range out of range");
+	if (first == next) return MatrixView<double, ORD>(a.Rows(), 0, a.Dist(), a.Data());
+	return a.ColRange(first, next);
+}
+
+typedef MatrixView<double, RowMajor> PyMatrixView;
+
+void CheckSameSize(size_t n1, size_t n2) {
+	if (n1 != n2) throw py::value_error("vector sizes do not match");
+}
+
+template <typename TA, typename TB>
+void CheckSameShape(const TA & a, const TB & b) {
+	if (a.Rows() != b.Rows() || a.Cols() != b.Cols()) throw py::value_error("matrix shapes do not match");
+}
+
+// self += alpha * x without the GIL. An x overlapping self in another layout
+// (x[1:] += x[:-1]) is copied first, the loop would read updated entries.
+void UpdateVector(VectorView<double, size_t> self, double alpha, VectorView<double, size_t> x) {
+	CheckSameSize(self.Size(), x.Size());
+	py::gil_scoped_release release;
+	const double * xend = x.Data() + x.Size() * x.Dist();
+	const double * send = self.Data() + self.Size() * self.Dist();
+	const bool same = x.Data() == self.Data() && x.Dist() == self.Dist();
+	if (!same && x.Size() && x.Data() < send && self.Data() < xend) {
+		Vector<double> tmp(x);
+		self += alpha * tmp;
+	}
+	else
+		self += alpha * x;
+}
+
+// Deferred evaluation: in deferred mode the arithmetic operators return VectorExpr
+// and MatrixExpr objects instead of computing. Chains like a + b + 2*c are then
+// evaluated in one fused pass (see lazy.hpp) when materialized with eval(),
+// Vector(expr), Matrix(expr) or +=. Outside of deferred mode the operators
+// evaluate at once, through the same kernels. An expression keeps the Python
+// objects it references alive: the operators take the operands as Python objects
+// and store those, a new wrapper of the C++ object would not own a Matrix.
+struct PyVectorExpr {
+	LazyVector<double> expr;
+	std::vector<py::object> keep;
+};
+
+struct PyMatrixExpr {
+	LazyMatrix<double, RowMajor> expr;
+	std::vector<py::object> keep;
+};
+
+// The mode is a contextvars.ContextVar, so it holds per thread and per asyncio task
+py::object & DeferredVar() {
+	// never destroyed, may be used until the interpreter shuts down
+	static py::object * var = new py::object(
+		py::module_::import("contextvars").attr("ContextVar")("bla_deferred", py::arg("default") = false));
+	return *var;
+}
+
+bool DeferredMode() { return DeferredVar().attr("get")().cast<bool>(); }
+
+// with bla.deferred(): ...
+struct DeferredScope {
+	bool on;
+	py::object token;
+};
+
+// An operand as an expression, nullopt if x has another type
+template <typename TE>
+std::optional<TE> Operand(py::handle x);
+
+template <>
+std::optional<PyVectorExpr> Operand(py::handle x) {
+	if (py::isinstance<PyVectorExpr>(x)) return x.cast<PyVectorExpr>();
+	if (py::isinstance<Vector<double>>(x))
+		return PyVectorExpr{ LazyVector<double>(*x.cast<Vector<double>*>()), { py::reinterpret_borrow<py::object>(x) } };
+	if (py::isinstance<VectorView<double, size_t>>(x))   // slices, rows and columns
+		return PyVectorExpr{ LazyVector<double>(*x.cast<VectorView<double, size_t>*>()), { py::reinterpret_borrow<py::object>(x) } };
+	return std::nullopt;
+}
+
+template <>
+std::optional<PyMatrixExpr> Operand(py::handle x) {
+	if (py::isinstance<PyMatrixExpr>(x)) return x.cast<PyMatrixExpr>();
+	if (py::isinstance<PyMatrixView>(x))   // also Matrix
+		return PyMatrixExpr{ LazyMatrix<double, RowMajor>(*x.cast<PyMatrixView*>()), { py::reinterpret_borrow<py::object>(x) } };
+	return std::nullopt;
+}
+
+std::optional<double> ScalarOperand(py::handle x) {
+	try { return x.cast<double>(); }
+	catch (py::cast_error &) { return std::nullopt; }
+}
+
+py::object NotImplemented() { return py::reinterpret_borrow<py::object>(py::handle(Py_NotImplemented)); }
+
+template <typename TE>
+std::vector<py::object> Join(const TE & a, const TE & b) {
+	std::vector<py::object> keep(a.keep);
+	keep.insert(keep.end(), b.keep.begin(), b.keep.end());
+	return keep;
+}
+
+PyVectorExpr operator+ (const PyVectorExpr & a, const PyVectorExpr & b) { return { a.expr + b.expr, Join(a, b) }; }
+PyVectorExpr operator- (const PyVectorExpr & a, const PyVectorExpr & b) { return { a.expr - b.expr, Join(a, b) }; }
+PyVectorExpr operator* (double scal, const PyVectorExpr & a) { return { scal * a.expr, a.keep }; }
+
+PyMatrixExpr operator+ (const PyMatrixExpr & a, const PyMatrixExpr & b) { return { a.expr + b.expr, Join(a, b) }; }
+PyMatrixExpr operator- (const PyMatrixExpr & a, const PyMatrixExpr & b) { return { a.expr - b.expr, Join(a, b) }; }
+PyMatrixExpr operator* (const PyMatrixExpr & a, const PyMatrixExpr & b) { return { a.expr * b.expr, Join(a, b) }; }
+PyMatrixExpr operator* (double scal, const PyMatrixExpr & a) { return { scal * a.expr, a.keep }; }
+
+// Size and shape errors become ValueError
+template <typename F>
+auto Combined(F f) {
+	try { return f(); }
+	catch (std::invalid_argument & e) { throw py::value_error(e.what()); }
+}
+
+Vector<double> Evaluate(const PyVectorExpr & e, size_t threads = 0) {
+	Vector<double> res(e.expr.Size());
+	py::gil_scoped_release release;
+	e.expr.Evaluate(res, threads);
+	return res;
+}
+
+Matrix<double, RowMajor> Evaluate(const PyMatrixExpr & e, size_t threads = 0) {
+	Matrix<double, RowMajor> res(e.expr.Rows(), e.expr.Cols());
+	py::gil_scoped_release release;
+	e.expr.Evaluate(res, threads);
+	return res;
+}
+
+// Result of an operator: the expression in deferred mode, else its value
+template <typename TE>
+py::object Result(const TE & e) {
+	if (DeferredMode()) return py::cast(e);
+	return py::cast(Evaluate(e));
+}
+
+// Operators on Python operands, NotImplemented for other types.
+// op returns the Python result, for Result(...) or an expression.
+template <typename TE, typename F>
+py::object Binary(py::handle a, py::handle b, F op) {
+	auto x = Operand<TE>(a), y = Operand<TE>(b);
+	if (!x || !y) return NotImplemented();
+	return Combined([&] { return op(*x, *y); });
+}
+
+template <typename TE, typename F>
+py::object Scaled(py::handle a, py::handle scal, F op) {
+	auto x = Operand<TE>(a);
+	auto s = ScalarOperand(scal);
+	if (!x || !s) return NotImplemented();
+	return op(*s, *x);
+}
+
+
+template <ORDERING ORD>
+void BindMatrixView(py::module & m, const char * name) {
+	typedef MatrixView<double, ORD> TV;
+	py::class_<TV> cls(m, name, py::buffer_protocol());
+	cls
+		.def(py::init([](py::buffer b) { return WrapMatrix<ORD>(b); }), py::keep_alive<1, 2>(),
+			py::arg("array"), "view of a float64 array, sharing its memory")
+		.def_buffer([](TV & self) { return MatrixBuffer(self); })
+		.def("__setitem__", [](TV & self, std::tuple<int, int> ind, double v) { MatrixItem(self, ind) = v; })
+		.def("__getitem__", [](TV & self, std::tuple<int, int> ind) { return MatrixItem(self, ind); })
+		.def_property_readonly("shape", [](TV & self) { return std::tuple(self.Rows(), self.Cols()); })
+
+		// Views, sharing memory with self
+		.def("__getitem__", [](TV & self, std::tuple<py::slice, py::slice> ind) {
+			return MatrixSlice(self, std::get<0>(ind), std::get<1>(ind));
+		}, py::keep_alive<0, 1>(), "sub-matrix a[r0:r1, c0:c1] as a view")
+		.def("__getitem__", [](TV & self, std::tuple<int, py::slice> ind) {
+			return VectorSlice(self.Row(CheckedIndex(std::get<0>(ind), self.Rows())), std::get<1>(ind));
+		}, py::keep_alive<0, 1>(), "part of a row as a view")
+		.def("__getitem__", [](TV & self, std::tuple<py::slice, int> ind) {
+			return VectorSlice(self.Col(CheckedIndex(std::get<1>(ind), self.Cols())), std::get<0>(ind));
+		}, py::keep_alive<0, 1>(), "part of a column as a view")
+		.def("__setitem__", [](TV & self, std::tuple<py::slice, py::slice> ind, double v) {
+			MatrixSlice(self, std::get<0>(ind), std::get<1>(ind)) = v;
+		})
+		.def("__setitem__", [](TV & self, std::tuple<py::slice, py::slice> ind, const PyMatrixView & other) {
+			TV dest = MatrixSlice(self, std::get<0>(ind), std::get<1>(ind));
+			CheckSameShape(dest, other);
+			// through the expression base, plain view assignment would rebind dest
+			if (detail::Overlaps(dest, other)) dest = static_cast<const MatExpr<PyMatrixView>&>(Matrix<double, RowMajor>(other));
+			else dest = static_cast<const MatExpr<PyMatrixView>&>(other);
+		})
+		.def("row", [](TV & self, int i) { return self.Row(CheckedIndex(i, self.Rows())); },
+			py::keep_alive<0, 1>(), py::arg("i"), "row i as a VectorView")
+		.def("col", [](TV & self, int j) { return self.Col(CheckedIndex(j, self.Cols())); },
+			py::keep_alive<0, 1>(), py::arg("j"), "column j as a VectorView")
+		.def("row_range", &RowRangeOf<ORD>, py::keep_alive<0, 1>(),
+			py::arg("first"), py::arg("next"), "rows [first, next) as a view")
+		.def("col_range", &ColRangeOf<ORD>, py::keep_alive<0, 1>(),
+			py::arg("first"), py::arg("next"), "columns [first, next) as a view")
+		.def("diag", [](TV & self) { return self.Diag(); }, py::keep_alive<0, 1>(), "main diagonal as a VectorView")
+		.def("transpose", [](TV & self) { return self.Transpose(); }, py::keep_alive<0, 1>(),
+			"transposed view, with the other ordering")
+		.def_property_readonly("T", [](TV & self) { return self.Transpose(); }, py::keep_alive<0, 1>())
+		.def("copy", [](TV & self) { return Matrix<double, RowMajor>(self); }, "copy into a new Matrix")
+		// In-place updates return self, nothing is allocated
+		.def("__iadd__", [](TV & self, const PyMatrixView & other) -> TV & {
+			CheckSameShape(self, other);
+			py::gil_scoped_release release;
+			self += other;
+			return self;
+		}, py::is_operator())
+		.def("__isub__", [](TV & self, const PyMatrixView & other) -> TV & {
+			CheckSameShape(self, other);
+			py::gil_scoped_release release;
+			self -= other;
+			return self;
+		}, py::is_operator())
+		.def("__imul__", [](TV & self, double scal) -> TV & {
+			py::gil_scoped_release release;
+			self *= scal;
+			return self;
+		}, py::is_operator())
+		.def("axpy", [](TV & self, double alpha, const PyMatrixView & x) -> TV & {
+			CheckSameShape(self, x);
+			py::gil_scoped_release release;
+			self += alpha * x;
+			return self;
+		}, py::arg("alpha"), py::arg("x"), "self += alpha*x in one pass, returns self")
+		.def("__str__", [](const TV & self) {
+			std::stringstream str;
+			str << self;
+			return str.str();
+		})
+		;
+
+	// Arithmetic on row-major matrices and views, also inherited by Matrix
+	if constexpr (ORD == RowMajor) {
+		cls
+		.def("__add__", [](py::object self, py::object other) {
+			return Binary<PyMatrixExpr>(self, other, [](auto & a, auto & b) { return Result(a + b); });
+		}, py::is_operator())
+		.def("__sub__", [](py::object self, py::object other) {
+			return Binary<PyMatrixExpr>(self, other, [](auto & a, auto & b) { return Result(a - b); });
+		}, py::is_operator())
+		.def("__neg__", [](py::object self) { return Result(-1.0 * *Operand<PyMatrixExpr>(self)); })
+		.def("__mul__", [](py::object self, py::object other) {
+			if (Operand<PyMatrixExpr>(other))
+				return Binary<PyMatrixExpr>(self, other, [](auto & a, auto & b) { return Result(a * b); });
+			return Scaled<PyMatrixExpr>(self, other, [](double s, auto & a) { return Result(s * a); });
+		}, py::is_operator())
+		.def("__rmul__", [](py::object self, py::object scal) {
+			return Scaled<PyMatrixExpr>(self, scal, [](double s, auto & a) { return Result(s * a); });
+		}, py::is_operator())
+
+		// C += expression, e.g. C[i0:i1, j0:j1] += lazy(A) * lazy(B) in a blocked algorithm
+		.def("__iadd__", [](PyMatrixView & self, const PyMatrixExpr & other) -> PyMatrixView & {
+			CheckSameShape(self, other.expr);
+			LazyMatrix<double, RowMajor> sum = LazyMatrix<double, RowMajor>(self) + other.expr;
+			py::gil_scoped_release release;
+			sum.Evaluate(self);
+			return self;
+		}, py::is_operator())
+		;
+	}
+}
+
+
+
+// Heavy kernels run with the GIL released, so other Python threads keep running.
+// Arguments are converted and results returned while holding it.
+typedef py::call_guard<py::gil_scoped_release> ReleaseGIL;
+
+MultBackend ParseBackend(const std::string & name, size_t m, size_t n, size_t k) {
+	if (name == "auto") return ChooseMultBackend(m, n, k, true, true);
+	for (MultBackend b : { MultBackend::Expression, MultBackend::Native, MultBackend::Parallel, MultBackend::Lapack })
+		if (name == BackendName(b)) return b;
+	throw py::value_error("unknown backend '" + name + "', expected auto, native, parallel, lapack or expression");
+}
+
+// out= parameters: the result is written into out if given (same shape, nothing allocated),
+// otherwise into a new object. eval runs without the GIL.
+template <typename F>
+py::object VectorInto(py::object out, size_t n, F eval) {
+	if (out.is_none()) {
+		Vector<double> res(n);
+		{
+			py::gil_scoped_release release;
+			eval(res);
+		}
+		return py::cast(std::move(res));
+	}
+	// a Vector or a VectorView
+	VectorView<double, size_t> res = out.cast<VectorView<double, size_t>>();
+	if (res.Size() != n) throw py::value_error("out has the wrong size");
+	py::gil_scoped_release release;
+	eval(res);
+	return out;
+}
+
+template <typename F>
+py::object MatrixInto(py::object out, size_t rows, size_t cols, F eval) {
+	if (out.is_none()) {
+		Matrix<double, RowMajor> res(rows, cols);
+		{
+			py::gil_scoped_release release;
+			eval(res);
+		}
+		return py::cast(std::move(res));
+	}
+	PyMatrixView * res = out.cast<PyMatrixView*>();
+	if (res->Rows() != rows || res->Cols() != cols) throw py::value_error("out has the wrong shape");
+	py::gil_scoped_release release;
+	eval(*res);
+	return out;
+}
+
+// True if the memory spanned by the two views intersects
+bool Overlaps(const PyMatrixView & a, const PyMatrixView & b) {
+	auto end = [](const PyMatrixView & v) { return v.Data() + (v.Rows() ? (v.Rows()-1) * v.Dist() + v.Cols() : 0); };
+	return a.Data() < end(b) && b.Data() < end(a);
+}
+
+// C = A*B with the chosen engine (see dispatch.hpp), threads for the parallel one
+py::object MatMul(const PyMatrixView & a, const PyMatrixView & b, const std::string & backend, size_t threads, py::object out) {
+	if (a.Cols() != b.Rows()) throw py::value_error("matrix dimensions do not match for multiplication");
+	MultBackend engine = ParseBackend(backend, a.Rows(), b.Cols(), a.Cols());
+	if (threads == 0) threads = GetDispatchThresholds().threads;
+	if (!out.is_none()) {
+		PyMatrixView * c = out.cast<PyMatrixView*>();
+		if (Overlaps(*c, a) || Overlaps(*c, b)) throw py::value_error("out must not share memory with a or b");
+	}
+
+	return MatrixInto(out, a.Rows(), b.Cols(), [&](PyMatrixView c) {
+		switch (engine) {
+			case MultBackend::Expression: MultMatMatSmall(a, b, c); break;
+			case MultBackend::Native:     MultMatMatNative<RowMajor>(a, b, c); break;
+			case MultBackend::Parallel:   MultMatMatNative<RowMajor>(a, b, c, threads); break;
+			case MultBackend::Lapack:     MultMatMatLapack(a, b, c); break;
+		}
+	});
+}
+
+// A product started with matmul_async: holds the operands until it is finished
+struct PyAsync {
+	AsyncHandle handle;
+	py::object a, b, result;
+
+	PyAsync(py::object _a, py::object _b, py::object _result)
+		: a(std::move(_a)), b(std::move(_b)), result(std::move(_result)) { }
+
+	~PyAsync() {
+		// the worker thread may still use a, b and result
+		if (!handle.Ready()) {
+			py::gil_scoped_release release;
+			try { handle.Wait(); } catch (...) { }
+		}
+	}
+
+	py::object Wait() {
+		{
+			py::gil_scoped_release release;
+			handle.Wait();
+		}
+		return result;
+	}
+};
+
+std::unique_ptr<PyAsync> MatMulAsync(py::object a, py::object b, py::object out) {
+	const PyMatrixView & va = *a.cast<PyMatrixView*>();
+	const PyMatrixView & vb = *b.cast<PyMatrixView*>();
+	if (va.Cols() != vb.Rows()) throw py::value_error("matrix dimensions do not match for multiplication");
+	if (out.is_none()) out = py::cast(Matrix<double, RowMajor>(va.Rows(), vb.Cols()));
+	PyMatrixView c = *out.cast<PyMatrixView*>();
+	if (c.Rows() != va.Rows() || c.Cols() != vb.Cols()) throw py::value_error("out has the wrong shape");
+	if (Overlaps(c, va) || Overlaps(c, vb)) throw py::value_error("out must not share memory with a or b");
+
+	auto res = std::make_unique<PyAsync>(a, b, out);
+	res->handle = (va * vb | Async).Into(c);
+	return res;
+}
+
+typedef LapackLU<RowMajor> PyLU;
+
+PyLU Factor(const PyMatrixView & a) {
+	if (a.Rows() != a.Cols()) throw py::value_error("matrix must be square");
+	Matrix<double, RowMajor> copy(a);
+	py::gil_scoped_release release;
+	return PyLU(std::move(copy));
+}
+
+void CheckSolvable(const PyLU & lu, size_t n, size_t size) {
+	if (lu.Info() > 0) throw py::value_error("matrix is singular");
+	if (size != n) throw py::value_error("right hand side has the wrong size");
+}
+
+Vector<double> SolveLU(const PyLU & lu, size_t n, const Vector<double> & b) {
+	CheckSolvable(lu, n, b.Size());
+	Vector<double> x(b);
+	py::gil_scoped_release release;
+	lu.Solve(x);
+	return x;
+}
+
+Matrix<double, RowMajor> SolveLU(const PyLU & lu, size_t n, const PyMatrixView & b) {
+	CheckSolvable(lu, n, b.Rows());
+	py::gil_scoped_release release;
+	Matrix<double, ColMajor> x(b);
+	lu.Solve(x);
+	return Matrix<double, RowMajor>(x);
+}
+
+bool UseLapack(const std::string & backend) {
+	if (backend == "auto" || backend == "lapack") return true;
+	if (backend == "native") return false;
+	throw py::value_error("unknown backend '" + backend + "', expected auto, native or lapack");
+}
+
+
+// Batched operations: a stack is either a float64 array with one more dimension
+// than its items (C-contiguous rows), or a list or tuple of items. Results are
+// arrays for array input and lists of new objects otherwise. The whole batch
+// runs in one call without the GIL, see batched.hpp.
+bool IsSequence(const py::object & obj) {
+	return py::isinstance<py::list>(obj) || py::isinstance<py::tuple>(obj);
+}
+
+std::vector<PyMatrixView> MatrixStack(py::object obj, bool writable = false) {
+	std::vector<PyMatrixView> stack;
+	if (IsSequence(obj)) {
+		for (py::handle item : obj) {
+			if (py::isinstance<PyMatrixView>(item)) stack.push_back(*item.cast<PyMatrixView*>());
+			else stack.push_back(WrapMatrix<RowMajor>(py::reinterpret_borrow<py::buffer>(item)));
+		}
+		return stack;
+	}
+	py::buffer_info info = RequestBuffer(py::reinterpret_borrow<py::buffer>(obj), 3, writable);
+	const size_t rows = info.shape[1], cols = info.shape[2];
+	const size_t rstride = info.strides[1] / sizeof(double), cstride = info.strides[2] / sizeof(double);
+	const size_t dist = rows > 1 ? rstride : cols;
+	if ((cstride != 1 && cols > 1) || dist < cols)
+		throw py::value_error("matrices of the stack must have C-contiguous rows");
+	for (py::ssize_t i = 0; i < info.shape[0]; ++i)
+		stack.emplace_back(rows, cols, dist, reinterpret_cast<double*>(static_cast<char*>(info.ptr) + i * info.strides[0]));
+	return stack;
+}
+
+std::vector<VectorView<double, size_t>> VectorStack(py::object obj, bool writable = false) {
+	std::vector<VectorView<double, size_t>> stack;
+	if (IsSequence(obj)) {
+		for (py::handle item : obj) {
+			if (py::isinstance<Vector<double>>(item)) stack.emplace_back(*item.cast<Vector<double>*>());
+			else if (py::isinstance<VectorView<double, size_t>>(item)) stack.push_back(*item.cast<VectorView<double, size_t>*>());
+			else stack.push_back(WrapVector(py::reinterpret_borrow<py::buffer>(item)));
+		}
+		return stack;
+	}
+	py::buffer_info info = RequestBuffer(py::reinterpret_borrow<py::buffer>(obj), 2, writable);
+	for (py::ssize_t i = 0; i < info.shape[0]; ++i)
+		stack.emplace_back(info.shape[1], info.strides[1] / sizeof(double),
+			reinterpret_cast<double*>(static_cast<char*>(info.ptr) + i * info.strides[0]));
+	return stack;
+}
+
+// Invalid shapes in a batch become ValueError
+template <typename F>
+auto RunBatch(F f) {
+	try {
+		py::gil_scoped_release release;
+		return f();
+	}
+	catch (std::invalid_argument & e) { throw py::value_error(e.what()); }
+}
+
+py::object BatchedMatMul(py::object a, py::object b, py::object out, size_t threads) {
+	std::vector<PyMatrixView> as = MatrixStack(a), bs = MatrixStack(b), cs;
+	if (as.size() != bs.size()) throw py::value_error("batch sizes do not match");
+	py::object result = out;
+	if (!out.is_none())
+		cs = MatrixStack(out, true);
+	else if (!IsSequence(a)) {
+		const size_t rows = as.empty() ? 0 : as[0].Rows(), cols = bs.empty() ? 0 : bs[0].Cols();
+		py::array_t<double> c({ py::ssize_t(as.size()), py::ssize_t(rows), py::ssize_t(cols) });
+		result = c;
+		cs = MatrixStack(result, true);
+	}
+	else {
+		py::list c;
+		for (size_t i = 0; i < as.size(); ++i)
+			c.append(py::cast(Matrix<double, RowMajor>(as[i].Rows(), bs[i].Cols())));
+		result = c;
+		cs = MatrixStack(result, true);
+	}
+	RunBatch([&] { BatchedMultiply(as, bs, cs, threads); return 0; });
+	return result;
+}
+
+py::object BatchedSolveStack(py::object a, py::object b, size_t threads) {
+	std::vector<PyMatrixView> as = MatrixStack(a);
+	std::vector<VectorView<double, size_t>> bs = VectorStack(b);
+	if (as.size() != bs.size()) throw py::value_error("batch sizes do not match");
+	py::object result;
+	if (!IsSequence(b)) {
+		py::array_t<double> x({ py::ssize_t(bs.size()), py::ssize_t(bs.empty() ? 0 : bs[0].Size()) });
+		result = x;
+	}
+	else {
+		py::list x;
+		for (auto & bi : bs)
+			x.append(py::cast(Vector<double>(bi.Size())));
+		result = x;
+	}
+	std::vector<VectorView<double, size_t>> xs = VectorStack(result, true);
+	std::vector<size_t> info = RunBatch([&] { return BatchedSolve(as, bs, xs, threads); });
+	for (size_t i = 0; i < info.size(); ++i)
+		if (info[i] > 0) throw py::value_error("matrix " + std::to_string(i) + " of the batch is singular");
+	return result;
+}
+
+py::array_t<double> BatchedDotStack(py::object x, py::object y, size_t threads) {
+	std::vector<VectorView<double, size_t>> xs = VectorStack(x), ys = VectorStack(y);
+	std::vector<double> dots = RunBatch([&] { return BatchedDot(xs, ys, threads); });
+	py::array_t<double> res(py::ssize_t(dots.size()));
+	std::copy(dots.begin(), dots.end(), res.mutable_data());
+	return res;
+}
+
+
+// Pickling. With protocol 5 the data is handed to pickle as a PickleBuffer, so it
+// can travel out of band (buffer_callback / buffers=, e.g. through
+// multiprocessing.shared_memory) without being copied into the pickle stream.
+// Unpickling adopts a writable buffer as the storage of the new object instead
+// of copying it; read-only buffers (protocols < 5) are copied.
+
+// Adopts the memory of a Python buffer (see AdoptingAllocator in memory.hpp),
+// keeping the buffer object alive until that memory is returned. The owning
+// Vector or Matrix may be freed on any thread, the GIL is taken only to drop
+// the buffer. The adopted memory is only as aligned as the buffer, the kernels
+// check that.
+class BufferAllocator : public AdoptingAllocator {
+	py::object owner;
+
+	void Release() override {
+		py::gil_scoped_acquire gil;
+		owner = py::object();
+	}
+
+public:
+	BufferAllocator(py::object _owner, void * _mem, size_t _size) : AdoptingAllocator(_mem, _size), owner(std::move(_owner)) { }
+
+	// the buffer was never handed out
+	~BufferAllocator() override {
+		if (owner) Release();
+	}
+};
+
+// Allocator adopting the memory of b if it holds exactly 'bytes' bytes, is
+// writable, contiguous and aligned for doubles, else nullptr
+BufferAllocator * AdoptBuffer(py::buffer b, const py::buffer_info & info, size_t bytes) {
+	if (bytes == 0 || info.readonly || size_t(info.size * info.itemsize) != bytes
+	    || !IsAligned(info.ptr, alignof(double)))
+		return nullptr;
+	py::ssize_t stride = info.itemsize;
+	for (py::ssize_t d = info.ndim; d-- > 0; ) {
+		if (info.shape[d] > 1 && info.strides[d] != stride) return nullptr;
+		stride *= info.shape[d];
+	}
+	return new BufferAllocator(b, info.ptr, bytes);
+}
+
+// Raw bytes of a contiguous buffer, for the copying fallback
+const char * BufferBytes(const py::buffer_info & info, size_t bytes) {
+	if (size_t(info.size * info.itemsize) != bytes)
+		throw py::value_error("pickled buffer has the wrong size");
+	if (info.ndim > 1 || (info.ndim == 1 && info.shape[0] > 1 && info.strides[0] != info.itemsize))
+		throw py::value_error("pickled buffer is not contiguous");
+	return static_cast<const char*>(info.ptr);
+}
+
+Vector<double> VectorFromBuffer(py::buffer b) {
+	py::buffer_info info = b.request();
+	const size_t n = size_t(info.size * info.itemsize) / sizeof(double);
+	if (BufferAllocator * alloc = AdoptBuffer(b, info, n * sizeof(double)))
+		return Vector<double>(n, *alloc);
+	Vector<double> v(n);
+	if (n > 0) std::memcpy(v.Data(), BufferBytes(info, n * sizeof(double)), n * sizeof(double));
+	return v;
+}
+
+Matrix<double, RowMajor> MatrixFromBuffer(py::buffer b, size_t rows, size_t cols) {
+	py::buffer_info info = b.request();
+	const size_t bytes = rows * cols * sizeof(double);
+	if (BufferAllocator * alloc = AdoptBuffer(b, info, bytes))
+		return Matrix<double, RowMajor>(rows, cols, *alloc);
+	Matrix<double, RowMajor> a(rows, cols);
+	if (bytes > 0) std::memcpy(a.Data(), BufferBytes(info, bytes), bytes);
+	return a;
+}
+
+// Data for the reconstructor: a PickleBuffer for protocol 5, else a copy as bytes
+py::object PickleData(py::object obj, const double * data, size_t n, int protocol) {
+	if (protocol >= 5)
+		return py::module::import("pickle").attr("PickleBuffer")(obj);
+	return py::bytes(reinterpret_cast<const char*>(data), n * sizeof(double));
+}
 
 
 PYBIND11_MODULE(bla, m) {
     m.doc() = "Basic linear algebra module"; // optional module docstring
     
-    py::class_<Vector<double>> (m, "Vector")
+    py::class_<Vector<double>> (m, "Vector", py::buffer_protocol())
 		.def(py::init<size_t>(),
 			py::arg("size"), "create vector of given size")
 
+		.def(py::init(&VectorFromArray),
+			py::arg("array"), "create vector as a copy of a 1-d array")
+
+		.def_buffer([](Vector<double> & self) { return VectorBuffer(self); })
+
 		.def("__len__", &Vector<double>::Size,
 			"return size of vector")
 		
@@ -30,26 +790,66 @@ PYBIND11_MODULE(bla, m) {
 		.def("__getitem__", [](Vector<double> & self, int i) { return self(i); })
 		
 		.def("__setitem__", [](Vector<double> & self, py::slice inds, double val) {
-		size_t start, stop, step, n;
-		if (!inds.compute(self.Size(), &start, &stop, &step, &n))
-			throw py::error_already_set();
-		self.Range(start, stop).Slice(0,step) = val;
+		VectorSlice(self, inds) = val;
+		})
+
+		.def("__setitem__", [](Vector<double> & self, py::slice inds, const VectorView<double, size_t> & v) {
+		AssignVector(VectorSlice(self, inds), v);
 		})
+
+		.def("__setitem__", [](Vector<double> & self, py::slice inds, const Vector<double> & v) {
+		AssignVector(VectorSlice(self, inds), v);
+		})
+
+		.def("__getitem__", [](Vector<double> & self, py::slice inds) { return VectorSlice(self, inds); },
+			py::keep_alive<0, 1>(), "slice as a VectorView, sharing memory")
 		
-		.def("__add__", [](Vector<double> & self, Vector<double> & other)
-		{ return Vector<double> (self+other); })
+		.def(py::init([](const PyVectorExpr & e) { return Evaluate(e); }),
+			py::arg("expr"), "evaluate an expression into a new vector")
 
-		.def("__sub__", [](Vector<double> & self, Vector<double> & other)
-		{ return Vector<double> (self-other); })
+		.def("__add__", [](py::object self, py::object other) {
+			return Binary<PyVectorExpr>(self, other, [](auto & a, auto & b) { return Result(a + b); });
+		}, py::is_operator())
+		.def("__sub__", [](py::object self, py::object other) {
+			return Binary<PyVectorExpr>(self, other, [](auto & a, auto & b) { return Result(a - b); });
+		}, py::is_operator())
+		.def("__neg__", [](py::object self) { return Result(-1.0 * *Operand<PyVectorExpr>(self)); })
+		.def("__mul__", [](py::object self, py::object scal) {
+			return Scaled<PyVectorExpr>(self, scal, [](double s, auto & a) { return Result(s * a); });
+		}, py::is_operator())
+		.def("__rmul__", [](py::object self, py::object scal) {
+			return Scaled<PyVectorExpr>(self, scal, [](double s, auto & a) { return Result(s * a); });
+		}, py::is_operator())
 
-		.def("__neg__", [](Vector<double> & self)
-		{ return Vector<double> (-self); })
+		// In-place updates return self, nothing is allocated
+		.def("__iadd__", [](Vector<double> & self, const VectorView<double, size_t> & other) -> Vector<double> & {
+			UpdateVector(self, 1.0, other);
+			return self;
+		}, py::is_operator())
 
-		.def("__mul__", [](Vector<double> & self, double scal)
-    	{ return Vector<double> (scal*self); })
+		.def("__iadd__", [](Vector<double> & self, const PyVectorExpr & other) -> Vector<double> & {
+			CheckSameSize(self.Size(), other.expr.Size());
+			LazyVector<double> sum = LazyVector<double>(self) + other.expr;
+			py::gil_scoped_release release;
+			sum.Evaluate(self);
+			return self;
+		}, py::is_operator())
 
-		.def("__rmul__", [](Vector<double> & self, double scal)
-		{ return Vector<double> (scal*self); })
+		.def("__isub__", [](Vector<double> & self, const VectorView<double, size_t> & other) -> Vector<double> & {
+			UpdateVector(self, -1.0, other);
+			return self;
+		}, py::is_operator())
+
+		.def("__imul__", [](Vector<double> & self, double scal) -> Vector<double> & {
+			py::gil_scoped_release release;
+			self *= scal;
+			return self;
+		}, py::is_operator())
+
+		.def("axpy", [](Vector<double> & self, double alpha, const VectorView<double, size_t> & x) -> Vector<double> & {
+			UpdateVector(self, alpha, x);
+			return self;
+		}, py::arg("alpha"), py::arg("x"), "self += alpha*x in one pass, returns self")
 		
 		.def("__str__", [](const Vector<double> & self) {
 			std::stringstream str;
@@ -57,6 +857,13 @@ PYBIND11_MODULE(bla, m) {
 			return str.str();
 		})
 
+		.def("__reduce_ex__", [m](py::object self, int protocol) {
+			Vector<double> & v = *self.cast<Vector<double>*>();
+			return py::make_tuple(m.attr("_vector_from_buffer"),
+				py::make_tuple(PickleData(self, v.Data(), v.Size(), protocol)));
+		})
+
+		// __reduce_ex__ takes precedence, __setstate__ still reads older pickles
 		.def(py::pickle(
 		[](Vector<double> & self) { // __getstate__
 			/* return a tuple that fully encodes the state of the object */
@@ -75,54 +882,317 @@ PYBIND11_MODULE(bla, m) {
 		
 		;
 
-	py::class_<Matrix<double, RowMajor>> (m, "Matrix")
+	BindMatrixView<RowMajor>(m, "MatrixView");
+	BindMatrixView<ColMajor>(m, "ColMajorMatrixView");
+
+	// a Matrix is accepted wherever a MatrixView is
+	py::class_<Matrix<double, RowMajor>, PyMatrixView> (m, "Matrix", py::buffer_protocol())
 		.def(py::init<size_t, size_t>(),
 			py::arg("rows"), py::arg("cols"), "create matrix of given size")
 
+		.def(py::init(&MatrixFromArray),
+			py::arg("array"), "create matrix as a copy of a 2-d array")
+
+		.def_buffer([](Matrix<double, RowMajor> & self) { return MatrixBuffer<RowMajor>(self); })
+
 		.def("__setitem__", [](Matrix<double, RowMajor> & self, 
 								std::tuple<int, int> ind, double v) {
-		int i = std::get<0>(ind);
-		int j = std::get<1>(ind);
-		if (i < 0) i += self.Rows();
-		if (j < 0) j += self.Cols();
-		if (i < 0 || i >= self.Rows() || j < 0 || j >= self.Cols())
-			throw py::index_error("matrix index out of range");
-		self(i, j) = v;
+		MatrixItem(self, ind) = v;
 		})
 
 		.def("__getitem__", [](Matrix<double, RowMajor> & self, 
 								std::tuple<int, int> ind) {
-		int i = std::get<0>(ind);
-		int j = std::get<1>(ind);
-		if (i < 0) i += self.Rows();
-		if (j < 0) j += self.Cols();
-		if (i < 0 || i >= self.Rows() || j < 0 || j >= self.Cols())
-			throw py::index_error("matrix index out of range");
-		return self(i, j);
+		return MatrixItem(self, ind);
 		})
 
 		.def_property_readonly("shape", [](Matrix<double, RowMajor> & self) {
 			return std::tuple(self.Rows(), self.Cols());
 		})
 
-		.def("__add__", [](Matrix<double, RowMajor> & self, Matrix<double, RowMajor> & other)
-		{ return Matrix<double, RowMajor> (self+other); })
+		.def(py::init([](const PyMatrixExpr & e) { return Evaluate(e); }),
+			py::arg("expr"), "evaluate an expression into a new matrix")
 
-		.def("__sub__", [](Matrix<double, RowMajor> & self, Matrix<double, RowMajor> & other)
-		{ return Matrix<double, RowMajor> (self-other); })
+		.def("__reduce_ex__", [m](py::object self, int protocol) {
+			Matrix<double, RowMajor> & a = *self.cast<Matrix<double, RowMajor>*>();
+			// a padded matrix is pickled from a contiguous copy
+			py::object data = (a.Dist() == a.Cols()) ? self : py::cast(Matrix<double, RowMajor>(a));
+			Matrix<double, RowMajor> & c = *data.cast<Matrix<double, RowMajor>*>();
+			return py::make_tuple(m.attr("_matrix_from_buffer"),
+				py::make_tuple(PickleData(data, c.Data(), c.Rows() * c.Cols(), protocol), a.Rows(), a.Cols()));
+		})
 
-		.def("__neg__", [](Matrix<double, RowMajor> & self)
-		{ return Matrix<double, RowMajor> (-self); })
+		.def("__str__", [](const Matrix<double, RowMajor> & self) {
+			std::stringstream str;
+			str << self;
+			return str.str();
+		})
 
-		.def("__mul__", [](Matrix<double, RowMajor> & self, 
-							Matrix<double, RowMajor> & other) 
-		{ return Matrix<double, RowMajor> (self*other); })
+		;
 
-		.def("__str__", [](const Matrix<double, RowMajor> & self) {
+	py::class_<VectorView<double, size_t>> (m, "VectorView", py::buffer_protocol())
+		.def(py::init(&WrapVector), py::keep_alive<1, 2>(),
+			py::arg("array"), "view of a 1-d float64 array, sharing its memory")
+		.def_buffer([](VectorView<double, size_t> & self) { return VectorBuffer(self); })
+		.def("__len__", &VectorView<double, size_t>::Size)
+		.def("__setitem__", [](VectorView<double, size_t> & self, int i, double v) {
+			if (i < 0) i += self.Size();
+			if (i < 0 || i >= int(self.Size())) throw py::index_error("vector index out of range");
+			self(i) = v;
+		})
+		.def("__getitem__", [](VectorView<double, size_t> & self, int i) {
+			if (i < 0) i += self.Size();
+			if (i < 0 || i >= int(self.Size())) throw py::index_error("vector index out of range");
+			return self(i);
+		})
+		.def("__getitem__", [](VectorView<double, size_t> & self, py::slice inds) { return VectorSlice(self, inds); },
+			py::keep_alive<0, 1>(), "slice as a VectorView, sharing memory")
+		.def("__setitem__", [](VectorView<double, size_t> & self, py::slice inds, double val) {
+			VectorSlice(self, inds) = val;
+		})
+		.def("__setitem__", [](VectorView<double, size_t> & self, py::slice inds, const VectorView<double, size_t> & v) {
+			AssignVector(VectorSlice(self, inds), v);
+		})
+		.def("__setitem__", [](VectorView<double, size_t> & self, py::slice inds, const Vector<double> & v) {
+			AssignVector(VectorSlice(self, inds), v);
+		})
+		.def("__add__", [](py::object self, py::object other) {
+			return Binary<PyVectorExpr>(self, other, [](auto & a, auto & b) { return Result(a + b); });
+		}, py::is_operator())
+		.def("__sub__", [](py::object self, py::object other) {
+			return Binary<PyVectorExpr>(self, other, [](auto & a, auto & b) { return Result(a - b); });
+		}, py::is_operator())
+		.def("__neg__", [](py::object self) { return Result(-1.0 * *Operand<PyVectorExpr>(self)); })
+		.def("__mul__", [](py::object self, py::object scal) {
+			return Scaled<PyVectorExpr>(self, scal, [](double s, auto & a) { return Result(s * a); });
+		}, py::is_operator())
+		.def("__rmul__", [](py::object self, py::object scal) {
+			return Scaled<PyVectorExpr>(self, scal, [](double s, auto & a) { return Result(s * a); });
+		}, py::is_operator())
+		.def("__iadd__", [](VectorView<double, size_t> & self, const VectorView<double, size_t> & other) -> VectorView<double, size_t> & {
+			UpdateVector(self, 1.0, other);
+			return self;
+		}, py::is_operator())
+		.def("__iadd__", [](VectorView<double, size_t> & self, const PyVectorExpr & other) -> VectorView<double, size_t> & {
+			CheckSameSize(self.Size(), other.expr.Size());
+			LazyVector<double> sum = LazyVector<double>(self) + other.expr;
+			py::gil_scoped_release release;
+			sum.Evaluate(self);
+			return self;
+		}, py::is_operator())
+		.def("__isub__", [](VectorView<double, size_t> & self, const VectorView<double, size_t> & other) -> VectorView<double, size_t> & {
+			UpdateVector(self, -1.0, other);
+			return self;
+		}, py::is_operator())
+		.def("__imul__", [](VectorView<double, size_t> & self, double scal) -> VectorView<double, size_t> & {
+			py::gil_scoped_release release;
+			self *= scal;
+			return self;
+		}, py::is_operator())
+		.def("axpy", [](VectorView<double, size_t> & self, double alpha, const VectorView<double, size_t> & x) -> VectorView<double, size_t> & {
+			UpdateVector(self, alpha, x);
+			return self;
+		}, py::arg("alpha"), py::arg("x"), "self += alpha*x in one pass, returns self")
+		.def("copy", [](VectorView<double, size_t> & self) { return Vector<double>(self); }, "copy into a new Vector")
+		.def("__str__", [](const VectorView<double, size_t> & self) {
 			std::stringstream str;
 			str << self;
 			return str.str();
 		})
+		;
+	// a Vector is accepted wherever a VectorView is, through its buffer
+	py::implicitly_convertible<Vector<double>, VectorView<double, size_t>>();
+
+	m.def("asmatrix", [](py::buffer b) -> py::object {
+		py::buffer_info info = RequestBuffer(b, 2);
+		// Fortran-contiguous columns (and not also C-contiguous rows) map to ColMajor
+		if (info.strides[0] == sizeof(double) && info.shape[0] > 1 && info.strides[1] != sizeof(double))
+			return py::cast(WrapMatrix<ColMajor>(b));
+		return py::cast(WrapMatrix<RowMajor>(b));
+	}, py::keep_alive<0, 1>(), py::arg("array"),
+	"view of a 2-d float64 array without copying, MatrixView for C order, ColMajorMatrixView for Fortran order");
+
+	m.def("matmul", &MatMul, py::arg("a"), py::arg("b"), py::arg("backend") = "auto", py::arg("threads") = 0,
+		py::arg("out") = py::none(),
+		"a*b with backend 'auto', 'native', 'parallel', 'lapack' or 'expression'; "
+		"threads for 'parallel' (0: configured default). Runs without holding the GIL.");
+
+	// Elementwise operations writing into out, a single pass without temporaries
+	m.def("add", [](const VectorView<double, size_t> & a, const VectorView<double, size_t> & b, py::object out) {
+		CheckSameSize(a.Size(), b.Size());
+		return VectorInto(out, a.Size(), [&](VectorView<double, size_t> res) { res = a + b; });
+	}, py::arg("a"), py::arg("b"), py::arg("out") = py::none());
+
+	m.def("add", [](const PyMatrixView & a, const PyMatrixView & b, py::object out) {
+		CheckSameShape(a, b);
+		return MatrixInto(out, a.Rows(), a.Cols(), [&](PyMatrixView res) { res = a + b; });
+	}, py::arg("a"), py::arg("b"), py::arg("out") = py::none());
+
+	m.def("sub", [](const VectorView<double, size_t> & a, const VectorView<double, size_t> & b, py::object out) {
+		CheckSameSize(a.Size(), b.Size());
+		return VectorInto(out, a.Size(), [&](VectorView<double, size_t> res) { res = a - b; });
+	}, py::arg("a"), py::arg("b"), py::arg("out") = py::none());
+
+	m.def("sub", [](const PyMatrixView & a, const PyMatrixView & b, py::object out) {
+		CheckSameShape(a, b);
+		return MatrixInto(out, a.Rows(), a.Cols(), [&](PyMatrixView res) { res = a - b; });
+	}, py::arg("a"), py::arg("b"), py::arg("out") = py::none());
+
+	m.def("scale", [](double alpha, const VectorView<double, size_t> & x, py::object out) {
+		return VectorInto(out, x.Size(), [&](VectorView<double, size_t> res) { res = alpha * x; });
+	}, py::arg("alpha"), py::arg("x"), py::arg("out") = py::none());
+
+	m.def("scale", [](double alpha, const PyMatrixView & x, py::object out) {
+		return MatrixInto(out, x.Rows(), x.Cols(), [&](PyMatrixView res) { res = alpha * x; });
+	}, py::arg("alpha"), py::arg("x"), py::arg("out") = py::none());
+
+	m.def("axpby", [](double alpha, const VectorView<double, size_t> & x, double beta, const VectorView<double, size_t> & y, py::object out) {
+		CheckSameSize(x.Size(), y.Size());
+		return VectorInto(out, x.Size(), [&](VectorView<double, size_t> res) { res = alpha * x + beta * y; });
+	}, py::arg("alpha"), py::arg("x"), py::arg("beta"), py::arg("y"), py::arg("out") = py::none(),
+		"alpha*x + beta*y in one pass");
+
+	py::class_<PyVectorExpr> (m, "VectorExpr", "deferred linear combination of vectors")
+		.def("__len__", [](const PyVectorExpr & self) { return self.expr.Size(); })
+		.def_property_readonly("terms", [](const PyVectorExpr & self) { return self.expr.Terms().size(); })
+		.def("__add__", [](py::object self, py::object other) {
+			return Binary<PyVectorExpr>(self, other, [](auto & a, auto & b) { return py::cast(a + b); });
+		}, py::is_operator())
+		.def("__sub__", [](py::object self, py::object other) {
+			return Binary<PyVectorExpr>(self, other, [](auto & a, auto & b) { return py::cast(a - b); });
+		}, py::is_operator())
+		.def("__neg__", [](const PyVectorExpr & self) { return -1.0 * self; })
+		.def("__mul__", [](const PyVectorExpr & self, double scal) { return scal * self; })
+		.def("__rmul__", [](const PyVectorExpr & self, double scal) { return scal * self; })
+		.def("eval", [](const PyVectorExpr & self, py::object out, size_t threads) {
+			return VectorInto(out, self.expr.Size(), [&](VectorView<double, size_t> res) { self.expr.Evaluate(res, threads); });
+		}, py::arg("out") = py::none(), py::arg("threads") = 0,
+			"evaluate in one pass, into out if given (which may be one of the terms)")
+		;
+
+	py::class_<PyMatrixExpr> (m, "MatrixExpr", "deferred sum of matrices and matrix products")
+		.def_property_readonly("shape", [](const PyMatrixExpr & self) { return std::tuple(self.expr.Rows(), self.expr.Cols()); })
+		.def("__add__", [](py::object self, py::object other) {
+			return Binary<PyMatrixExpr>(self, other, [](auto & a, auto & b) { return py::cast(a + b); });
+		}, py::is_operator())
+		.def("__sub__", [](py::object self, py::object other) {
+			return Binary<PyMatrixExpr>(self, other, [](auto & a, auto & b) { return py::cast(a - b); });
+		}, py::is_operator())
+		.def("__mul__", [](py::object self, py::object other) {
+			if (Operand<PyMatrixExpr>(other))
+				return Binary<PyMatrixExpr>(self, other, [](auto & a, auto & b) { return py::cast(a * b); });
+			return Scaled<PyMatrixExpr>(self, other, [](double s, auto & a) { return py::cast(s * a); });
+		}, py::is_operator())
+		.def("__rmul__", [](py::object self, py::object other) {
+			if (Operand<PyMatrixExpr>(other))
+				return Binary<PyMatrixExpr>(other, self, [](auto & a, auto & b) { return py::cast(a * b); });
+			return Scaled<PyMatrixExpr>(self, other, [](double s, auto & a) { return py::cast(s * a); });
+		}, py::is_operator())
+		.def("__neg__", [](const PyMatrixExpr & self) { return -1.0 * self; })
+		.def("eval", [](const PyMatrixExpr & self, py::object out, size_t threads) {
+			return MatrixInto(out, self.expr.Rows(), self.expr.Cols(), [&](PyMatrixView res) { self.expr.Evaluate(res, threads); });
+		}, py::arg("out") = py::none(), py::arg("threads") = 0,
+			"evaluate, into out if given")
+		;
+
+	py::class_<DeferredScope> (m, "deferred", "with bla.deferred(): operators build expressions instead of computing")
+		.def(py::init([](bool on) { return DeferredScope{ on, py::none() }; }), py::arg("on") = true)
+		.def("__enter__", [](DeferredScope & self) {
+			self.token = DeferredVar().attr("set")(py::bool_(self.on));
+		})
+		.def("__exit__", [](DeferredScope & self, py::args) { DeferredVar().attr("reset")(self.token); })
+		;
+
+	m.def("lazy", [](py::object x) -> py::object {
+		if (auto e = Operand<PyVectorExpr>(x)) return py::cast(*e);
+		if (auto e = Operand<PyMatrixExpr>(x)) return py::cast(*e);
+		throw py::type_error("lazy() takes a Vector or a matrix");
+	}, py::arg("x"), "x as a deferred expression");
 
+	py::class_<PyLU> (m, "LU")
+		.def(py::init(&Factor), py::arg("a"), "LU factorization with partial pivoting (Lapack)")
+		.def_property_readonly("info", [](const PyLU & self) { return int(self.Info()); },
+			"0 on success, i > 0 if the matrix is singular")
+		.def("solve", [](const PyLU & self, const Vector<double> & b) {
+			return SolveLU(self, self.Size(), b);
+		}, py::arg("b"), "solution of a x = b")
+		.def("solve", [](const PyLU & self, const PyMatrixView & b) {
+			return SolveLU(self, self.Size(), b);
+		}, py::arg("b"), "solution of a X = B, column by column")
+		.def("det", &PyLU::Det, ReleaseGIL())
 		;
+
+	m.def("lu_solve", [](const PyMatrixView & a, const Vector<double> & b) {
+		return SolveLU(Factor(a), a.Rows(), b);
+	}, py::arg("a"), py::arg("b"), "solution of a x = b by LU factorization");
+
+	m.def("lu_solve", [](const PyMatrixView & a, const PyMatrixView & b) {
+		return SolveLU(Factor(a), a.Rows(), b);
+	}, py::arg("a"), py::arg("b"), "solution of a X = B by LU factorization");
+
+	m.def("inverse", [](const PyMatrixView & a, const std::string & backend) {
+		if (a.Rows() != a.Cols()) throw py::value_error("matrix must be square");
+		bool lapack = UseLapack(backend);
+		Matrix<double, RowMajor> copy(a);
+		py::gil_scoped_release release;
+		if (!lapack) return copy.Invert();
+		PyLU lu(std::move(copy));
+		if (lu.Info() > 0) throw py::value_error("matrix is singular");
+		return std::move(lu).Inverse();
+	}, py::arg("a"), py::arg("backend") = "auto", "inverse with backend 'auto' or 'lapack' (LU) or 'native' (Gauss)");
+
+	m.def("det", [](const PyMatrixView & a, const std::string & backend) {
+		if (a.Rows() != a.Cols()) throw py::value_error("matrix must be square");
+		bool lapack = UseLapack(backend);
+		Matrix<double, RowMajor> copy(a);
+		py::gil_scoped_release release;
+		return lapack ? PyLU(std::move(copy)).Det() : copy.Det();
+	}, py::arg("a"), py::arg("backend") = "auto", "determinant with backend 'auto' or 'lapack' (LU) or 'native' (Gauss)");
+
+	py::class_<PyAsync> (m, "AsyncResult")
+		.def("ready", [](const PyAsync & self) { return self.handle.Ready(); },
+			"True once the operation has finished")
+		.def("wait", &PyAsync::Wait, "waits for the operation and returns its result, raises its error")
+		.def("__await__", [](py::object self) {
+			// waits on a thread of the default executor, the event loop keeps running
+			py::object loop = py::module_::import("asyncio").attr("get_running_loop")();
+			return loop.attr("run_in_executor")(py::none(), self.attr("wait")).attr("__await__")();
+		})
+		;
+
+	m.def("matmul_async", &MatMulAsync, py::arg("a"), py::arg("b"), py::arg("out") = py::none(),
+		"starts a*b in the background and returns an AsyncResult; a, b and out must not be changed until it is finished");
+	m.def("wait_all", &AsyncWaitAll, ReleaseGIL(), "waits for all operations started with matmul_async");
+
+	m.def("batched_matmul", &BatchedMatMul, py::arg("a"), py::arg("b"), py::arg("out") = py::none(), py::arg("threads") = 0,
+		"a[i]*b[i] for stacks of matrices (3-d arrays or lists), in one call without the GIL");
+	m.def("batched_solve", &BatchedSolveStack, py::arg("a"), py::arg("b"), py::arg("threads") = 0,
+		"solutions of a[i] x[i] = b[i] for a stack of matrices and of vectors (2-d array or list)");
+	m.def("batched_dot", &BatchedDotStack, py::arg("x"), py::arg("y"), py::arg("threads") = 0,
+		"array of the inner products of x[i] and y[i]");
+
+	// reconstructors for pickle
+	m.def("_vector_from_buffer", &VectorFromBuffer, py::arg("buffer"));
+	m.def("_matrix_from_buffer", &MatrixFromBuffer, py::arg("buffer"), py::arg("rows"), py::arg("cols"));
+
+	m.attr("profiling") = PROFILING;
+	m.def("profile", []() {
+		py::dict res;
+		for (auto & k : ProfileReport()) {
+			py::dict d;
+			d["calls"] = k.calls;
+			d["flops"] = k.flops;
+			d["bytes"] = k.bytes;
+			d["seconds"] = k.seconds;
+			res[py::str(k.name)] = d;
+		}
+		return res;
+	}, "calls, flops, bytes and seconds per kernel, empty unless built with MATHLIB_PROFILE");
+	m.def("reset_profile", &ResetProfile, "sets the kernel counters to zero");
+
+	m.def("use_memory_pool", [](bool on) {
+		// never destroyed, pooled buffers may outlive the module
+		static PoolAllocator* pool = new PoolAllocator();
+		if (on) SetDefaultAllocator(*pool);
+		else SetDefaultAllocator(Heap());
+	}, py::arg("on") = true, "recycle buffers of new vectors and matrices through a size-class pool");
 }
@@ -0,0 +1,270 @@
+#ifndef FILE_DISPATCH
+#define FILE_DISPATCH
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "profile.hpp"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "matrix.hpp"
+
+// Chooses the engine for C = A*B from the operand shapes:
+//   Expression - plain loops, for tiny matrices where any setup costs more than the product
+//   Native     - blocked SIMD kernel AddMatMat
+//   Parallel   - AddMatMatParallel, only pays off once thread startup is amortized
+//   Lapack     - dgemm, for large matrices and orderings the native kernels don't handle
+// The crossover sizes are machine dependent. They are read from a per-host config file
+// on first use and can be measured with CalibrateDispatchThresholds().
+
+namespace Mathlib {
+
+    enum class MultBackend { Expression, Native, Parallel, Lapack };
+
+    inline const char* BackendName(MultBackend b) {
+        switch (b) {
+            case MultBackend::Expression: return "expression";
+            case MultBackend::Native:     return "native";
+            case MultBackend::Parallel:   return "parallel";
+            case MultBackend::Lapack:     return "lapack";
+        }
+        return "unknown";
+    }
+
+    // Sizes refer to the cube root of m*n*k, i.e. the size of an equally expensive square product
+    struct DispatchThresholds {
+        size_t small = 24;        // below: Expression
+        size_t parallel = 200;    // from here on: Parallel (if threads > 1)
+        size_t lapack = 1024;     // from here on: Lapack
+        size_t threads = std::max(1u, std::thread::hardware_concurrency());
+
+        bool Load(const std::string& filename) {
+            std::ifstream in(filename);
+            if (!in) return false;
+            std::string key;
+            size_t val;
+            while (in >> key >> val) {
+                if (key == "small") small = val;
+                else if (key == "parallel") parallel = val;
+                else if (key == "lapack") lapack = val;
+                else if (key == "threads") threads = std::max<size_t>(1, val);
+            }
+            return true;
+        }
+
+        bool Save(const std::string& filename) const {
+            std::ofstream out(filename);
+            if (!out) return false;
+            out << "small " << small << "\n"
+                << "parallel " << parallel << "\n"
+                << "lapack " << lapack << "\n"
+                << "threads " << threads << "\n";
+            return bool(out);
+        }
+    };
+
+    // $NAMEPENDING_DISPATCH_CONFIG, or $HOME/.namepending_dispatch_<hostname>
+    inline std::string DispatchConfigFile() {
+        if (const char* env = std::getenv("NAMEPENDING_DISPATCH_CONFIG"))
+            return env;
+
+        std::string host = "default";
+#ifdef _WIN32
+        if (const char* h = std::getenv("COMPUTERNAME")) host = h;
+        const char* home = std::getenv("USERPROFILE");
+#else
+        char buf[256];
+        if (gethostname(buf, sizeof(buf)) == 0) {
+            buf[sizeof(buf)-1] = 0;
+            host = buf;
+        }
+        const char* home = std::getenv("HOME");
+#endif
+        return std::string(home ? home : ".") + "/.namepending_dispatch_" + host;
+    }
+
+    // Global thresholds, loaded from DispatchConfigFile() on first use
+    inline DispatchThresholds& GetDispatchThresholds() {
+        static DispatchThresholds thresholds = [] {
+            DispatchThresholds t;
+            t.Load(DispatchConfigFile());
+            return t;
+        }();
+        return thresholds;
+    }
+
+    inline bool SaveDispatchThresholds() {
+        return GetDispatchThresholds().Save(DispatchConfigFile());
+    }
+
+
+    // Debug hook, called with the chosen backend and m, n, k for every dispatched product
+    using DispatchHook = std::function<void(MultBackend, size_t, size_t, size_t)>;
+
+    inline DispatchHook& GetDispatchHook() {
+        static DispatchHook hook;
+        return hook;
+    }
+
+    inline void SetDispatchHook(DispatchHook hook) { GetDispatchHook() = std::move(hook); }
+
+
+    // Policy for plain C = A*B (without | tag). Native keeps the blocked kernel for every size,
+    // Auto routes through MultMatMatAuto as if written C = A*B | Auto.
+    enum class MultPolicy { Native, Auto };
+
+    inline MultPolicy& DefaultMultPolicy() {
+        static MultPolicy policy = MultPolicy::Native;
+        return policy;
+    }
+
+    inline void SetDefaultMultPolicy(MultPolicy policy) { DefaultMultPolicy() = policy; }
+
+
+
+
+    // C = A*B with plain loops, any type and ordering
+    template <typename T1, typename T2, typename T, ORDERING OA, ORDERING OB, ORDERING OC>
+    void MultMatMatSmall(MatrixView<T1, OA> a, MatrixView<T2, OB> b, MatrixView<T, OC> c) {
+        MATHLIB_PROFILE_SCOPE("MultMatMatSmall", 2.0 * c.Rows() * c.Cols() * a.Cols(),
+                              sizeof(T1) * a.Rows() * a.Cols() + sizeof(T2) * b.Rows() * b.Cols() + sizeof(T) * c.Rows() * c.Cols());
+        c = T(0);
+        for (size_t j = 0; j < c.Cols(); ++j)
+            for (size_t k = 0; k < a.Cols(); ++k) {
+                T bkj = b(k, j);
+                for (size_t i = 0; i < c.Rows(); ++i)
+                    c(i, j) = c(i, j) + a(i, k) * bkj;
+            }
+    }
+
+    // True if the blocked double kernels can handle these orderings
+    // (all column-major, or all row-major which is the transposed product)
+    template <typename T1, typename T2, typename T, ORDERING OA, ORDERING OB, ORDERING OC>
+    constexpr bool NativeMultSupported() {
+        return std::is_same_v<T1, double> && std::is_same_v<T2, double> && std::is_same_v<T, double>
+            && OA == OB && OB == OC;
+    }
+
+    // C = A*B with AddMatMat or AddMatMatParallel, ntasks == 1 meaning sequential
+    template <ORDERING ORD>
+    void MultMatMatNative(MatrixView<double, ORD> a, MatrixView<double, ORD> b, MatrixView<double, ORD> c, size_t ntasks = 1) {
+        c = 0.0;
+        if constexpr (ORD == ColMajor) {
+            if (ntasks > 1) AddMatMatParallel(a, b, c, ntasks);
+            else AddMatMat(a, b, c);
+        }
+        else {
+            if (ntasks > 1) AddMatMatParallel(b.Transpose(), a.Transpose(), c.Transpose(), ntasks);
+            else AddMatMat(b.Transpose(), a.Transpose(), c.Transpose());
+        }
+    }
+
+    inline MultBackend ChooseMultBackend(size_t m, size_t n, size_t k, bool native_ok, bool lapack_ok) {
+        const auto& th = GetDispatchThresholds();
+        const double size = std::cbrt(double(m) * double(n) * double(k));
+
+        if (size < th.small) return MultBackend::Expression;
+        if (lapack_ok && (size >= th.lapack || !native_ok)) return MultBackend::Lapack;
+        if (!native_ok) return MultBackend::Expression;
+        if (size >= th.parallel && th.threads > 1 && m >= 2) return MultBackend::Parallel;
+        return MultBackend::Native;
+    }
+
+    template <typename T1, typename T2, typename T, ORDERING OA, ORDERING OB, ORDERING OC>
+    void MultMatMatAuto(MatrixView<T1, OA> a, MatrixView<T2, OB> b, MatrixView<T, OC> c) {
+        constexpr bool native_ok = NativeMultSupported<T1, T2, T, OA, OB, OC>();
+        constexpr bool lapack_ok = std::is_same_v<T1, double> && std::is_same_v<T2, double> && std::is_same_v<T, double>;
+
+        MultBackend backend = ChooseMultBackend(c.Rows(), c.Cols(), a.Cols(), native_ok, lapack_ok);
+        if (auto& hook = GetDispatchHook())
+            hook(backend, c.Rows(), c.Cols(), a.Cols());
+
+        if constexpr (native_ok) {
+            if (backend == MultBackend::Native)   return MultMatMatNative<OC>(a, b, c);
+            if (backend == MultBackend::Parallel) return MultMatMatNative<OC>(a, b, c, GetDispatchThresholds().threads);
+        }
+        if constexpr (lapack_ok) {
+            if (backend == MultBackend::Lapack)   return MultMatMatLapack(a, b, c);
+        }
+        MultMatMatSmall(a, b, c);
+    }
+
+    // Plain C = A*B
+    template <typename T1, typename T2, typename T, ORDERING OA, ORDERING OB, ORDERING OC>
+    void MultMatMatDefault(MatrixView<T1, OA> a, MatrixView<T2, OB> b, MatrixView<T, OC> c) {
+        if (DefaultMultPolicy() == MultPolicy::Auto)
+            return MultMatMatAuto(a, b, c);
+
+        if constexpr (NativeMultSupported<T1, T2, T, OA, OB, OC>())
+            MultMatMatNative<OC>(a, b, c);
+        else
+            MultMatMatSmall(a, b, c);
+    }
+
+    // Plain C += A*B, C must not overlap A or B
+    template <typename T1, typename T2, typename T, ORDERING OA, ORDERING OB, ORDERING OC>
+    void AddMatMatDefault(MatrixView<T1, OA> a, MatrixView<T2, OB> b, MatrixView<T, OC> c) {
+        if constexpr (NativeMultSupported<T1, T2, T, OA, OB, OC>()) {
+            if constexpr (OC == ColMajor) AddMatMat(a, b, c);
+            else AddMatMat(b.Transpose(), a.Transpose(), c.Transpose());
+        }
+        else {
+            Matrix<T, OC> ab(c.Rows(), c.Cols());
+            MultMatMatSmall(a, b, ab);
+            c += ab;
+        }
+    }
+
+
+
+    // Measures the crossover sizes on this machine with square products,
+    // stores them in the global thresholds and optionally in DispatchConfigFile()
+    inline DispatchThresholds CalibrateDispatchThresholds(bool save = true) {
+        auto& th = GetDispatchThresholds();
+
+        auto time = [](auto&& func, size_t n) {
+            size_t runs = 1 + size_t(2e7 / double(n*n*n));
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < runs; ++i)
+                func();
+            std::chrono::duration<double> dt = std::chrono::steady_clock::now() - start;
+            return dt.count() / runs;
+        };
+
+        // First size where 'fast' beats 'slow', or 'none' if it never does
+        auto crossover = [&](std::initializer_list<size_t> sizes, auto slow, auto fast, size_t none) {
+            for (size_t n : sizes) {
+                Matrix<double> a(n, n), b(n, n), c(n, n);
+                a = 1.0;
+                b = 1.0;
+                if (time([&] { fast(a, b, c); }, n) < time([&] { slow(a, b, c); }, n))
+                    return n;
+            }
+            return none;
+        };
+
+        auto small = [](MatrixView<double> a, MatrixView<double> b, MatrixView<double> c) { MultMatMatSmall(a, b, c); };
+        auto native = [](MatrixView<double> a, MatrixView<double> b, MatrixView<double> c) { MultMatMatNative<ColMajor>(a, b, c); };
+        auto parallel = [&](MatrixView<double> a, MatrixView<double> b, MatrixView<double> c) { MultMatMatNative<ColMajor>(a, b, c, th.threads); };
+        auto lapack = [](MatrixView<double> a, MatrixView<double> b, MatrixView<double> c) { MultMatMatLapack(a, b, c); };
+
+        th.small = crossover({ 4, 8, 16, 24, 32, 48, 64 }, small, native, 64);
+        th.parallel = (th.threads > 1) ? crossover({ 64, 96, 128, 192, 256, 384, 512 }, native, parallel, 512) : size_t(-1);
+        if (th.threads > 1)
+            th.lapack = crossover({ 128, 256, 512, 768, 1024 }, parallel, lapack, size_t(-1));
+        else
+            th.lapack = crossover({ 128, 256, 512, 768, 1024 }, native, lapack, size_t(-1));
+
+        if (save)
+            SaveDispatchThresholds();
+        return th;
+    }
+}
+
+#endif
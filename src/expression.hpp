@@ -22,6 +22,14 @@ namespace Mathlib
 		auto operator()(size_t i) const { return Downcast()(i); }
 	};
 
+	// True for anything deriving from MatExpr (including Matrix, which derives via MatrixView)
+	template<typename E>
+	std::true_type IsMatExprHelper(const MatExpr<E>*);
+	std::false_type IsMatExprHelper(...);
+
+	template<typename T>
+	constexpr bool IsMatExpr = decltype(IsMatExprHelper(std::declval<T*>()))::value;
+
 
 
 
@@ -160,7 +168,8 @@ namespace Mathlib
 		size_t Size() const { return vec.Size(); }      
 	};
 
-	template<typename TSCAL, typename EV>
+	// Matrices must not be picked up as scalars, otherwise A*v never reaches the overload above
+	template<typename TSCAL, typename EV, typename = std::enable_if_t<!IsMatExpr<TSCAL>>>
 	auto operator*(const TSCAL scal, const VecExpr<EV>& v) {
 		return VecExprScaleL(scal, v.Downcast());
 	}
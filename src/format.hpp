@@ -0,0 +1,70 @@
+#ifndef FILE_FORMAT
+#define FILE_FORMAT
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <limits>
+#include <locale>
+#include <ostream>
+#include <string>
+#include <type_traits>
+
+// Number formatting with std::to_chars for the printers and the text writers:
+// no locale lookups and no virtual stream calls per element.
+// Floating point std::to_chars is missing in older standard libraries (before
+// GCC 11), which do not define __cpp_lib_to_chars. There the printers use the
+// ostream path for floating point types and the text writers snprintf.
+
+namespace Mathlib {
+
+    namespace detail {
+        template <typename T>
+        constexpr bool IsCharLike = std::is_same_v<T, bool> || std::is_same_v<T, char>
+            || std::is_same_v<T, signed char> || std::is_same_v<T, unsigned char>;
+
+        // Appends val to out. precision < 0 gives the shortest form that reads back exactly,
+        // otherwise %g with that precision.
+        template <typename T>
+        void AppendNumber(std::string& out, T val, int precision = -1) {
+            char buf[64];
+            if constexpr (std::is_floating_point_v<T>) {
+#ifdef __cpp_lib_to_chars
+                auto res = (precision < 0) ? std::to_chars(buf, buf + sizeof(buf), val)
+                                           : std::to_chars(buf, buf + sizeof(buf), val, std::chars_format::general, precision);
+                out.append(buf, res.ptr);
+#else
+                // max_digits10 digits read back exactly, but are not always the shortest form
+                const int digits = (precision < 0) ? std::numeric_limits<T>::max_digits10 : precision;
+                const int len = std::snprintf(buf, sizeof(buf), "%.*Lg", digits, static_cast<long double>(val));
+                out.append(buf, std::min(size_t(len), sizeof(buf) - 1));
+#endif
+            }
+            else {
+                auto res = std::to_chars(buf, buf + sizeof(buf), val);
+                out.append(buf, res.ptr);
+            }
+        }
+
+        // True if os << val for a T prints what AppendNumber(out, val, os.precision()) does:
+        // arithmetic type, default float format, decimal, no width, classic locale
+        template <typename T>
+        bool FastFormattable(const std::ostream& os) {
+            if constexpr (!std::is_arithmetic_v<T> || IsCharLike<T>)
+                return false;
+#ifndef __cpp_lib_to_chars
+            else if constexpr (std::is_floating_point_v<T>)
+                return false;
+#endif
+            else {
+                const auto flags = os.flags();
+                return os.width() == 0
+                    && !(flags & (std::ios::floatfield | std::ios::showpos | std::ios::showpoint | std::ios::uppercase | std::ios::showbase))
+                    && (flags & std::ios::basefield) != std::ios::hex && (flags & std::ios::basefield) != std::ios::oct
+                    && os.getloc() == std::locale::classic();
+            }
+        }
+    }
+}
+
+#endif
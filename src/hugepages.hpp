@@ -0,0 +1,172 @@
+#ifndef FILE_HUGEPAGES
+#define FILE_HUGEPAGES
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "memory.hpp"
+
+// Huge pages for large buffers. With 4 KB pages, a matrix of a few GB needs
+// hundreds of thousands of TLB entries, and strided accesses (Row() of a
+// column-major matrix, packing in AddMatMat) miss the TLB on almost every
+// element. Buffers from a HugePageAllocator are 2 MB aligned and backed by
+// 2 MB pages if the system provides them:
+//   Transparent - madvise(MADV_HUGEPAGE), the kernel assembles huge pages when touched
+//   Explicit    - mmap(MAP_HUGETLB) from the hugetlbfs pool (vm.nr_hugepages),
+//                 falling back to Transparent if the pool is empty
+// Elsewhere it falls back to plain aligned allocations.
+
+namespace Mathlib {
+
+    constexpr size_t HUGE_PAGE_SIZE = size_t(2) << 20;
+
+    enum class HugePageMode { Transparent, Explicit };
+
+    struct HugePageStats {
+        size_t allocations = 0;        // buffers served with huge page alignment
+        size_t explicit_bytes = 0;     // from the hugetlbfs pool
+        size_t advised_bytes = 0;      // madvise(MADV_HUGEPAGE)
+        size_t fallbacks = 0;          // Explicit requests served as Transparent
+    };
+
+    // Bytes of [ptr, ptr+bytes) currently backed by huge pages, from /proc/self/smaps
+    // (AnonHugePages for transparent, Private_Hugetlb for explicit huge pages)
+    inline size_t HugePageBytes(const void* ptr, size_t bytes) {
+        size_t total = 0;
+#ifdef __linux__
+        std::ifstream smaps("/proc/self/smaps");
+        const auto lo = reinterpret_cast<std::uintptr_t>(ptr);
+        const auto hi = lo + bytes;
+        size_t overlap = 0;   // of the current mapping with the range
+        std::string line;
+        while (std::getline(smaps, line)) {
+            std::uintptr_t start, end;
+            char dash;
+            std::istringstream header(line);
+            // mapping header: "start-end perms offset dev inode path"
+            if (line.find('-') != std::string::npos && !line.empty() && std::isxdigit(line[0])
+                && (header >> std::hex >> start >> dash >> end) && dash == '-') {
+                overlap = (start < hi && end > lo) ? std::min(end, hi) - std::max(start, lo) : 0;
+                continue;
+            }
+            if (!overlap) continue;
+
+            std::istringstream field(line);
+            std::string key;
+            size_t kb;
+            if (field >> key >> kb && (key == "AnonHugePages:" || key == "Private_Hugetlb:" || key == "Shared_Hugetlb:"))
+                total += std::min(kb * 1024, overlap);   // merged mappings may extend beyond the range
+        }
+#else
+        (void)ptr; (void)bytes;
+#endif
+        return total;
+    }
+
+
+    // Buffers from min_bytes on get huge pages, smaller ones come from the heap
+    class HugePageAllocator : public Allocator {
+        HugePageMode mode;
+        size_t min_bytes;
+        HugePageStats stats;
+        std::map<void*, size_t> live;   // large buffers and their mapped size
+        std::mutex mutex;
+
+        static size_t RoundUp(size_t bytes) { return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE; }
+
+#ifdef __linux__
+        // mmap with 2 MB alignment: map one huge page more, unmap the unaligned ends
+        static void* MapAligned(size_t size) {
+            void* raw = mmap(nullptr, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (raw == MAP_FAILED) return nullptr;
+            auto addr = reinterpret_cast<std::uintptr_t>(raw);
+            auto aligned = (addr + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+            if (aligned > addr)
+                munmap(raw, aligned - addr);
+            munmap(reinterpret_cast<void*>(aligned + size), addr + HUGE_PAGE_SIZE - aligned);
+            return reinterpret_cast<void*>(aligned);
+        }
+#endif
+
+    public:
+        HugePageAllocator(HugePageMode _mode = HugePageMode::Transparent, size_t _min_bytes = HUGE_PAGE_SIZE)
+            : mode(_mode), min_bytes(_min_bytes) { }
+
+        HugePageAllocator(const HugePageAllocator&) = delete;
+        HugePageAllocator& operator=(const HugePageAllocator&) = delete;
+
+        void* Allocate(size_t bytes, size_t alignment) override {
+            if (bytes < min_bytes) return AlignedAlloc(bytes, alignment);
+#ifdef __linux__
+            const size_t size = RoundUp(bytes);
+            void* ptr = nullptr;
+            bool hugetlb = false;
+
+#ifdef MAP_HUGETLB
+            if (mode == HugePageMode::Explicit) {
+                ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                if (ptr == MAP_FAILED) ptr = nullptr;
+                hugetlb = ptr != nullptr;
+            }
+#endif
+            bool advised = false;
+            if (!ptr) {
+                ptr = MapAligned(size);
+                if (!ptr) throw std::runtime_error("Memory allocation failed");
+#ifdef MADV_HUGEPAGE
+                advised = madvise(ptr, size, MADV_HUGEPAGE) == 0;
+#endif
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            live[ptr] = size;
+            ++stats.allocations;
+            if (hugetlb) stats.explicit_bytes += size;
+            if (advised) stats.advised_bytes += size;
+            if (mode == HugePageMode::Explicit && !hugetlb) ++stats.fallbacks;
+            return ptr;
+#else
+            return AlignedAlloc(bytes, std::max(alignment, HUGE_PAGE_SIZE));
+#endif
+        }
+
+        void Deallocate(void* ptr, size_t bytes) override {
+            if (!ptr) return;
+            if (bytes < min_bytes) return AlignedFree(ptr);
+#ifdef __linux__
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                live.erase(ptr);
+            }
+            munmap(ptr, RoundUp(bytes));
+#else
+            AlignedFree(ptr);
+#endif
+        }
+
+        HugePageStats Stats() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return stats;
+        }
+
+        // Bytes of the live large buffers actually backed by huge pages right now
+        size_t BackedBytes() {
+            std::lock_guard<std::mutex> lock(mutex);
+            size_t total = 0;
+            for (auto [ptr, size] : live)
+                total += HugePageBytes(ptr, size);
+            return total;
+        }
+    };
+}
+
+#endif
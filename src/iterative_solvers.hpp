@@ -0,0 +1,301 @@
+#ifndef FILE_ITERATIVE_SOLVERS
+#define FILE_ITERATIVE_SOLVERS
+
+#include "matrix.hpp"
+#include "profile.hpp"
+
+// Krylov solvers for A x = b. The operator A can be anything for which
+// y = A * x is a valid vector assignment: Matrix, MatrixView, any MatExpr
+// node (e.g. A + 2*B) or the sparse matrices from sparse_matrix.hpp.
+// Updates are written with the vector expressions, inner products which are
+// needed together are computed in a single pass over memory.
+// With MATHLIB_PROFILE every iteration is counted and timed as a kernel,
+// without flops and bytes, which depend on the operator.
+
+namespace Mathlib {
+
+    struct SolverResult {
+        bool converged = false;
+        size_t iterations = 0;
+        double residual = 0;   // norm of the final residual b - A x
+    };
+
+
+    // (a, b) and (a, c) in one pass
+    template <typename T, typename TA, typename TB, typename TC>
+    std::pair<T, T> Dot2(VectorView<T, TA> a, VectorView<T, TB> b, VectorView<T, TC> c) {
+        const T* pa = a.Data();
+        const T* pb = b.Data();
+        const T* pc = c.Data();
+        const size_t da = a.Dist(), db = b.Dist(), dc = c.Dist();
+        T ab(0), ac(0);
+        for (size_t i = 0; i < a.Size(); ++i) {
+            ab = ab + pa[i*da] * pb[i*db];
+            ac = ac + pa[i*da] * pc[i*dc];
+        }
+        return { ab, ac };
+    }
+
+    // y = expr, returns (y, y) accumulated while writing y
+    template <typename T, typename TD, typename E>
+    T AssignNorm2(VectorView<T, TD> y, const VecExpr<E>& expr) {
+        T* py = y.Data();
+        const size_t dy = y.Dist();
+        T sum(0);
+        for (size_t i = 0; i < y.Size(); ++i) {
+            T val = expr(i);
+            py[i*dy] = val;
+            sum = sum + val * val;
+        }
+        return sum;
+    }
+
+
+
+
+    // Preconditioners provide Apply(r, z) computing z = M^{-1} r
+
+    class IdentityPreconditioner {
+    public:
+        template <typename T, typename TD1, typename TD2>
+        void Apply(VectorView<T, TD1> r, VectorView<T, TD2> z) const {
+            // element-wise copy, z = r would just rebind the view if TD1 == TD2
+            for (size_t i = 0; i < r.Size(); ++i)
+                z(i) = r(i);
+        }
+    };
+
+    template <typename T>
+    class JacobiPreconditioner {
+        Vector<T> invdiag;
+
+    public:
+        template <typename E>
+        JacobiPreconditioner(const MatExpr<E>& A) : invdiag(A.Rows()) {
+            for (size_t i = 0; i < A.Rows(); ++i) {
+                T d = A(i, i);
+                if (d == T(0)) throw std::runtime_error("Jacobi preconditioner needs non-zero diagonal");
+                invdiag(i) = T(1) / d;
+            }
+        }
+
+        template <typename TD1, typename TD2>
+        void Apply(VectorView<T, TD1> r, VectorView<T, TD2> z) const { z = VecMul(invdiag, r); }
+    };
+
+
+
+
+    // Preconditioned conjugate gradients, A and M must be symmetric positive definite
+    template <typename TOP, typename T, typename TPRE = IdentityPreconditioner>
+    SolverResult CG(const TOP& A, VectorView<T> b, VectorView<T> x, const TPRE& pre = TPRE(),
+                    double tol = 1e-10, size_t maxit = 1000) {
+        const size_t n = b.Size();
+        Vector<T> r(n), z(n), p(n), Ap(n);
+        SolverResult res;
+
+        const double bnorm = std::sqrt(Dot(b, b));
+        if (bnorm == 0) {
+            x = T(0);
+            res.converged = true;
+            return res;
+        }
+
+        Ap = A * x;
+        res.residual = std::sqrt(AssignNorm2(VectorView<T>(r), b - Ap));
+        if (res.residual <= tol * bnorm) {
+            res.converged = true;
+            return res;
+        }
+
+        pre.Apply(r, z);
+        p = z;
+        T rz = Dot(r, z);
+
+        for (res.iterations = 1; res.iterations <= maxit; ++res.iterations) {
+            MATHLIB_PROFILE_SCOPE("CG iteration", 0, 0);
+
+            Ap = A * p;
+            T alpha = rz / Dot(p, Ap);
+            x = x + alpha * p;
+            res.residual = std::sqrt(AssignNorm2(VectorView<T>(r), r - alpha * Ap));
+            if (res.residual <= tol * bnorm) {
+                res.converged = true;
+                return res;
+            }
+
+            pre.Apply(r, z);
+            T rznew = Dot(r, z);
+            p = z + (rznew / rz) * p;
+            rz = rznew;
+        }
+        res.iterations = maxit;
+        return res;
+    }
+
+
+    // Right-preconditioned BiCGStab for general non-singular A
+    template <typename TOP, typename T, typename TPRE = IdentityPreconditioner>
+    SolverResult BiCGStab(const TOP& A, VectorView<T> b, VectorView<T> x, const TPRE& pre = TPRE(),
+                          double tol = 1e-10, size_t maxit = 1000) {
+        const size_t n = b.Size();
+        Vector<T> r(n), rhat(n), p(n), v(n), s(n), t_(n), phat(n), shat(n);
+        SolverResult res;
+
+        const double bnorm = std::sqrt(Dot(b, b));
+        if (bnorm == 0) {
+            x = T(0);
+            res.converged = true;
+            return res;
+        }
+
+        v = A * x;
+        res.residual = std::sqrt(AssignNorm2(VectorView<T>(r), b - v));
+        if (res.residual <= tol * bnorm) {
+            res.converged = true;
+            return res;
+        }
+
+        rhat = r;
+        p = T(0);
+        v = T(0);
+        T rho(1), alpha(1), omega(1);
+
+        for (res.iterations = 1; res.iterations <= maxit; ++res.iterations) {
+            MATHLIB_PROFILE_SCOPE("BiCGStab iteration", 0, 0);
+
+            T rhonew = Dot(rhat, r);
+            if (rhonew == T(0))
+                return res;   // breakdown, r is orthogonal to the shadow residual
+
+            p = r + ((rhonew / rho) * (alpha / omega)) * (p - omega * v);
+            pre.Apply(p, phat);
+            v = A * phat;
+            alpha = rhonew / Dot(rhat, v);
+
+            double snorm = std::sqrt(AssignNorm2(VectorView<T>(s), r - alpha * v));
+            if (snorm <= tol * bnorm) {
+                x = x + alpha * phat;
+                res.residual = snorm;
+                res.converged = true;
+                return res;
+            }
+
+            pre.Apply(s, shat);
+            t_ = A * shat;
+            auto [ts, tt] = Dot2(t_, s, t_);
+            omega = ts / tt;
+
+            x = x + alpha * phat + omega * shat;
+            res.residual = std::sqrt(AssignNorm2(VectorView<T>(r), s - omega * t_));
+            if (res.residual <= tol * bnorm) {
+                res.converged = true;
+                return res;
+            }
+            if (omega == T(0))
+                return res;
+
+            rho = rhonew;
+        }
+        res.iterations = maxit;
+        return res;
+    }
+
+
+    // Restarted, right-preconditioned GMRES(restart) with modified Gram-Schmidt
+    template <typename TOP, typename T, typename TPRE = IdentityPreconditioner>
+    SolverResult GMRES(const TOP& A, VectorView<T> b, VectorView<T> x, const TPRE& pre = TPRE(),
+                       double tol = 1e-10, size_t maxit = 1000, size_t restart = 30) {
+        const size_t n = b.Size();
+        const size_t m = std::max<size_t>(1, std::min(restart, n));
+        Matrix<T, ColMajor> V(n, m+1), H(m+1, m);
+        Vector<T> w(n), z(n), g(m+1), cs(m), sn(m), y(m);
+        SolverResult res;
+
+        const double bnorm = std::sqrt(Dot(b, b));
+        if (bnorm == 0) {
+            x = T(0);
+            res.converged = true;
+            return res;
+        }
+
+        while (true) {
+            w = A * x;
+            double beta = std::sqrt(AssignNorm2(V.Col(0), b - w));
+            res.residual = beta;
+            if (beta <= tol * bnorm) {
+                res.converged = true;
+                return res;
+            }
+            if (res.iterations >= maxit)
+                return res;
+
+            V.Col(0) = (T(1) / beta) * V.Col(0);
+            g = T(0);
+            g(0) = beta;
+            H = T(0);
+
+            size_t k = 0;
+            bool breakdown = false;
+            while (k < m && res.iterations < maxit) {
+                MATHLIB_PROFILE_SCOPE("GMRES iteration", 0, 0);
+                ++res.iterations;
+
+                pre.Apply(V.Col(k), z);
+                w = A * z;
+
+                // Orthogonalize, the last update also gives ||w||^2
+                double wnorm2 = 0;
+                for (size_t i = 0; i <= k; ++i) {
+                    H(i, k) = Dot(V.Col(i), w);
+                    wnorm2 = AssignNorm2(VectorView<T>(w), w - H(i, k) * V.Col(i));
+                }
+                H(k+1, k) = std::sqrt(wnorm2);
+                if (H(k+1, k) != T(0))
+                    V.Col(k+1) = (T(1) / H(k+1, k)) * w;
+
+                // Apply previous Givens rotations to the new column, then eliminate H(k+1, k)
+                for (size_t i = 0; i < k; ++i) {
+                    T h0 = H(i, k), h1 = H(i+1, k);
+                    H(i, k)   =  cs(i) * h0 + sn(i) * h1;
+                    H(i+1, k) = -sn(i) * h0 + cs(i) * h1;
+                }
+                T denom = std::sqrt(H(k, k) * H(k, k) + H(k+1, k) * H(k+1, k));
+                if (denom == T(0)) {
+                    // A M^{-1} v_k lies in the span of v_0..v_{k-1} and H is singular,
+                    // the space cannot reduce the residual any further
+                    breakdown = true;
+                    break;
+                }
+                cs(k) = H(k, k) / denom;
+                sn(k) = H(k+1, k) / denom;
+                H(k, k) = denom;
+                H(k+1, k) = T(0);
+                g(k+1) = -sn(k) * g(k);
+                g(k) = cs(k) * g(k);
+
+                res.residual = std::abs(g(k+1));
+                ++k;
+                if (res.residual <= tol * bnorm || wnorm2 == 0)
+                    break;
+            }
+
+            // Solve the k x k upper triangular system H y = g, then x += M^{-1} V y
+            for (size_t i = k; i-- > 0; ) {
+                T sum = g(i);
+                for (size_t j = i+1; j < k; ++j)
+                    sum = sum - H(i, j) * y(j);
+                y(i) = sum / H(i, i);
+            }
+            w = T(0);
+            for (size_t j = 0; j < k; ++j)
+                w = w + y(j) * V.Col(j);
+            pre.Apply(w, z);
+            x = x + z;
+            if (breakdown)
+                return res;
+        }
+    }
+}
+
+#endif
@@ -5,6 +5,7 @@
 #include <string>
 
 #include "matrix.hpp"
+#include "profile.hpp"
 
 typedef int integer;
 typedef integer logical;
@@ -62,12 +63,14 @@ namespace Mathlib
 							MatrixView<double, OB> b,
 							MatrixView<double, ColMajor> c)
 	{
+		MATHLIB_PROFILE_SCOPE("dgemm", 2.0 * c.Rows() * c.Cols() * a.Cols(),
+		                      8.0 * (a.Rows() * a.Cols() + b.Rows() * b.Cols() + c.Rows() * c.Cols()));
 		char transa_ = (OA == ColMajor) ? 'N' : 'T';
 		char transb_ = (OB == ColMajor) ? 'N' : 'T'; 
 	
 		integer n = c.Rows();
 		integer m = c.Cols();
-		integer k = a.Dist();
+		integer k = a.Cols();
 	
 		double alpha = 1.0;
 		double beta = 0;
@@ -93,47 +96,88 @@ namespace Mathlib
 
 
 
-	// LU decomposition and linear system solver
-	template <ORDERING ORD>
+	// LU decomposition and linear system solver, T = double or float
+	template <ORDERING ORD, typename T = double>
 	class LapackLU {
-		Matrix <double, ORD> a;
+		static_assert(std::is_same_v<T, double> || std::is_same_v<T, float>, "LapackLU supports double and float");
+
+		Matrix <T, ORD> a;
 		std::vector<integer> ipiv;
+		integer info = 0;
 		
 	public:
-		LapackLU (Matrix<double,ORD> _a)
+		LapackLU (Matrix<T,ORD> _a)
 		: a(std::move(_a)), ipiv(a.Rows()) {
-		integer m = a.Rows();
+		MATHLIB_PROFILE_SCOPE("getrf", 2.0 / 3.0 * a.Rows() * a.Rows() * a.Cols(), sizeof(T) * a.Rows() * a.Cols());
+		// Lapack sees a row-major matrix as its transpose
+		integer m = (ORD == ColMajor) ? a.Rows() : a.Cols();
+		integer n = (ORD == ColMajor) ? a.Cols() : a.Rows();
 		if (m == 0) return;
-		integer n = a.Cols();
 		integer lda = a.Dist();
-		integer info;
 		
 		// int dgetrf_(integer *m, integer *n, doublereal *a, 
 		//             integer * lda, integer *ipiv, integer *info);
 
-		dgetrf_(&n, &m, &a(0,0), &lda, &ipiv[0], &info);
+		if constexpr (std::is_same_v<T, double>)
+			dgetrf_(&m, &n, a.Data(), &lda, &ipiv[0], &info);
+		else
+			sgetrf_(&m, &n, a.Data(), &lda, &ipiv[0], &info);
 		}
-		
+
+		// 0 on success, i > 0 if U(i,i) is exactly zero (factorization of a singular matrix)
+		integer Info() const { return info; }
+
+		size_t Size() const { return a.Rows(); }
+
 		// b overwritten with A^{-1} b
-		void Solve (VectorView<double> b) const {
+		void Solve (VectorView<T> b) const {
 		char transa =  (ORD == ColMajor) ? 'N' : 'T';
 		integer n = a.Rows();
 		integer nrhs = 1;
 		integer lda = a.Dist();
-		integer ldb = b.size();
+		integer ldb = std::max<integer>(b.Size(), 1);
 		integer info;
 
 		// int dgetrs_(char *trans, integer *n, integer *nrhs, 
 		//             doublereal *a, integer *lda, integer *ipiv,
 		//             doublereal *b, integer *ldb, integer *info);
 
-		dgetrs_(&transa, &n, &nrhs, a.Data(), &lda, (integer*)ipiv.data(), b.Data(), &ldb, &info);
+		if constexpr (std::is_same_v<T, double>)
+			dgetrs_(&transa, &n, &nrhs, a.Data(), &lda, (integer*)ipiv.data(), b.Data(), &ldb, &info);
+		else
+			sgetrs_(&transa, &n, &nrhs, a.Data(), &lda, (integer*)ipiv.data(), b.Data(), &ldb, &info);
 		}
-	
-		Matrix<double,ORD> Inverse() && {
-		double hwork;
+
+		// Each column of b overwritten with A^{-1} b
+		void Solve (MatrixView<T, ColMajor> b) const {
+		char transa =  (ORD == ColMajor) ? 'N' : 'T';
+		integer n = a.Rows();
+		integer nrhs = b.Cols();
+		integer lda = a.Dist();
+		integer ldb = std::max<integer>(b.Dist(), 1);
+		integer info;
+		if (nrhs == 0) return;
+
+		if constexpr (std::is_same_v<T, double>)
+			dgetrs_(&transa, &n, &nrhs, a.Data(), &lda, (integer*)ipiv.data(), b.Data(), &ldb, &info);
+		else
+			sgetrs_(&transa, &n, &nrhs, a.Data(), &lda, (integer*)ipiv.data(), b.Data(), &ldb, &info);
+		}
+
+		// Product of the pivots, with the sign of the row permutation
+		T Det () const {
+		T det = 1;
+		for (size_t i = 0; i < a.Rows(); ++i) {
+			det *= a(i, i);
+			if (ipiv[i] != integer(i+1)) det = -det;
+		}
+		return det;
+		}
+
+		Matrix<T,ORD> Inverse() && {
+		T hwork;
 		integer lwork = -1;
-		integer n = a.Height();      
+		integer n = a.Rows();
 		integer lda = a.Dist();
 		integer info;
 
@@ -142,16 +186,22 @@ namespace Mathlib
 		//             integer *info);
 
 		// query work-size
-		dgetri_(&n, &a(0,0), &lda, ipiv.data(), &hwork, &lwork, &info);
+		if constexpr (std::is_same_v<T, double>)
+			dgetri_(&n, a.Data(), &lda, ipiv.data(), &hwork, &lwork, &info);
+		else
+			sgetri_(&n, a.Data(), &lda, ipiv.data(), &hwork, &lwork, &info);
 		lwork = integer(hwork);
-		std::vector<double> work(lwork);
-		dgetri_(&n, &a(0,0), &lda, ipiv.data(), &work[0], &lwork, &info);
+		Vector<T> work(lwork, WorkspaceAllocator());
+		if constexpr (std::is_same_v<T, double>)
+			dgetri_(&n, a.Data(), &lda, ipiv.data(), work.Data(), &lwork, &info);
+		else
+			sgetri_(&n, a.Data(), &lda, ipiv.data(), work.Data(), &lwork, &info);
 		return std::move(a);      
 		}
 
-		// Matrix<double,ORD> LFactor() const { ... }
-		// Matrix<double,ORD> UFactor() const { ... }
-		// Matrix<double,ORD> PFactor() const { ... }
+		// Matrix<T,ORD> LFactor() const { ... }
+		// Matrix<T,ORD> UFactor() const { ... }
+		// Matrix<T,ORD> PFactor() const { ... }
 	};
 
   
@@ -0,0 +1,342 @@
+#ifndef FILE_LAZY
+#define FILE_LAZY
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "matrix.hpp"
+#include "partition.hpp"
+#include "profile.hpp"
+
+// Expressions assembled at run time, for callers that cannot use the expression
+// templates (the Python bindings build them operator by operator). Sums,
+// differences and multiples of vectors or matrices are kept as one linear
+// combination sum_k c_k x_k and evaluated in a single pass over memory, in
+// parallel for large sizes. Up to three contiguous terms go through fixed
+// kernels the compiler vectorizes; longer or strided combinations are
+// accumulated block-wise in a small buffer. Matrix expressions may also
+// contain products, whose factors are evaluated first and accumulated with
+// the product kernels.
+
+namespace Mathlib {
+
+    template <typename T>
+    struct LazyTerm {
+        T coef;
+        VectorView<T, size_t> x;
+    };
+
+    namespace detail {
+
+        constexpr size_t LAZY_BLOCK = 256;
+
+        // res[i] = sum_k c_k x_k[i] for first <= i < next, all with unit stride
+        template <typename T>
+        bool CombineContiguous(const std::vector<LazyTerm<T>>& terms, T* res, size_t first, size_t next) {
+            const size_t n = next - first;
+            auto x = [&](size_t k) { return terms[k].x.Data() + first; };
+            T* r = res + first;
+            switch (terms.size()) {
+            case 1: {
+                const T c0 = terms[0].coef;
+                const T* x0 = x(0);
+                for (size_t i = 0; i < n; ++i)
+                    r[i] = c0 * x0[i];
+                return true;
+            }
+            case 2: {
+                const T c0 = terms[0].coef, c1 = terms[1].coef;
+                const T *x0 = x(0), *x1 = x(1);
+                for (size_t i = 0; i < n; ++i)
+                    r[i] = c0 * x0[i] + c1 * x1[i];
+                return true;
+            }
+            case 3: {
+                const T c0 = terms[0].coef, c1 = terms[1].coef, c2 = terms[2].coef;
+                const T *x0 = x(0), *x1 = x(1), *x2 = x(2);
+                for (size_t i = 0; i < n; ++i)
+                    r[i] = c0 * x0[i] + c1 * x1[i] + c2 * x2[i];
+                return true;
+            }
+            }
+            return false;
+        }
+
+        // Any number of terms and strides: blocks are summed up in a local buffer
+        // before they are stored, so res may be one of the x_k
+        template <typename T>
+        void CombineBlocked(const std::vector<LazyTerm<T>>& terms, VectorView<T, size_t> res, size_t first, size_t next) {
+            T buf[LAZY_BLOCK];
+            for (size_t b = first; b < next; b += LAZY_BLOCK) {
+                const size_t n = std::min(LAZY_BLOCK, next - b);
+                for (size_t k = 0; k < terms.size(); ++k) {
+                    const T c = terms[k].coef;
+                    const size_t d = terms[k].x.Dist();
+                    const T* x = terms[k].x.Data() + b * d;
+                    if (k == 0)
+                        for (size_t i = 0; i < n; ++i) buf[i] = c * x[i * d];
+                    else
+                        for (size_t i = 0; i < n; ++i) buf[i] += c * x[i * d];
+                }
+                const size_t d = res.Dist();
+                T* r = res.Data() + b * d;
+                for (size_t i = 0; i < n; ++i)
+                    r[i * d] = buf[i];
+            }
+        }
+
+        template <typename T>
+        void CombineRange(const std::vector<LazyTerm<T>>& terms, VectorView<T, size_t> res, size_t first, size_t next) {
+            if (terms.empty()) {
+                for (size_t i = first; i < next; ++i) res(i) = T(0);
+                return;
+            }
+            bool contiguous = res.Dist() == 1;
+            for (auto& t : terms)
+                contiguous = contiguous && t.x.Dist() == 1;
+            if (!(contiguous && CombineContiguous(terms, res.Data(), first, next)))
+                CombineBlocked(terms, res, first, next);
+        }
+
+        // Evaluates the combination into res, ntasks == 0 meaning InitTasks
+        template <typename T>
+        void Combine(const std::vector<LazyTerm<T>>& terms, VectorView<T, size_t> res, size_t ntasks) {
+            const size_t n = res.Size();
+            MATHLIB_PROFILE_SCOPE("LazyCombine", 2.0 * terms.size() * n, sizeof(T) * (terms.size() + 1) * n);
+            ParallelFor(n, ntasks ? ntasks : InitTasks(n), [&](size_t first, size_t next) {
+                CombineRange(terms, res, first, next);
+            }, LAZY_BLOCK);
+        }
+
+        // Adds c*x to the terms, merging it with an existing term on the same vector
+        template <typename T>
+        void AddTerm(std::vector<LazyTerm<T>>& terms, LazyTerm<T> t) {
+            for (auto& u : terms)
+                if (u.x.Data() == t.x.Data() && u.x.Dist() == t.x.Dist() && u.x.Size() == t.x.Size()) {
+                    u.coef += t.coef;
+                    return;
+                }
+            terms.push_back(t);
+        }
+
+        // One past the last element of m
+        template <typename T, ORDERING ORD>
+        const T* EndOf(const MatrixView<T, ORD>& m) {
+            const size_t inner = (ORD == ColMajor) ? m.Rows() : m.Cols();
+            const size_t outer = (ORD == ColMajor) ? m.Cols() : m.Rows();
+            return m.Data() + (inner && outer ? (outer - 1) * m.Dist() + inner : 0);
+        }
+
+        // True if the memory spanned by the two matrices intersects
+        template <typename T, ORDERING OA, ORDERING OB>
+        bool Overlaps(const MatrixView<T, OA>& a, const MatrixView<T, OB>& b) {
+            return a.Data() < EndOf(b) && b.Data() < EndOf(a);
+        }
+    }
+
+
+    // sum_k c_k x_k over vectors of equal size. The vectors are referenced, not
+    // copied, and must stay alive until the expression is evaluated.
+    template <typename T>
+    class LazyVector {
+        size_t size = 0;
+        std::vector<LazyTerm<T>> terms;
+
+    public:
+        LazyVector() = default;
+        LazyVector(VectorView<T, size_t> x, T coef = T(1)) : size(x.Size()), terms{ { coef, x } } { }
+
+        size_t Size() const { return size; }
+        const std::vector<LazyTerm<T>>& Terms() const { return terms; }
+
+        // Terms on the same vector are merged, a + 2*a has a single term
+        LazyVector& operator+=(const LazyVector& other) {
+            if (terms.empty()) size = other.size;
+            if (other.size != size) throw std::invalid_argument("Vector sizes do not match");
+            for (auto& t : other.terms)
+                detail::AddTerm(terms, t);
+            return *this;
+        }
+
+        LazyVector& operator-=(const LazyVector& other) { return *this += T(-1) * other; }
+
+        LazyVector& operator*=(T scal) {
+            for (auto& t : terms)
+                t.coef *= scal;
+            return *this;
+        }
+
+        // res = expression in one pass. res may be one of the terms, but must not
+        // partially overlap them.
+        void Evaluate(VectorView<T, size_t> res, size_t ntasks = 0) const {
+            if (res.Size() != size) throw std::invalid_argument("Vector sizes do not match");
+            detail::Combine(terms, res, ntasks);
+        }
+
+        Vector<T> Evaluate() const {
+            Vector<T> res(size);
+            Evaluate(res);
+            return res;
+        }
+
+        friend LazyVector operator+(LazyVector a, const LazyVector& b) { return a += b; }
+        friend LazyVector operator-(LazyVector a, const LazyVector& b) { return a -= b; }
+        friend LazyVector operator-(LazyVector a) { return a *= T(-1); }
+        friend LazyVector operator*(T scal, LazyVector a) { return a *= scal; }
+        friend LazyVector operator*(LazyVector a, T scal) { return a *= scal; }
+    };
+
+
+    // Linear combination of matrices and of products of such expressions,
+    // sum_k c_k X_k + sum_l d_l F_l G_l. The matrices are referenced, not copied.
+    template <typename T, ORDERING ORD = ColMajor>
+    class LazyMatrix {
+    public:
+        struct Term {
+            T coef;
+            MatrixView<T, ORD> x;
+        };
+        struct Product {
+            T coef;
+            std::shared_ptr<const LazyMatrix> a, b;
+        };
+
+    private:
+        size_t rows = 0, cols = 0;
+        std::vector<Term> terms;
+        std::vector<Product> products;
+
+        bool Empty() const { return terms.empty() && products.empty(); }
+
+        void CheckShape(size_t r, size_t c) const {
+            if (r != rows || c != cols) throw std::invalid_argument("Matrix shapes do not match");
+        }
+
+        // View of coef * f: f itself if it is a plain matrix that does not overlap res,
+        // otherwise f evaluated into storage
+        static MatrixView<T, ORD> Factor(const LazyMatrix& f, T coef, MatrixView<T, ORD> res,
+                                         Matrix<T, ORD>& storage) {
+            if (f.products.empty() && f.terms.size() == 1 && f.terms[0].coef * coef == T(1)
+                && !detail::Overlaps(f.terms[0].x, res))
+                return f.terms[0].x;
+            storage.Resize(f.rows, f.cols);
+            f.Evaluate(storage);
+            if (coef != T(1)) storage *= coef;
+            return storage;
+        }
+
+        // res = sum_k c_k X_k, line by line unless all matrices are contiguous
+        void EvaluateTerms(MatrixView<T, ORD> res, size_t ntasks) const {
+            const size_t inner = (ORD == ColMajor) ? rows : cols;
+            const size_t outer = (ORD == ColMajor) ? cols : rows;
+            bool contiguous = res.Dist() == inner;
+            for (auto& t : terms)
+                contiguous = contiguous && t.x.Dist() == inner;
+
+            if (contiguous) {
+                std::vector<LazyTerm<T>> flat;
+                for (auto& t : terms)
+                    flat.push_back({ t.coef, VectorView<T, size_t>(rows * cols, size_t(1), t.x.Data()) });
+                detail::Combine(flat, VectorView<T, size_t>(rows * cols, size_t(1), res.Data()), ntasks);
+                return;
+            }
+
+            ParallelFor(outer, ntasks ? ntasks : InitTasks(rows * cols), [&](size_t first, size_t next) {
+                std::vector<LazyTerm<T>> line(terms.size());
+                for (size_t j = first; j < next; ++j) {
+                    for (size_t k = 0; k < terms.size(); ++k)
+                        line[k] = { terms[k].coef, VectorView<T, size_t>(inner, size_t(1), terms[k].x.Data() + j * terms[k].x.Dist()) };
+                    detail::CombineRange(line, VectorView<T, size_t>(inner, size_t(1), res.Data() + j * res.Dist()), 0, inner);
+                }
+            });
+        }
+
+    public:
+        LazyMatrix() = default;
+        LazyMatrix(MatrixView<T, ORD> x, T coef = T(1)) : rows(x.Rows()), cols(x.Cols()), terms{ { coef, x } } { }
+
+        size_t Rows() const { return rows; }
+        size_t Cols() const { return cols; }
+        size_t NumTerms() const { return terms.size(); }
+        size_t NumProducts() const { return products.size(); }
+
+        LazyMatrix& operator+=(const LazyMatrix& other) {
+            if (Empty()) {
+                rows = other.rows;
+                cols = other.cols;
+            }
+            CheckShape(other.rows, other.cols);
+            for (auto& t : other.terms) {
+                auto same = std::find_if(terms.begin(), terms.end(), [&](const Term& u) {
+                    return u.x.Data() == t.x.Data() && u.x.Dist() == t.x.Dist()
+                        && u.x.Rows() == t.x.Rows() && u.x.Cols() == t.x.Cols();
+                });
+                if (same != terms.end()) same->coef += t.coef;
+                else terms.push_back(t);
+            }
+            products.insert(products.end(), other.products.begin(), other.products.end());
+            return *this;
+        }
+
+        LazyMatrix& operator-=(const LazyMatrix& other) { return *this += T(-1) * other; }
+
+        LazyMatrix& operator*=(T scal) {
+            for (auto& t : terms) t.coef *= scal;
+            for (auto& p : products) p.coef *= scal;
+            return *this;
+        }
+
+        // res = expression. The plain terms are combined in one pass, then the
+        // products are accumulated with AddMatMatDefault (MultMatMatDefault for
+        // a single product). Factors that are sums are evaluated once.
+        void Evaluate(MatrixView<T, ORD> res, size_t ntasks = 0) const {
+            CheckShape(res.Rows(), res.Cols());
+            if (products.empty()) {
+                EvaluateTerms(res, ntasks);
+                return;
+            }
+
+            // factors first, the first pass overwrites res
+            std::vector<Matrix<T, ORD>> storage(2 * products.size(), Matrix<T, ORD>(0, 0));
+            std::vector<std::pair<MatrixView<T, ORD>, MatrixView<T, ORD>>> factors;
+            for (size_t l = 0; l < products.size(); ++l)
+                factors.emplace_back(Factor(*products[l].a, products[l].coef, res, storage[2*l]),
+                                     Factor(*products[l].b, T(1), res, storage[2*l+1]));
+
+            size_t l = 0;
+            if (terms.empty()) {
+                MultMatMatDefault(factors[0].first, factors[0].second, res);
+                l = 1;
+            }
+            else
+                EvaluateTerms(res, ntasks);
+            for (; l < factors.size(); ++l)
+                AddMatMatDefault(factors[l].first, factors[l].second, res);
+        }
+
+        Matrix<T, ORD> Evaluate() const {
+            Matrix<T, ORD> res(rows, cols);
+            Evaluate(res);
+            return res;
+        }
+
+        friend LazyMatrix operator+(LazyMatrix a, const LazyMatrix& b) { return a += b; }
+        friend LazyMatrix operator-(LazyMatrix a, const LazyMatrix& b) { return a -= b; }
+        friend LazyMatrix operator-(LazyMatrix a) { return a *= T(-1); }
+        friend LazyMatrix operator*(T scal, LazyMatrix a) { return a *= scal; }
+        friend LazyMatrix operator*(LazyMatrix a, T scal) { return a *= scal; }
+
+        friend LazyMatrix operator*(const LazyMatrix& a, const LazyMatrix& b) {
+            if (a.cols != b.rows) throw std::invalid_argument("Matrix dimensions do not match for multiplication");
+            LazyMatrix res;
+            res.rows = a.rows;
+            res.cols = b.cols;
+            res.products.push_back({ T(1), std::make_shared<const LazyMatrix>(a), std::make_shared<const LazyMatrix>(b) });
+            return res;
+        }
+    };
+}
+
+#endif
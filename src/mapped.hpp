@@ -0,0 +1,271 @@
+#ifndef FILE_MAPPED
+#define FILE_MAPPED
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "matrix.hpp"
+
+// File-backed matrices and vectors. The file starts with a MappedHeader, the
+// data follows at a page-aligned offset in the ordering and leading dimension
+// given in the header. Opening maps the file without reading it (O(1)), pages
+// are loaded on first access. MappedMatrix is a MatrixView (MappedVector a
+// VectorView), so all views, expressions and kernels work on the mapping directly.
+//
+//   ReadOnly    - PROT_READ, writing through the view crashes
+//   ReadWrite   - MAP_SHARED, changes go to the file (Flush() to force)
+//   CopyOnWrite - MAP_PRIVATE, changes stay in this process, the file is unchanged
+
+namespace Mathlib {
+
+    enum class DType : uint32_t { Float32 = 1, Float64 = 2, Int32 = 3, Int64 = 4, UInt64 = 5 };
+
+    template <typename T> constexpr DType DTypeOf();
+    template <> constexpr DType DTypeOf<float>()    { return DType::Float32; }
+    template <> constexpr DType DTypeOf<double>()   { return DType::Float64; }
+    template <> constexpr DType DTypeOf<int32_t>()  { return DType::Int32; }
+    template <> constexpr DType DTypeOf<int64_t>()  { return DType::Int64; }
+    template <> constexpr DType DTypeOf<uint64_t>() { return DType::UInt64; }
+
+    enum class MapMode { ReadOnly, ReadWrite, CopyOnWrite };
+
+    struct MappedHeader {
+        static constexpr char MAGIC[8] = { 'N', 'P', 'M', 'A', 'T', 'R', 'I', 'X' };
+        static constexpr uint32_t VERSION = 1;
+        static constexpr uint32_t FLAG_VECTOR = 1;
+        static constexpr uint32_t FLAG_CHECKSUMS = 2;   // checksum table after the data, see serialize.hpp
+
+        char magic[8];
+        uint32_t version;
+        uint32_t dtype;
+        uint32_t ordering;
+        uint32_t flags;
+        uint64_t rows, cols, dist;
+        uint64_t data_offset;     // multiple of the page size
+    };
+    static_assert(sizeof(MappedHeader) == 56, "MappedHeader must have a fixed layout");
+
+
+    // Owns the mapping of a whole file
+    class MappedFile {
+        void* ptr = nullptr;
+        size_t size = 0;
+
+    public:
+        MappedFile() = default;
+
+#ifndef _WIN32
+        // Maps an existing file
+        MappedFile(const std::string& filename, MapMode mode) {
+            int fd = ::open(filename.c_str(), mode == MapMode::ReadWrite ? O_RDWR : O_RDONLY);
+            if (fd < 0) throw std::runtime_error("Cannot open " + filename);
+            struct stat st;
+            if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(MappedHeader)) {
+                ::close(fd);
+                throw std::runtime_error("Not a mapped matrix file: " + filename);
+            }
+            size = st.st_size;
+            int prot = (mode == MapMode::ReadOnly) ? PROT_READ : PROT_READ | PROT_WRITE;
+            int flags = (mode == MapMode::ReadWrite) ? MAP_SHARED : MAP_PRIVATE;
+            ptr = mmap(nullptr, size, prot, flags, fd, 0);
+            ::close(fd);   // the mapping keeps the file alive
+            if (ptr == MAP_FAILED) {
+                ptr = nullptr;
+                throw std::runtime_error("Cannot map " + filename);
+            }
+        }
+
+        // Creates (or truncates) a file of the given size and maps it shared.
+        // The file is sparse, unwritten parts read as zero.
+        MappedFile(const std::string& filename, size_t _size) {
+            int fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) throw std::runtime_error("Cannot create " + filename);
+            if (ftruncate(fd, off_t(_size)) != 0) {
+                ::close(fd);
+                throw std::runtime_error("Cannot resize " + filename);
+            }
+            size = _size;
+            ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (ptr == MAP_FAILED) {
+                ptr = nullptr;
+                throw std::runtime_error("Cannot map " + filename);
+            }
+        }
+
+        ~MappedFile() {
+            if (ptr) munmap(ptr, size);
+        }
+
+        void Flush() const {
+            if (ptr && msync(ptr, size, MS_SYNC) != 0)
+                throw std::runtime_error("msync failed");
+        }
+
+        // Hint that the whole file will be needed soon
+        void Prefetch() const {
+            if (ptr) madvise(ptr, size, MADV_WILLNEED);
+        }
+#else
+        MappedFile(const std::string&, MapMode) { throw std::runtime_error("Mapped files are not supported on this platform"); }
+        MappedFile(const std::string&, size_t) { throw std::runtime_error("Mapped files are not supported on this platform"); }
+        void Flush() const { }
+        void Prefetch() const { }
+#endif
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&& other) : ptr(other.ptr), size(other.size) { other.ptr = nullptr; other.size = 0; }
+        MappedFile& operator=(MappedFile&& other) {
+            std::swap(ptr, other.ptr);
+            std::swap(size, other.size);
+            return *this;
+        }
+
+        char* Data() const { return static_cast<char*>(ptr); }
+        size_t Size() const { return size; }
+        const MappedHeader& Header() const { return *reinterpret_cast<const MappedHeader*>(ptr); }
+    };
+
+
+    namespace detail {
+        inline size_t MappedDataOffset() { return PAGE_SIZE; }
+
+        template <typename T>
+        MappedFile CreateMapped(const std::string& filename, uint32_t ordering, uint32_t flags,
+                                size_t rows, size_t cols, size_t dist, size_t outer) {
+            const size_t offset = MappedDataOffset();
+            MappedFile file(filename, offset + dist * outer * sizeof(T));
+            MappedHeader h{};
+            std::memcpy(h.magic, MappedHeader::MAGIC, sizeof(h.magic));
+            h.version = MappedHeader::VERSION;
+            h.dtype = uint32_t(DTypeOf<T>());
+            h.ordering = ordering;
+            h.flags = flags;
+            h.rows = rows;
+            h.cols = cols;
+            h.dist = dist;
+            h.data_offset = offset;
+            std::memcpy(file.Data(), &h, sizeof(h));
+            return file;
+        }
+
+        // Checks the header against the expected type and the file size
+        template <typename T>
+        void CheckMapped(const MappedFile& file, uint32_t ordering, bool vector) {
+            const MappedHeader& h = file.Header();
+            if (std::memcmp(h.magic, MappedHeader::MAGIC, sizeof(h.magic)) != 0)
+                throw std::runtime_error("Not a mapped matrix file");
+            if (h.version != MappedHeader::VERSION)
+                throw std::runtime_error("Unsupported mapped matrix version");
+            if (h.dtype != uint32_t(DTypeOf<T>()))
+                throw std::runtime_error("Mapped matrix has a different element type");
+            if (bool(h.flags & MappedHeader::FLAG_VECTOR) != vector)
+                throw std::runtime_error(vector ? "Mapped file holds a matrix" : "Mapped file holds a vector");
+            if (!vector && h.ordering != ordering)
+                throw std::runtime_error("Mapped matrix has a different ordering");
+
+            const uint64_t inner = (ordering == ColMajor) ? h.rows : h.cols;
+            const uint64_t outer = (ordering == ColMajor) ? h.cols : h.rows;
+            // divide instead of multiplying, the header fields may be anything
+            if (h.dist < inner || h.data_offset % PAGE_SIZE != 0 || h.data_offset > file.Size()
+                || (outer && h.dist > (file.Size() - h.data_offset) / sizeof(T) / outer))
+                throw std::runtime_error("Mapped matrix file is truncated or corrupt");
+        }
+    }
+
+
+    template <typename T, ORDERING ORD = ColMajor>
+    class MappedMatrix : public MatrixView<T, ORD> {
+        typedef MatrixView<T, ORD> BASE;
+        MappedFile file;
+
+    public:
+        // Matrix at byte offset 'offset' of a mapped file with any header (e.g. NPY)
+        MappedMatrix(MappedFile&& _file, size_t r, size_t c, size_t dist, size_t offset)
+            : BASE(r, c, dist, reinterpret_cast<T*>(_file.Data() + offset)), file(std::move(_file)) { }
+
+        // New file for an r x c matrix with zero entries, mapped read-write
+        static MappedMatrix Create(const std::string& filename, size_t r, size_t c) {
+            const size_t inner = (ORD == ColMajor) ? r : c;
+            const size_t outer = (ORD == ColMajor) ? c : r;
+            MappedFile file = detail::CreateMapped<T>(filename, ORD, 0, r, c, inner, outer);
+            return MappedMatrix(std::move(file), r, c, inner, detail::MappedDataOffset());
+        }
+
+        static MappedMatrix Open(const std::string& filename, MapMode mode = MapMode::ReadOnly) {
+            MappedFile file(filename, mode);
+            detail::CheckMapped<T>(file, ORD, false);
+            const MappedHeader h = file.Header();
+            return MappedMatrix(std::move(file), h.rows, h.cols, h.dist, h.data_offset);
+        }
+
+        MappedMatrix(MappedMatrix&&) = default;
+        MappedMatrix(const MappedMatrix&) = delete;
+
+        using BASE::operator=;
+        // Copies the values into the mapping
+        MappedMatrix& operator=(const MatrixView<T, ORD>& other) {
+            BASE::operator=(static_cast<const MatExpr<MatrixView<T, ORD>>&>(other));
+            return *this;
+        }
+        MappedMatrix& operator=(const MappedMatrix& other) { return *this = static_cast<const BASE&>(other); }
+
+        void Flush() const { file.Flush(); }
+        void Prefetch() const { file.Prefetch(); }
+        const MappedHeader& Header() const { return file.Header(); }   // only for files of this format
+        const MappedFile& File() const { return file; }
+    };
+
+
+    template <typename T>
+    class MappedVector : public VectorView<T> {
+        typedef VectorView<T> BASE;
+        MappedFile file;
+
+    public:
+        // Vector at byte offset 'offset' of a mapped file with any header (e.g. NPY)
+        MappedVector(MappedFile&& _file, size_t n, size_t offset)
+            : BASE(n, reinterpret_cast<T*>(_file.Data() + offset)), file(std::move(_file)) { }
+
+        // New file for a vector of size n with zero entries, mapped read-write
+        static MappedVector Create(const std::string& filename, size_t n) {
+            MappedFile file = detail::CreateMapped<T>(filename, ColMajor, MappedHeader::FLAG_VECTOR, n, 1, n, 1);
+            return MappedVector(std::move(file), n, detail::MappedDataOffset());
+        }
+
+        static MappedVector Open(const std::string& filename, MapMode mode = MapMode::ReadOnly) {
+            MappedFile file(filename, mode);
+            detail::CheckMapped<T>(file, ColMajor, true);
+            const size_t n = file.Header().rows, offset = file.Header().data_offset;
+            return MappedVector(std::move(file), n, offset);
+        }
+
+        MappedVector(MappedVector&&) = default;
+        MappedVector(const MappedVector&) = delete;
+
+        using BASE::operator=;
+        // Copies the values into the mapping
+        MappedVector& operator=(const VectorView<T>& other) {
+            BASE::operator=(static_cast<const VecExpr<VectorView<T>>&>(other));
+            return *this;
+        }
+        MappedVector& operator=(const MappedVector& other) { return *this = static_cast<const BASE&>(other); }
+
+        void Flush() const { file.Flush(); }
+        void Prefetch() const { file.Prefetch(); }
+        const MappedHeader& Header() const { return file.Header(); }   // only for files of this format
+        const MappedFile& File() const { return file; }
+    };
+}
+
+#endif
@@ -15,12 +15,26 @@ namespace Mathlib{
     template <typename T1, typename T2, ORDERING OA, ORDERING OB>
     class LapackMultExpr;
 
-    class T_Parallel { };
-    static constexpr T_Parallel Parallel;
+    // T_Parallel / Parallel: see partition.hpp
 
     template <typename T1, typename T2, ORDERING OA, ORDERING OB>
     class ParallelMultExpr;
 
+    class T_Auto { };
+    static constexpr T_Auto Auto;
+
+    // Matrix(r, c, Padded): leading dimension rounded up by PaddedDist, see memory.hpp
+    class T_Padded { };
+    static constexpr T_Padded Padded;
+
+    template <typename T1, typename T2, ORDERING OA, ORDERING OB>
+    class AutoMultExpr;
+
+    // T_Async / Async: see async.hpp
+
+    template <typename TM, typename EM>
+    class SparseMatMatExpr;
+
     template <typename T, ORDERING ORD = ColMajor>
     class MatrixView : public MatExpr<MatrixView<T, ORD>> {
     protected:
@@ -55,20 +69,28 @@ namespace Mathlib{
             return *this;
         }
 
-        // Assignment from multiplication of two matrices
+        // Assignment from multiplication of two matrices, see MultMatMatDefault in dispatch.hpp
         template <typename T1, typename T2, ORDERING OA, ORDERING OB>
         MatrixView& operator=(const MatExprMul<MatrixView<T1, OA>, MatrixView<T2, OB>>& expr) {
-            AddMatMat(expr.Left(), expr.Right(), *this);
+            MultMatMatDefault(expr.Left(), expr.Right(), *this);
             return *this;
         }
 
         // Assignment from RunParallel multiplication
         template <typename TA, typename TB, ORDERING OA, ORDERING OB>
         MatrixView& operator=(const ParallelMultExpr<TA, TB, OA, OB>& other) {
+            *this = T(0);
             AddMatMatParallel(other.a, other.b, *this);
             return *this;
         }
 
+        // Assignment from multiplication with automatically chosen backend
+        template <typename TA, typename TB, ORDERING OA, ORDERING OB>
+        MatrixView& operator=(const AutoMultExpr<TA, TB, OA, OB>& other) {
+            MultMatMatAuto(other.a, other.b, *this);
+            return *this;
+        }
+
         // Assignment from Lapack multiplication
         template <typename TA, typename TB, ORDERING OA, ORDERING OB>
         MatrixView& operator=(const LapackMultExpr<TA, TB, OA, OB>& other) {
@@ -76,6 +98,13 @@ namespace Mathlib{
             return *this;
         }
 
+        // Assignment from sparse matrix times dense matrix, see sparse_matrix.hpp
+        template <typename TM, typename EM>
+        MatrixView& operator=(const SparseMatMatExpr<TM, EM>& expr) {
+            MultSparseMatMat(expr.Left(), expr.Right(), *this);
+            return *this;
+        }
+
         // Scalar assignment
         MatrixView& operator=(T scal) {
             for (size_t i = 0; i < rows; ++i)
@@ -84,6 +113,37 @@ namespace Mathlib{
             return *this;
         }
 
+        // In-place updates, one pass over the data without temporaries
+        template<typename E>
+        MatrixView& operator+=(const MatExpr<E>& other) {
+            for (size_t i = 0; i < rows; ++i)
+                for (size_t j = 0; j < cols; ++j)
+                    data[index(i, j)] += other(i, j);
+            return *this;
+        }
+
+        template<typename E>
+        MatrixView& operator-=(const MatExpr<E>& other) {
+            for (size_t i = 0; i < rows; ++i)
+                for (size_t j = 0; j < cols; ++j)
+                    data[index(i, j)] -= other(i, j);
+            return *this;
+        }
+
+        // C += A*B accumulates with the product kernels, see AddMatMatDefault in dispatch.hpp
+        template <typename T1, typename T2, ORDERING OA, ORDERING OB>
+        MatrixView& operator+=(const MatExprMul<MatrixView<T1, OA>, MatrixView<T2, OB>>& expr) {
+            AddMatMatDefault(expr.Left(), expr.Right(), *this);
+            return *this;
+        }
+
+        MatrixView& operator*=(T scal) {
+            for (size_t i = 0; i < rows; ++i)
+                for (size_t j = 0; j < cols; ++j)
+                    data[index(i, j)] *= scal;
+            return *this;
+        }
+
         // Accessors
         T*     Data()  const { return data; }
         size_t Rows()  const { return rows; }
@@ -164,20 +224,86 @@ namespace Mathlib{
         using BASE::rows;
         using BASE::cols;
         using BASE::data;
+        Allocator* alloc;   // owner of data
+        size_t capacity;    // allocated elements, >= AllocSize()
+        bool padded;        // Resize keeps the leading dimension padded
+
+        // Number of elements used by the current shape, including the padding
+        size_t AllocSize() const { return this->dist * ((ORD == ColMajor) ? cols : rows); }
+
+        // Leading dimension of an r x c matrix under the padding policy
+        size_t DistFor(size_t r, size_t c) const {
+            const size_t inner = (ORD == ColMajor) ? r : c;
+            return padded ? PaddedDist<T>(inner) : inner;
+        }
+
+        // New shape, reallocates only if the storage is too small. Values are lost.
+        void SetShape(size_t r, size_t c, size_t _dist) {
+            const size_t needed = _dist * ((ORD == ColMajor) ? c : r);
+            if (needed > capacity) {
+                T* mem = AllocateBuffer<T>(needed, *alloc);
+                FreeBuffer(data, capacity, *alloc);
+                data = mem;
+                capacity = needed;
+            }
+            rows = r;
+            cols = c;
+            this->dist = _dist;
+        }
+
+        void CopyFrom(const Matrix& other) {
+            const size_t inner = (ORD == ColMajor) ? rows : cols;
+            const size_t outer = (ORD == ColMajor) ? cols : rows;
+            for (size_t j = 0; j < outer; ++j)
+                for (size_t i = 0; i < inner; ++i)
+                    data[j * this->dist + i] = other.data[j * other.dist + i];
+        }
+
+        // f(i, j) for all entries, split along the outer dimension as in AddMatMatParallel
+        template <typename FUNC>
+        void FillParallel(FUNC f) {
+            const size_t inner = (ORD == ColMajor) ? rows : cols;
+            const size_t outer = (ORD == ColMajor) ? cols : rows;
+            ParallelRanges(outer, InitTasks(rows * cols), [&](size_t first, size_t next) {
+                for (size_t j = first; j < next; ++j)
+                    for (size_t i = 0; i < inner; ++i) {
+                        if constexpr (ORD == ColMajor)
+                            data[j * this->dist + i] = f(i, j);
+                        else
+                            data[j * this->dist + i] = f(j, i);
+                    }
+            });
+        }
+
+        Matrix(size_t r, size_t c, size_t _dist, Allocator& _alloc, bool _padded = false) :
+            MatrixView<T, ORD>(r, c, _dist, nullptr), alloc(&_alloc), padded(_padded) {
+            capacity = AllocSize();
+            data = AllocateBuffer<T>(capacity, *alloc);
+        }
 
     public:
+        // Storage from the current allocator, see memory.hpp
         Matrix(size_t r, size_t c) : 
-            MatrixView<T, ORD>(r, c, new T[r * c]) { }
+            Matrix(r, c, CurrentAllocator()) { }
 
-        Matrix(const Matrix& other) : Matrix(other.Rows(), other.Cols()) {
-            *this = other;
+        Matrix(size_t r, size_t c, Allocator& _alloc) : 
+            Matrix(r, c, (ORD == ColMajor) ? r : c, _alloc) { }
+
+        Matrix(size_t r, size_t c, T_Padded) :
+            Matrix(r, c, PaddedDist<T>((ORD == ColMajor) ? r : c), CurrentAllocator(), true) { }
+
+        // Keeps the leading dimension (and padding) of other
+        Matrix(const Matrix& other) : Matrix(other.rows, other.cols, other.dist, CurrentAllocator(), other.padded) {
+            CopyFrom(other);
         }
 
-        Matrix(Matrix&& other) : MatrixView<T, ORD>(0, 0, nullptr) {
+        Matrix(Matrix&& other) : MatrixView<T, ORD>(0, 0, nullptr), alloc(other.alloc), capacity(0), padded(false) {
             std::swap(rows, other.rows);
             std::swap(cols, other.cols);
             std::swap(data, other.data);
             std::swap(this->dist, other.dist);
+            std::swap(capacity, other.capacity);
+            std::swap(padded, other.padded);
         }
 
         template <typename T2>
@@ -185,40 +311,101 @@ namespace Mathlib{
             *this = other;
         }
 
+        // Parallel first touch: each task fills the columns (col-major) or rows (row-major)
+        // it owns under StaticPartition, as in AddMatMatParallel. Matrix(r, c) itself
+        // doesn't touch the memory of trivial types.
+        Matrix(size_t r, size_t c, T_Parallel, const T& val) : Matrix(r, c) {
+            FillParallel([&](size_t, size_t) { return val; });
+        }
+
+        template <typename FUNC, typename = std::enable_if_t<std::is_invocable_v<FUNC, size_t, size_t>>>
+        Matrix(size_t r, size_t c, T_Parallel, FUNC gen) : Matrix(r, c) {   // (i, j) -> value
+            FillParallel(gen);
+        }
+
+        template <typename E>
+        Matrix(T_Parallel, const MatExpr<E>& expr) : Matrix(expr.Rows(), expr.Cols()) {
+            FillParallel([&](size_t i, size_t j) { return expr(i, j); });
+        }
+
+        size_t Capacity() const { return capacity; }
+
+        // Grows the storage to at least n elements, keeping shape and values
+        void Reserve(size_t n) {
+            if (n <= capacity) return;
+            T* mem = AllocateBuffer<T>(n, *alloc);
+            for (size_t i = 0; i < AllocSize(); ++i)
+                mem[i] = std::move(data[i]);
+            FreeBuffer(data, capacity, *alloc);
+            data = mem;
+            capacity = n;
+        }
+
+        // Changes the shape, reallocating only if it does not fit into Capacity().
+        // Values are not preserved if the shape changes.
+        void Resize(size_t r, size_t c) {
+            if (r == rows && c == cols) return;
+            SetShape(r, c, DistFor(r, c));
+        }
+
+        // Assignments reuse the storage if it is large enough. Expressions are
+        // written into the current shape, Resize first if it differs.
+
         using BASE::operator=;
-        Matrix& operator=(const Matrix& other) { // Copy
+        Matrix& operator=(const Matrix& other) { // Copy, takes over the leading dimension of other
             if (this != &other) {
-                delete[] data;
-                rows = other.rows;
-                cols = other.cols;
-                data = new T[rows * cols];
-                for (size_t i = 0; i < rows * cols; ++i)
-                    data[i] = other.data[i];
+                SetShape(other.rows, other.cols, other.dist);
+                padded = other.padded;
+                CopyFrom(other);
             }
             return *this;
         }
 
+        // Copies the values (MatrixView's own assignment would rebind the pointer)
+        Matrix& operator=(const MatrixView<T, ORD>& other) {
+            if (other.Data() == data && other.Rows() == rows && other.Cols() == cols && other.Dist() == this->dist)
+                return *this;
+            const T* begin = data;
+            const T* end = data + capacity;
+            if ((other.Rows() != rows || other.Cols() != cols) && other.Data() >= begin && other.Data() < end) {
+                // other looks into this matrix, the new layout would overwrite it
+                Matrix tmp(other.Rows(), other.Cols(), *alloc);
+                tmp.BASE::operator=(static_cast<const MatExpr<MatrixView<T, ORD>>&>(other));
+                return *this = std::move(tmp);
+            }
+            Resize(other.Rows(), other.Cols());
+            BASE::operator=(static_cast<const MatExpr<MatrixView<T, ORD>>&>(other));
+            return *this;
+        }
+
         Matrix& operator=(Matrix&& other) { // Move
             if (this != &other) {
-                delete[] data;
+                FreeBuffer(data, capacity, *alloc);
                 rows = other.rows;
                 cols = other.cols;
+                this->dist = other.dist;
                 data = other.data;
+                alloc = other.alloc;
+                capacity = other.capacity;
+                padded = other.padded;
                 other.data = nullptr;
-                other.rows = other.cols = 0;
+                other.rows = other.cols = other.dist = other.capacity = 0;
             }
             return *this;
         }
 
         ~Matrix() {
-            delete[] data;
+            FreeBuffer(data, capacity, *alloc);
         }
 
+        Allocator& GetAllocator() const { return *alloc; }
+
         Matrix<T, ORD> Invert() const {
             if(rows != cols) throw std::runtime_error("Matrix must be square to compute inverse");
             size_t n = rows;
 
-            Matrix<T, ORD> M(*this);
+            Matrix<T, ORD> M(rows, cols, WorkspaceAllocator());
+            M = *this;
             Matrix<T, ORD> I(rows, cols);
 
             for (size_t i = 0; i < n; ++i) {
@@ -276,7 +463,8 @@ namespace Mathlib{
             if (rows != cols) throw std::runtime_error("Matrix must be square to compute determinant");
             size_t n = rows;
 
-            Matrix<T, ORD> M(*this);
+            Matrix<T, ORD> M(rows, cols, WorkspaceAllocator());
+            M = *this;
             T det = T(1);
 
             // Perform Gaussian elimination to convert M to upper triangular form
@@ -331,6 +519,16 @@ namespace Mathlib{
             : a(_a), b(_b) { }
     };
 
+    template <typename T1, typename T2, ORDERING OA, ORDERING OB>
+    class AutoMultExpr {
+    public:
+        MatrixView<T1, OA> a;
+        MatrixView<T2, OB> b;
+
+        AutoMultExpr(const MatrixView<T1, OA>& _a, const MatrixView<T2, OB>& _b)
+            : a(_a), b(_b) { }
+    };
+
     template <typename T1, typename T2, ORDERING OA, ORDERING OB>
     auto operator|(const MatExprMul<MatrixView<T1, OA>, MatrixView<T2, OB>>& expr, T_Lapack) {
         return LapackMultExpr<T1, T2, OA, OB>(expr.Left(), expr.Right());
@@ -341,8 +539,29 @@ namespace Mathlib{
         return ParallelMultExpr<T1, T2, OA, OB>(expr.Left(), expr.Right());
     }
 
+    template <typename T1, typename T2, ORDERING OA, ORDERING OB>
+    auto operator|(const MatExprMul<MatrixView<T1, OA>, MatrixView<T2, OB>>& expr, T_Auto) {
+        return AutoMultExpr<T1, T2, OA, OB>(expr.Left(), expr.Right());
+    }
+
     template <typename T, ORDERING ORD>
     std::ostream& operator<<(std::ostream& os, const MatrixView<T, ORD>& m) {
+        if (detail::FastFormattable<T>(os)) {
+            // format a row at a time into a buffer
+            std::string buf;
+            const int prec = int(os.precision());
+            for (size_t i = 0; i < m.Rows(); ++i) {
+                buf.clear();
+                for (size_t j = 0; j < m.Cols(); ++j) {
+                    detail::AppendNumber(buf, m(i, j), prec);
+                    buf += ' ';
+                }
+                buf += '\n';
+                os.write(buf.data(), buf.size());
+            }
+            return os;
+        }
+
         for (size_t i = 0; i < m.Rows(); ++i) {
             for (size_t j = 0; j < m.Cols(); ++j)
                 os << m(i, j) << " ";
@@ -355,5 +574,6 @@ namespace Mathlib{
 
 #include "lapack_interface.hpp"
 #include "matrix_simd_ops.hpp"
+#include "dispatch.hpp"
 
 #endif
\ No newline at end of file
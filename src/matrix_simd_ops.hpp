@@ -1,4 +1,5 @@
 #include "matrix.hpp"
+#include "profile.hpp"
 #include "../NamePending-HPC/src/simd.hpp"
 #include "../NamePending-HPC/src/taskmanager.hpp"
 
@@ -8,12 +9,18 @@ using namespace ASC_HPC;
 using std::size_t;
 
 // Compute C_block(HxW) += A_block(HxK) * B_block(KxW)
-template <size_t H, size_t W>
+// ALIGNED: the columns of the A and C blocks start on H*sizeof(double) boundaries
+template <size_t H, size_t W, bool ALIGNED = false>
 inline void AddMatMatKernel(size_t K,
                             const double* a, size_t lda,
                             const double* b, size_t ldb,
                             double*       c, size_t ldc)
 {
+    if constexpr (ALIGNED) {
+        a = MATHLIB_ASSUME_ALIGNED(a, H * sizeof(double));
+        c = MATHLIB_ASSUME_ALIGNED(c, H * sizeof(double));
+    }
+
     // Load current C-block into registers: one SIMD<double, H> per column of the block
     SIMD<double, H> acc[W];
     for (size_t j = 0; j < W; ++j) {
@@ -54,17 +61,24 @@ void AddMatMat2(MatrixView<double> A,
     const size_t n = C.Cols();     // #cols of C (same as B.Cols())
     const size_t k = A.Cols();     // shared dimension
 
+    // Always true for the packed A block from AddMatMat, for C if it comes from an
+    // aligned Matrix whose Dist() is a multiple of H (e.g. Matrix(r, c, Padded))
+    const bool aligned = IsAligned(A.Data(), H * sizeof(double)) && A.Dist() % H == 0
+                      && IsAligned(C.Data(), H * sizeof(double)) && C.Dist() % H == 0;
+
     // Main blocked region: multiples of HxW
     size_t j = 0;
     for (; j + W <= n; j += W) {
         size_t i = 0;
         for (; i + H <= m; i += H) {
-            
-            AddMatMatKernel<H, W>(
-                k,
-                &A(i, 0), A.Dist(),          // A block: HxK starting at row i, col 0
-                &B(0, j), B.Dist(),          // B block: KxW starting at row 0, col j
-                &C(i, j), C.Dist());         // C block: HxW starting at (i, j)
+            if (aligned)
+                AddMatMatKernel<H, W, true>(k, &A(i, 0), A.Dist(), &B(0, j), B.Dist(), &C(i, j), C.Dist());
+            else
+                AddMatMatKernel<H, W>(
+                    k,
+                    &A(i, 0), A.Dist(),          // A block: HxK starting at row i, col 0
+                    &B(0, j), B.Dist(),          // B block: KxW starting at row 0, col j
+                    &C(i, j), C.Dist());         // C block: HxW starting at (i, j)
         }
 
         // Remaining rows for this W-wide stripe
@@ -96,6 +110,8 @@ void AddMatMat2(MatrixView<double> A,
 
 
 void AddMatMat (MatrixView<double> A, MatrixView<double> B, MatrixView<double> C) {
+  MATHLIB_PROFILE_SCOPE("AddMatMat", 2.0 * C.Rows() * C.Cols() * A.Cols(),
+                        8.0 * (A.Rows() * A.Cols() + B.Rows() * B.Cols() + 2.0 * C.Rows() * C.Cols()));
   constexpr size_t BH=96;
   constexpr size_t BW=96;
   alignas (64) double memBA[BH*BW];
@@ -106,49 +122,23 @@ void AddMatMat (MatrixView<double> A, MatrixView<double> B, MatrixView<double> C
 
       MatrixView<double> Ablock(i2-i1, j2-j1, BW, memBA);
       Ablock = A.RowRange(i1,i2).ColRange(j1,j2);
-
-        static Timer t(" ", { 1, 0, 0});
-        RegionTimer reg(t);
-
-
       AddMatMat2 (Ablock, B.RowRange(j1,j2), C.RowRange(i1,i2));
     }
 }
 
 
-void AddMatMatParallel(MatrixView<double> A, MatrixView<double> B, MatrixView<double> C)
+void AddMatMatParallel(MatrixView<double> A, MatrixView<double> B, MatrixView<double> C, size_t ntasks = DEFAULT_NTASKS)
     {
-        constexpr size_t NTASKS = 8;
-
-        StartWorkers(NTASKS-1);
-
-        RunParallel(NTASKS,
-            // func: gets called with (nr, size), nr in [0,size)
-            [&](int nr, int size)
+        MATHLIB_PROFILE_SCOPE("AddMatMatParallel", 2.0 * C.Rows() * C.Cols() * A.Cols(),
+                              8.0 * (A.Rows() * A.Cols() + B.Rows() * B.Cols() + 2.0 * C.Rows() * C.Cols()));
+        // Each task computes C_chunk += A * B_chunk for column ranges, starting with its
+        // columns under StaticPartition, so its part of C is contiguous and stays on its
+        // NUMA node (first touch with the same partition, see partition.hpp). Tasks that
+        // finish early steal columns from the others. Chunks are whole kernel widths (W = 12).
+        ParallelFor(C.Cols(), ntasks, [&](size_t j0, size_t j1)
             {
-                
-
-                const size_t m = C.Rows();
-                const size_t nTasks = static_cast<size_t>(size);
-
-                // ceil(m / nTasks)
-                const size_t chunk = (m + nTasks - 1) / nTasks;
-
-                const size_t i0 = static_cast<size_t>(nr) * chunk;
-                const size_t i1 = std::min(m, i0 + chunk);
-
-                if (i0 >= i1)
-                    return;   // this task has no rows to process
-
-                // Take the row ranges for this chunk
-                auto a_chunk = A.RowRange(i0, i1);
-                auto c_chunk = C.RowRange(i0, i1);
-
-                // Each task computes: C_chunk += A_chunk * B
-                AddMatMat(a_chunk, B, c_chunk);
-            });
-
-        StopWorkers();
+                AddMatMat(A, B.ColRange(j0, j1), C.ColRange(j0, j1));
+            }, 12);
     }
 
 } // namespace Mathlib
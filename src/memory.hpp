@@ -0,0 +1,337 @@
+#ifndef FILE_MEMORY
+#define FILE_MEMORY
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// Storage for Vector and Matrix. Buffers are aligned to a cache line, large ones
+// to a page, so SIMD loads never straddle cache lines and the kernels can rely
+// on the alignment of the first element. They come from the allocator of the
+// calling thread: the heap by default, or an Arena / PoolAllocator installed
+// with ScopedAllocator.
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MATHLIB_ASSUME_ALIGNED(ptr, alignment) static_cast<decltype(ptr)>(__builtin_assume_aligned(ptr, alignment))
+#else
+#define MATHLIB_ASSUME_ALIGNED(ptr, alignment) (ptr)
+#endif
+
+namespace Mathlib {
+
+    constexpr size_t CACHE_LINE = 64;
+    constexpr size_t PAGE_SIZE = 4096;
+
+    // Buffers of at least this many bytes start on a page boundary
+    constexpr size_t PAGE_ALIGN_THRESHOLD = size_t(1) << 20;
+
+    inline bool IsAligned(const void* ptr, size_t alignment) {
+        return reinterpret_cast<std::uintptr_t>(ptr) % alignment == 0;
+    }
+
+    inline void* AlignedAlloc(size_t bytes, size_t alignment) {
+        if (bytes == 0) return nullptr;
+#ifdef _WIN32
+        void* ptr = _aligned_malloc(bytes, alignment);
+#else
+        void* ptr = nullptr;
+        if (posix_memalign(&ptr, alignment, bytes) != 0)
+            ptr = nullptr;
+#endif
+        if (!ptr) throw std::runtime_error("Memory allocation failed");
+        return ptr;
+    }
+
+    inline void AlignedFree(void* ptr) {
+#ifdef _WIN32
+        _aligned_free(ptr);
+#else
+        std::free(ptr);
+#endif
+    }
+
+
+    // Source of the buffers of Vector and Matrix. Every owning object remembers the
+    // allocator it got its buffer from and returns it there, so objects created in a
+    // ScopedAllocator may outlive the scope (but not the allocator).
+    class Allocator {
+    public:
+        virtual ~Allocator() = default;
+        virtual void* Allocate(size_t bytes, size_t alignment) = 0;
+        virtual void Deallocate(void* ptr, size_t bytes) = 0;
+    };
+
+    class HeapAllocator : public Allocator {
+    public:
+        void* Allocate(size_t bytes, size_t alignment) override { return AlignedAlloc(bytes, alignment); }
+        void Deallocate(void* ptr, size_t) override { AlignedFree(ptr); }
+    };
+
+    inline Allocator& Heap() {
+        static HeapAllocator heap;
+        return heap;
+    }
+
+    // Hands out memory owned by someone else (e.g. a Python buffer) once, and
+    // calls Release() when it is returned. Further requests (a Resize beyond the
+    // adopted size) go to the heap. Created with new, it deletes itself once
+    // nothing allocated from it is live; the objects may be freed on any thread.
+    class AdoptingAllocator : public Allocator {
+        void* mem;
+        size_t size;
+        std::atomic<bool> adopted{ false };
+        std::atomic<size_t> live{ 0 };
+
+    protected:
+        // Called once, when the adopted memory comes back
+        virtual void Release() { }
+
+    public:
+        AdoptingAllocator(void* _mem, size_t _size) : mem(_mem), size(_size) { }
+
+        void* Allocate(size_t bytes, size_t alignment) override {
+            live.fetch_add(1, std::memory_order_relaxed);
+            if (bytes <= size && !adopted.exchange(true))
+                return mem;
+            return AlignedAlloc(bytes, alignment);
+        }
+
+        void Deallocate(void* ptr, size_t) override {
+            if (ptr == mem) Release();
+            else AlignedFree(ptr);
+            if (live.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                delete this;
+        }
+    };
+
+    namespace detail {
+        inline std::atomic<Allocator*>& DefaultAllocatorPtr() {
+            static std::atomic<Allocator*> alloc{ &Heap() };
+            return alloc;
+        }
+
+        inline Allocator*& ScopedAllocatorPtr() {
+            thread_local Allocator* alloc = nullptr;
+            return alloc;
+        }
+    }
+
+    // Process-wide allocator, used when no ScopedAllocator is active
+    inline void SetDefaultAllocator(Allocator& alloc) { detail::DefaultAllocatorPtr() = &alloc; }
+
+    // Allocator for new objects on the calling thread
+    inline Allocator& CurrentAllocator() {
+        Allocator* scoped = detail::ScopedAllocatorPtr();
+        return scoped ? *scoped : *detail::DefaultAllocatorPtr().load(std::memory_order_relaxed);
+    }
+
+    // Installs an allocator for the calling thread for the lifetime of this object:
+    //     Arena arena;
+    //     for (...) {
+    //         { ScopedAllocator use(arena);  ... temporaries ... }
+    //         arena.Reset();
+    //     }
+    class ScopedAllocator {
+        Allocator* prev;
+    public:
+        ScopedAllocator(Allocator& alloc) : prev(detail::ScopedAllocatorPtr()) { detail::ScopedAllocatorPtr() = &alloc; }
+        ~ScopedAllocator() { detail::ScopedAllocatorPtr() = prev; }
+        ScopedAllocator(const ScopedAllocator&) = delete;
+        ScopedAllocator& operator=(const ScopedAllocator&) = delete;
+    };
+
+
+    // Bump allocator. Deallocate is a no-op, Reset() releases everything at once
+    // and keeps the memory (merged into one chunk) for the next round, so repeated
+    // solver iterations neither call malloc nor fault in fresh pages.
+    class Arena : public Allocator {
+        struct Chunk { char* mem; size_t size; };
+        std::vector<Chunk> chunks;
+        size_t offset = 0;          // in chunks.back()
+        size_t live = 0;
+        size_t chunk_size;
+        std::mutex mutex;
+
+        void AddChunk(size_t bytes) {
+            chunks.push_back({ static_cast<char*>(AlignedAlloc(bytes, PAGE_SIZE)), bytes });
+            offset = 0;
+        }
+
+        void ReleaseChunks() {
+            for (auto& c : chunks)
+                AlignedFree(c.mem);
+            chunks.clear();
+            offset = 0;
+        }
+
+    public:
+        Arena(size_t _chunk_size = size_t(1) << 22) : chunk_size(std::max(_chunk_size, PAGE_SIZE)) { }
+        ~Arena() { ReleaseChunks(); }
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        void* Allocate(size_t bytes, size_t alignment) override {
+            if (bytes == 0) return nullptr;
+            std::lock_guard<std::mutex> lock(mutex);
+            size_t start = chunks.empty() ? 0 : (offset + alignment - 1) / alignment * alignment;
+            if (chunks.empty() || start + bytes > chunks.back().size) {
+                AddChunk(std::max(chunk_size, (bytes + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE));
+                start = 0;
+            }
+            offset = start + bytes;
+            ++live;
+            return chunks.back().mem + start;
+        }
+
+        void Deallocate(void* ptr, size_t) override {
+            if (!ptr) return;
+            std::lock_guard<std::mutex> lock(mutex);
+            --live;
+        }
+
+        // All buffers from this arena must be freed before
+        void Reset() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (live > 0) throw std::runtime_error("Arena reset with live allocations");
+            if (chunks.size() > 1) {
+                size_t total = 0;
+                for (auto& c : chunks)
+                    total += c.size;
+                ReleaseChunks();
+                AddChunk(total);
+            }
+            offset = 0;
+        }
+
+        size_t Capacity() const {
+            size_t total = 0;
+            for (auto& c : chunks)
+                total += c.size;
+            return total;
+        }
+
+        size_t LiveAllocations() const { return live; }
+    };
+
+
+    // Size-class pool: requests are rounded up to a power of two (at least one cache
+    // line) and freed blocks are kept in a free list per class, so objects with
+    // arbitrary lifetimes can be recycled in O(1). Blocks above max_block go
+    // straight to the heap.
+    class PoolAllocator : public Allocator {
+        static constexpr size_t NCLASSES = 64;
+        std::vector<void*> free_lists[NCLASSES];
+        size_t max_block;
+        size_t cached = 0;
+        std::mutex mutex;
+
+        static size_t SizeClass(size_t bytes) {
+            size_t c = 6;   // 64 bytes
+            while ((size_t(1) << c) < bytes) ++c;
+            return c;
+        }
+
+        // Every block of a class gets the same alignment, enough for any request in it
+        static size_t BlockAlignment(size_t block) { return block >= PAGE_SIZE ? PAGE_SIZE : CACHE_LINE; }
+
+    public:
+        PoolAllocator(size_t _max_block = size_t(1) << 26) : max_block(_max_block) { }
+        ~PoolAllocator() { Release(); }
+        PoolAllocator(const PoolAllocator&) = delete;
+        PoolAllocator& operator=(const PoolAllocator&) = delete;
+
+        void* Allocate(size_t bytes, size_t alignment) override {
+            if (bytes == 0) return nullptr;
+            if (bytes > max_block) return AlignedAlloc(bytes, alignment);
+
+            const size_t c = SizeClass(bytes);
+            const size_t block = size_t(1) << c;
+            if (alignment > BlockAlignment(block)) throw std::invalid_argument("Alignment not supported by pool");
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!free_lists[c].empty()) {
+                    void* ptr = free_lists[c].back();
+                    free_lists[c].pop_back();
+                    cached -= block;
+                    return ptr;
+                }
+            }
+            return AlignedAlloc(block, BlockAlignment(block));
+        }
+
+        void Deallocate(void* ptr, size_t bytes) override {
+            if (!ptr) return;
+            if (bytes > max_block) return AlignedFree(ptr);
+
+            const size_t c = SizeClass(bytes);
+            std::lock_guard<std::mutex> lock(mutex);
+            free_lists[c].push_back(ptr);
+            cached += size_t(1) << c;
+        }
+
+        // Returns all cached blocks to the heap
+        void Release() {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& list : free_lists) {
+                for (void* ptr : list)
+                    AlignedFree(ptr);
+                list.clear();
+            }
+            cached = 0;
+        }
+
+        size_t CachedBytes() const { return cached; }
+    };
+
+    // Per-thread pool for the scratch matrices of Invert, Det and LapackLU,
+    // which never leave the function that creates them
+    inline Allocator& WorkspaceAllocator() {
+        thread_local PoolAllocator pool;
+        return pool;
+    }
+
+
+    // Aligned array of n default-initialized T (like new T[n])
+    template <typename T>
+    T* AllocateBuffer(size_t n, Allocator& alloc = CurrentAllocator()) {
+        if (n > SIZE_MAX / sizeof(T)) throw std::runtime_error("Memory allocation failed");
+        const size_t bytes = n * sizeof(T);
+        T* ptr = static_cast<T*>(alloc.Allocate(bytes, bytes >= PAGE_ALIGN_THRESHOLD ? PAGE_SIZE : CACHE_LINE));
+
+        if constexpr (!std::is_trivially_default_constructible_v<T>)
+            for (size_t i = 0; i < n; ++i)
+                new (ptr + i) T;
+        return ptr;
+    }
+
+    template <typename T>
+    void FreeBuffer(T* ptr, size_t n, Allocator& alloc) {
+        if (!ptr) return;
+        if constexpr (!std::is_trivially_destructible_v<T>)
+            for (size_t i = 0; i < n; ++i)
+                ptr[i].~T();
+        alloc.Deallocate(ptr, n * sizeof(T));
+    }
+
+
+    // Leading dimension >= ld for padded matrices: a whole number of cache lines,
+    // and not a multiple of 1 KB, so that walking along the outer dimension does
+    // not map every element into the same few cache sets (n = 1024, 2048, ...).
+    template <typename T>
+    size_t PaddedDist(size_t ld) {
+        if (sizeof(T) > CACHE_LINE || CACHE_LINE % sizeof(T) != 0) return ld;
+        constexpr size_t per_line = CACHE_LINE / sizeof(T);
+        size_t dist = (ld + per_line - 1) / per_line * per_line;
+        if ((dist * sizeof(T)) % 1024 == 0)
+            dist += per_line;
+        return dist;
+    }
+}
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef FILE_MIXED_PRECISION
+#define FILE_MIXED_PRECISION
+
+#include <limits>
+#include <memory>
+#include <stdexcept>
+
+#include "matrix.hpp"
+#include "lapack_interface.hpp"
+
+namespace Mathlib {
+
+    struct RefinementResult {
+        size_t iterations = 0;   // refinement steps with the float factorization
+        bool fallback = false;   // true if refinement stagnated and the double LU was used
+        double residual = 0;     // max-norm of b - A x
+    };
+
+
+    // y = expr, returns max |y(i)|
+    template <typename E>
+    double AssignMaxNorm(VectorView<double> y, const VecExpr<E>& expr) {
+        double m = 0;
+        for (size_t i = 0; i < y.Size(); ++i) {
+            double val = expr(i);
+            y(i) = val;
+            m = std::max(m, std::abs(val));
+        }
+        return m;
+    }
+
+
+    // Solves A x = b to double accuracy using an LU factorization in single precision.
+    // Each refinement step computes the residual in double with the matrix-vector
+    // expression and solves for the correction with the float factors.
+    // If refinement does not converge (A too ill-conditioned for float), A is factored
+    // once more in double precision.
+    // A is referenced, not copied, and must stay alive and unchanged while solving.
+    template <ORDERING ORD = ColMajor>
+    class MixedPrecisionLU {
+        MatrixView<double, ORD> a;
+        LapackLU<ORD, float> luf;
+        std::unique_ptr<LapackLU<ORD, double>> lud;   // created on first fallback
+        double anorm = 0;
+        size_t maxit;
+
+        static Matrix<float, ORD> ToFloat(MatrixView<double, ORD> A) {
+            Matrix<float, ORD> af(A.Rows(), A.Cols());
+            for (size_t i = 0; i < A.Rows(); ++i)
+                for (size_t j = 0; j < A.Cols(); ++j)
+                    af(i, j) = static_cast<float>(A(i, j));
+            return af;
+        }
+
+        const LapackLU<ORD, double>& DoubleLU() {
+            if (!lud)
+                lud = std::make_unique<LapackLU<ORD, double>>(Matrix<double, ORD>(a));
+            return *lud;
+        }
+
+    public:
+        MixedPrecisionLU(MatrixView<double, ORD> A, size_t _maxit = 30)
+            : a(A), luf(ToFloat(A)), maxit(_maxit) {
+            if (A.Rows() != A.Cols()) throw std::invalid_argument("Matrix must be square");
+
+            // Infinity norm, used in the stopping criterion
+            for (size_t i = 0; i < A.Rows(); ++i) {
+                double rowsum = 0;
+                for (size_t j = 0; j < A.Cols(); ++j)
+                    rowsum += std::abs(A(i, j));
+                anorm = std::max(anorm, rowsum);
+            }
+        }
+
+        // b overwritten with A^{-1} b. Throws if A is singular (b is then unchanged).
+        RefinementResult Solve(VectorView<double> b) {
+            if (b.Size() != a.Rows()) throw std::invalid_argument("Matrix and vector sizes do not match");
+            const size_t n = b.Size();
+            const double eps = std::numeric_limits<double>::epsilon();
+            Vector<double> rhs(b), x(n), r(n);
+            Vector<float> d(n);
+            RefinementResult res;
+
+            auto maxnorm = [](const Vector<double>& v) {
+                double m = 0;
+                for (size_t i = 0; i < v.Size(); ++i)
+                    m = std::max(m, std::abs(v(i)));
+                return m;
+            };
+
+            bool converged = false;
+            if (luf.Info() == 0) {
+                x = 0.0;
+                r = rhs;
+                double prev = std::numeric_limits<double>::infinity();
+
+                for (size_t it = 1; it <= maxit; ++it) {
+                    res.iterations = it;
+
+                    // correction in single precision
+                    d = r;
+                    luf.Solve(d);
+                    x = x + d;
+
+                    // residual in double precision
+                    r = a * x;
+                    res.residual = AssignMaxNorm(r, rhs - r);
+
+                    // Same criterion as Lapack's dsgesv: ||r|| < ||x|| ||A|| eps sqrt(n)
+                    if (res.residual <= maxnorm(x) * anorm * eps * std::sqrt(double(n))) {
+                        converged = true;
+                        break;
+                    }
+
+                    // No progress, float is not accurate enough for this matrix
+                    if (!(res.residual < 0.5 * prev))
+                        break;
+                    prev = res.residual;
+                }
+            }
+
+            if (!converged) {
+                res.fallback = true;
+                if (DoubleLU().Info() > 0) throw std::runtime_error("Matrix is singular");
+                x = rhs;
+                DoubleLU().Solve(x);
+                r = a * x;
+                res.residual = AssignMaxNorm(r, rhs - r);
+            }
+
+            // element-wise, b = x would rebind the view
+            for (size_t i = 0; i < n; ++i)
+                b(i) = x(i);
+            return res;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,294 @@
+#ifndef FILE_NUMA
+#define FILE_NUMA
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "memory.hpp"
+
+// NUMA support without libnuma: the topology is read from /sys, threads are
+// pinned with sched_setaffinity and memory policies are set with the mbind
+// system call. On other systems everything degrades to a single node and
+// pinning is a no-op.
+//
+// Pinning is off by default. SetAffinity(AffinityMode::Compact) or
+// $NAMEPENDING_AFFINITY=compact|scatter turns it on. Each task of the parallel
+// kernels and the parallel constructors (see partition.hpp) then runs on a
+// fixed CPU. Task nr is always placed on the same CPU, so data first touched
+// by task nr of one call stays local to task nr of the next.
+
+namespace Mathlib {
+
+    struct NumaTopology {
+        std::vector<std::vector<int>> node_cpus;   // CPUs usable by this process, per node
+        std::vector<int> cpu_node;                 // node of each CPU id, -1 if not usable
+
+        size_t Nodes() const { return node_cpus.size(); }
+    };
+
+    // "0-3,8,10-11" -> {0,1,2,3,8,10,11}
+    inline std::vector<int> ParseCpuList(const std::string& list) {
+        std::vector<int> cpus;
+        std::stringstream ss(list);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            if (item.empty() || item == "\n") continue;
+            int first, last;
+            if (std::sscanf(item.c_str(), "%d-%d", &first, &last) == 2) {
+                for (int c = first; c <= last; ++c)
+                    cpus.push_back(c);
+            }
+            else if (std::sscanf(item.c_str(), "%d", &first) == 1)
+                cpus.push_back(first);
+        }
+        return cpus;
+    }
+
+    inline NumaTopology ReadNumaTopology() {
+        NumaTopology topo;
+        std::vector<int> allowed;
+
+#ifdef __linux__
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        if (sched_getaffinity(0, sizeof(mask), &mask) == 0)
+            for (int c = 0; c < CPU_SETSIZE; ++c)
+                if (CPU_ISSET(c, &mask))
+                    allowed.push_back(c);
+
+        for (int node = 0, missing = 0; node < 1024 && missing < 64; ++node) {
+            std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if (!in) {
+                ++missing;
+                continue;
+            }
+            std::string line;
+            std::getline(in, line);
+
+            std::vector<int> cpus;
+            for (int c : ParseCpuList(line))
+                if (std::find(allowed.begin(), allowed.end(), c) != allowed.end())
+                    cpus.push_back(c);
+            if (cpus.empty()) continue;
+
+            for (int c : cpus) {
+                if (size_t(c) >= topo.cpu_node.size())
+                    topo.cpu_node.resize(c+1, -1);
+                topo.cpu_node[c] = node;
+            }
+            topo.node_cpus.push_back(std::move(cpus));
+        }
+#endif
+
+        if (topo.node_cpus.empty()) {
+            // no /sys information, one node with all CPUs
+            if (allowed.empty())
+                for (unsigned c = 0; c < std::max(1u, std::thread::hardware_concurrency()); ++c)
+                    allowed.push_back(int(c));
+            topo.node_cpus.push_back(allowed);
+            topo.cpu_node.assign(allowed.back() + 1, -1);
+            for (int c : allowed)
+                topo.cpu_node[c] = 0;
+        }
+        return topo;
+    }
+
+    inline const NumaTopology& GetNumaTopology() {
+        static NumaTopology topo = ReadNumaTopology();
+        return topo;
+    }
+
+
+    // Compact: fill the CPUs of node 0 first, then node 1, ...
+    // Scatter: round-robin over the nodes, spreading tasks over all sockets
+    enum class AffinityMode { None, Compact, Scatter };
+
+    inline std::atomic<AffinityMode>& AffinitySetting() {
+        static std::atomic<AffinityMode> mode = [] {
+            const char* env = std::getenv("NAMEPENDING_AFFINITY");
+            if (env && std::strcmp(env, "compact") == 0) return AffinityMode::Compact;
+            if (env && std::strcmp(env, "scatter") == 0) return AffinityMode::Scatter;
+            return AffinityMode::None;
+        }();
+        return mode;
+    }
+
+    inline void SetAffinity(AffinityMode mode) { AffinitySetting() = mode; }
+    inline AffinityMode GetAffinity() { return AffinitySetting(); }
+
+    // CPU for task nr, -1 if pinning is off
+    inline int TaskCpu(size_t nr, AffinityMode mode = GetAffinity()) {
+        const auto& topo = GetNumaTopology();
+        if (mode == AffinityMode::Compact) {
+            size_t total = 0;
+            for (auto& cpus : topo.node_cpus)
+                total += cpus.size();
+            size_t k = nr % total;
+            for (auto& cpus : topo.node_cpus) {
+                if (k < cpus.size()) return cpus[k];
+                k -= cpus.size();
+            }
+        }
+        if (mode == AffinityMode::Scatter) {
+            const auto& cpus = topo.node_cpus[nr % topo.Nodes()];
+            return cpus[(nr / topo.Nodes()) % cpus.size()];
+        }
+        return -1;
+    }
+
+    // NUMA node of task nr, -1 if pinning is off
+    inline int TaskNode(size_t nr, AffinityMode mode = GetAffinity()) {
+        int cpu = TaskCpu(nr, mode);
+        return cpu < 0 ? -1 : GetNumaTopology().cpu_node[cpu];
+    }
+
+    // Pins the calling thread to a CPU for the lifetime of this object, then
+    // restores the previous mask. cpu < 0 does nothing.
+    class PinThread {
+#ifdef __linux__
+        cpu_set_t saved;
+#endif
+        bool active = false;
+
+    public:
+        PinThread(int cpu) {
+#ifdef __linux__
+            if (cpu < 0 || cpu >= CPU_SETSIZE) return;
+            if (sched_getaffinity(0, sizeof(saved), &saved) != 0) return;
+            cpu_set_t mask;
+            CPU_ZERO(&mask);
+            CPU_SET(cpu, &mask);
+            active = sched_setaffinity(0, sizeof(mask), &mask) == 0;
+#else
+            (void)cpu;
+#endif
+        }
+
+        ~PinThread() {
+#ifdef __linux__
+            if (active)
+                sched_setaffinity(0, sizeof(saved), &saved);
+#endif
+        }
+
+        PinThread(const PinThread&) = delete;
+        PinThread& operator=(const PinThread&) = delete;
+    };
+
+
+    // Memory policies, values of <linux/mempolicy.h>
+    enum class NumaPolicy { Default = 0, Preferred = 1, Bind = 2, Interleave = 3 };
+
+    // Applies a policy to the pages in [ptr, ptr+bytes), rounded inwards to whole pages.
+    // Bind/Preferred use 'node', Interleave spreads over all nodes. With move = true,
+    // pages already touched are migrated. Returns false if not supported.
+    inline bool NumaBind(void* ptr, size_t bytes, NumaPolicy policy, int node = 0, bool move = false) {
+#if defined(__linux__) && defined(SYS_mbind)
+        const auto& topo = GetNumaTopology();
+        auto begin = (reinterpret_cast<std::uintptr_t>(ptr) + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+        auto end = (reinterpret_cast<std::uintptr_t>(ptr) + bytes) / PAGE_SIZE * PAGE_SIZE;
+        if (end <= begin) return true;
+
+        constexpr size_t MAXNODE = 1024;
+        unsigned long nodemask[MAXNODE / (8 * sizeof(unsigned long))] = { };
+        auto set = [&](int n) { nodemask[n / (8 * sizeof(long))] |= 1ul << (n % (8 * sizeof(long))); };
+        if (policy == NumaPolicy::Interleave) {
+            for (size_t n = 0; n < topo.cpu_node.size(); ++n)
+                if (topo.cpu_node[n] >= 0)
+                    set(topo.cpu_node[n]);
+        }
+        else if (policy != NumaPolicy::Default)
+            set(node);
+
+        const unsigned long MPOL_MF_MOVE_ = 1 << 1;
+        long ret = syscall(SYS_mbind, begin, end - begin, int(policy),
+                           policy == NumaPolicy::Default ? nullptr : nodemask, MAXNODE + 1,
+                           move ? MPOL_MF_MOVE_ : 0);
+        return ret == 0;
+#else
+        (void)ptr; (void)bytes; (void)policy; (void)node; (void)move;
+        return false;
+#endif
+    }
+
+    // Node of the page containing ptr (touching it if necessary), -1 if unknown
+    inline int NumaNodeOf(const void* ptr) {
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+        int node = -1;
+        const unsigned long MPOL_F_NODE_ = 1, MPOL_F_ADDR_ = 2;
+        if (syscall(SYS_get_mempolicy, &node, nullptr, 0, ptr, MPOL_F_NODE_ | MPOL_F_ADDR_) == 0)
+            return node;
+#else
+        (void)ptr;
+#endif
+        return -1;
+    }
+
+
+    // Page-granular allocator placing memory by policy before it is touched, e.g.
+    // Interleave for operands read by all threads, Bind to keep a matrix on one node.
+    // Small requests should rather go to the heap, every buffer takes whole pages.
+    class NumaAllocator : public Allocator {
+        NumaPolicy policy;
+        int node;
+
+        static size_t RoundUp(size_t bytes) { return (bytes + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE; }
+
+    public:
+        NumaAllocator(NumaPolicy _policy = NumaPolicy::Interleave, int _node = 0) : policy(_policy), node(_node) { }
+
+        // Pages are aligned to PAGE_SIZE; a larger alignment (a power of two) maps
+        // that much more and unmaps the unaligned ends
+        void* Allocate(size_t bytes, size_t alignment) override {
+            if (bytes == 0) return nullptr;
+            if (alignment & (alignment - 1)) throw std::invalid_argument("Alignment must be a power of two");
+#ifdef __linux__
+            const size_t size = RoundUp(bytes);
+            const size_t extra = alignment > PAGE_SIZE ? alignment : 0;
+            void* raw = mmap(nullptr, size + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (raw == MAP_FAILED) throw std::runtime_error("Memory allocation failed");
+            auto addr = reinterpret_cast<std::uintptr_t>(raw);
+            auto aligned = addr;
+            if (extra) {
+                aligned = (addr + alignment - 1) / alignment * alignment;
+                if (aligned > addr)
+                    munmap(raw, aligned - addr);
+                munmap(reinterpret_cast<void*>(aligned + size), addr + extra - aligned);
+            }
+            void* ptr = reinterpret_cast<void*>(aligned);
+            NumaBind(ptr, size, policy, node);
+            return ptr;
+#else
+            return AlignedAlloc(bytes, std::max(alignment, PAGE_SIZE));
+#endif
+        }
+
+        void Deallocate(void* ptr, size_t bytes) override {
+            if (!ptr) return;
+#ifdef __linux__
+            munmap(ptr, RoundUp(bytes));
+#else
+            (void)bytes;
+            AlignedFree(ptr);
+#endif
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,427 @@
+#ifndef FILE_OUT_OF_CORE
+#define FILE_OUT_OF_CORE
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "matrix.hpp"
+#include "mapped.hpp"
+
+// Out-of-core C = A*B and LU for matrices that don't fit into memory.
+// The matrices live in files of the MappedMatrix<double, ColMajor> format
+// (see mapped.hpp) and are streamed tile by tile with pread/pwrite, using at
+// most a given memory budget. The next tiles are read by a background thread
+// while the current ones go through AddMatMat.
+
+namespace Mathlib {
+
+    struct OutOfCoreStats {
+        size_t bytes_read = 0;
+        size_t bytes_written = 0;
+        double io_time = 0;        // seconds spent in pread/pwrite
+        double wait_time = 0;      // seconds the compute thread waited for I/O
+        double compute_time = 0;
+        double total_time = 0;
+
+        // Fraction of the I/O time hidden behind computation
+        double OverlapEfficiency() const { return io_time > 0 ? std::max(0.0, 1.0 - wait_time / io_time) : 1.0; }
+    };
+
+
+    namespace detail {
+        using Clock = std::chrono::steady_clock;
+
+        inline double Since(Clock::time_point start) {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        // Result of a background transfer
+        struct IOResult {
+            size_t bytes = 0;
+            double seconds = 0;
+        };
+
+        // Waits for a transfer and books it
+        inline void Finish(std::future<IOResult>& f, OutOfCoreStats& stats, bool write) {
+            if (!f.valid()) return;
+            auto start = Clock::now();
+            IOResult r = f.get();
+            stats.wait_time += Since(start);
+            stats.io_time += r.seconds;
+            (write ? stats.bytes_written : stats.bytes_read) += r.bytes;
+        }
+    }
+
+
+    // Column-major double matrix in a file, accessed with explicit reads and writes
+    class DiskMatrix {
+        int fd = -1;
+        size_t rows = 0, cols = 0, dist = 0, offset = 0;
+
+#ifndef _WIN32
+        static void ReadAll(int fd, char* buf, size_t bytes, size_t pos) {
+            while (bytes > 0) {
+                ssize_t got = pread(fd, buf, bytes, off_t(pos));
+                if (got <= 0) throw std::runtime_error("Read from matrix file failed");
+                buf += got;
+                pos += got;
+                bytes -= got;
+            }
+        }
+
+        static void WriteAll(int fd, const char* buf, size_t bytes, size_t pos) {
+            while (bytes > 0) {
+                ssize_t put = pwrite(fd, buf, bytes, off_t(pos));
+                if (put <= 0) throw std::runtime_error("Write to matrix file failed");
+                buf += put;
+                pos += put;
+                bytes -= put;
+            }
+        }
+
+        DiskMatrix(int _fd, const MappedHeader& h)
+            : fd(_fd), rows(h.rows), cols(h.cols), dist(h.dist), offset(h.data_offset) { }
+#endif
+
+    public:
+#ifndef _WIN32
+        // New zero matrix, readable as MappedMatrix<double>
+        static DiskMatrix Create(const std::string& filename, size_t r, size_t c) {
+            detail::CreateMapped<double>(filename, ColMajor, 0, r, c, r, c);
+            return Open(filename);
+        }
+
+        static DiskMatrix Open(const std::string& filename, bool writable = true) {
+            int fd = ::open(filename.c_str(), writable ? O_RDWR : O_RDONLY);
+            if (fd < 0) throw std::runtime_error("Cannot open " + filename);
+            MappedHeader h;
+            struct stat st;
+            try {
+                if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(h))
+                    throw std::runtime_error("Not a mapped matrix file: " + filename);
+                ReadAll(fd, reinterpret_cast<char*>(&h), sizeof(h), 0);
+                if (std::memcmp(h.magic, MappedHeader::MAGIC, sizeof(h.magic)) != 0
+                    || h.dtype != uint32_t(DType::Float64) || h.ordering != ColMajor
+                    || (h.flags & MappedHeader::FLAG_VECTOR) || h.dist < h.rows
+                    || h.data_offset + h.dist * h.cols * sizeof(double) > size_t(st.st_size))
+                    throw std::runtime_error("Not a column-major double matrix file: " + filename);
+            }
+            catch (...) {
+                ::close(fd);
+                throw;
+            }
+            return DiskMatrix(fd, h);
+        }
+
+        ~DiskMatrix() {
+            if (fd >= 0) ::close(fd);
+        }
+#else
+        static DiskMatrix Create(const std::string&, size_t, size_t) { throw std::runtime_error("Out-of-core matrices are not supported on this platform"); }
+        static DiskMatrix Open(const std::string&, bool = true) { throw std::runtime_error("Out-of-core matrices are not supported on this platform"); }
+#endif
+
+        DiskMatrix(const DiskMatrix&) = delete;
+        DiskMatrix& operator=(const DiskMatrix&) = delete;
+        DiskMatrix(DiskMatrix&& other) : fd(other.fd), rows(other.rows), cols(other.cols), dist(other.dist), offset(other.offset) {
+            other.fd = -1;
+        }
+
+        size_t Rows() const { return rows; }
+        size_t Cols() const { return cols; }
+
+#ifndef _WIN32
+        // dst = this(i0 : i0+dst.Rows(), j0 : j0+dst.Cols()), returns the bytes read
+        size_t Read(size_t i0, size_t j0, MatrixView<double> dst) const {
+            if (i0 + dst.Rows() > rows || j0 + dst.Cols() > cols) throw std::out_of_range("Tile out of range");
+            const size_t h = dst.Rows();
+            if (i0 == 0 && h == dist && dst.Dist() == h)
+                ReadAll(fd, reinterpret_cast<char*>(dst.Data()), h * dst.Cols() * sizeof(double), offset + j0 * dist * sizeof(double));
+            else
+                for (size_t j = 0; j < dst.Cols(); ++j)
+                    ReadAll(fd, reinterpret_cast<char*>(&dst(0, j)), h * sizeof(double), offset + ((j0 + j) * dist + i0) * sizeof(double));
+            return h * dst.Cols() * sizeof(double);
+        }
+
+        // this(i0 : i0+src.Rows(), j0 : j0+src.Cols()) = src, returns the bytes written
+        size_t Write(size_t i0, size_t j0, MatrixView<double> src) const {
+            if (i0 + src.Rows() > rows || j0 + src.Cols() > cols) throw std::out_of_range("Tile out of range");
+            const size_t h = src.Rows();
+            if (i0 == 0 && h == dist && src.Dist() == h)
+                WriteAll(fd, reinterpret_cast<const char*>(src.Data()), h * src.Cols() * sizeof(double), offset + j0 * dist * sizeof(double));
+            else
+                for (size_t j = 0; j < src.Cols(); ++j)
+                    WriteAll(fd, reinterpret_cast<const char*>(&src(0, j)), h * sizeof(double), offset + ((j0 + j) * dist + i0) * sizeof(double));
+            return h * src.Cols() * sizeof(double);
+        }
+#else
+        size_t Read(size_t, size_t, MatrixView<double>) const { return 0; }
+        size_t Write(size_t, size_t, MatrixView<double>) const { return 0; }
+#endif
+
+        // Read/Write adding the time taken to seconds
+        size_t TimedRead(size_t i0, size_t j0, MatrixView<double> dst, double& seconds) const {
+            auto start = std::chrono::steady_clock::now();
+            size_t bytes = Read(i0, j0, dst);
+            seconds += detail::Since(start);
+            return bytes;
+        }
+
+        size_t TimedWrite(size_t i0, size_t j0, MatrixView<double> src, double& seconds) const {
+            auto start = std::chrono::steady_clock::now();
+            size_t bytes = Write(i0, j0, src);
+            seconds += detail::Since(start);
+            return bytes;
+        }
+    };
+
+
+    // C = A*B for matrices on disk using at most about budget_bytes of memory.
+    // C is computed tile by tile and written once. For consecutive C tiles the
+    // order of the inner dimension is reversed, so the A (or B) tile loaded
+    // last is used again instead of being read twice.
+    inline OutOfCoreStats OutOfCoreMultiply(const DiskMatrix& A, const DiskMatrix& B, const DiskMatrix& C, size_t budget_bytes) {
+        using namespace detail;
+        if (A.Cols() != B.Rows() || C.Rows() != A.Rows() || C.Cols() != B.Cols())
+            throw std::invalid_argument("Matrix dimensions do not match for multiplication");
+
+        OutOfCoreStats stats;
+        auto start = Clock::now();
+        const size_t m = C.Rows(), n = C.Cols(), k = A.Cols();
+
+        // two buffers each for tiles of A, B and C
+        size_t t = size_t(std::sqrt(double(budget_bytes) / (6 * sizeof(double))));
+        if (t < 1) throw std::invalid_argument("Memory budget too small");
+        t = std::min(t, std::max({ m, n, k }));
+        const size_t tm = std::min(t, m), tn = std::min(t, n), tk = std::min(t, k);
+        const size_t nti = (m + tm - 1) / tm, ntj = (n + tn - 1) / tn, ntp = (k + tk - 1) / tk;
+
+        struct Step { size_t i, j, p; bool first, last; };
+        std::vector<Step> steps;
+        bool forward = true;
+        for (size_t i = 0; i < nti; ++i)
+            for (size_t jj = 0; jj < ntj; ++jj) {
+                size_t j = (i % 2 == 0) ? jj : ntj - 1 - jj;   // snake over the C tiles
+                for (size_t pp = 0; pp < ntp; ++pp) {
+                    size_t p = forward ? pp : ntp - 1 - pp;
+                    steps.push_back({ i, j, p, pp == 0, pp == ntp - 1 });
+                }
+                forward = !forward;
+            }
+
+        Matrix<double> abuf[2] = { Matrix<double>(tm, tk), Matrix<double>(tm, tk) };
+        Matrix<double> bbuf[2] = { Matrix<double>(tk, tn), Matrix<double>(tk, tn) };
+        Matrix<double> cbuf[2] = { Matrix<double>(tm, tn), Matrix<double>(tm, tn) };
+
+        auto rows = [&](size_t ti, size_t ts, size_t total) { return std::min(ts, total - ti * ts); };
+        auto aview = [&](int b, const Step& s) { return MatrixView<double>(abuf[b]).RowRange(0, rows(s.i, tm, m)).ColRange(0, rows(s.p, tk, k)); };
+        auto bview = [&](int b, const Step& s) { return MatrixView<double>(bbuf[b]).RowRange(0, rows(s.p, tk, k)).ColRange(0, rows(s.j, tn, n)); };
+        auto cview = [&](int b, const Step& s) { return MatrixView<double>(cbuf[b]).RowRange(0, rows(s.i, tm, m)).ColRange(0, rows(s.j, tn, n)); };
+
+        // Reads the tiles of step s that are not in the current buffers
+        int acur = 1, bcur = 1;
+        auto load = [&](size_t s, bool newa, bool newb) {
+            const Step st = steps[s];
+            int ab = 1 - acur, bb = 1 - bcur;
+            return std::async(std::launch::async, [&, st, ab, bb, newa, newb] {
+                IOResult r;
+                if (newa) r.bytes += A.TimedRead(st.i * tm, st.p * tk, aview(ab, st), r.seconds);
+                if (newb) r.bytes += B.TimedRead(st.p * tk, st.j * tn, bview(bb, st), r.seconds);
+                return r;
+            });
+        };
+        auto needs = [&](size_t s) {
+            if (s == 0) return std::pair<bool, bool>(true, true);
+            const Step &a = steps[s-1], &b = steps[s];
+            return std::pair<bool, bool>(a.i != b.i || a.p != b.p, a.p != b.p || a.j != b.j);
+        };
+
+        std::future<IOResult> reading = load(0, true, true);
+        std::future<IOResult> writing[2];
+        int ccur = 1;
+
+        for (size_t s = 0; s < steps.size(); ++s) {
+            const Step& st = steps[s];
+            auto [newa, newb] = needs(s);
+            Finish(reading, stats, false);
+            if (newa) acur = 1 - acur;
+            if (newb) bcur = 1 - bcur;
+
+            if (s + 1 < steps.size()) {
+                auto [na, nb] = needs(s + 1);
+                reading = load(s + 1, na, nb);
+            }
+
+            if (st.first) {
+                ccur = 1 - ccur;
+                Finish(writing[ccur], stats, true);   // buffer still being written from two tiles ago
+                cview(ccur, st) = 0.0;
+            }
+
+            auto cstart = Clock::now();
+            AddMatMat(aview(acur, st), bview(bcur, st), cview(ccur, st));
+            stats.compute_time += Since(cstart);
+
+            if (st.last) {
+                const int cb = ccur;
+                writing[cb] = std::async(std::launch::async, [&, st, cb] {
+                    IOResult r;
+                    r.bytes = C.TimedWrite(st.i * tm, st.j * tn, cview(cb, st), r.seconds);
+                    return r;
+                });
+            }
+        }
+        Finish(writing[0], stats, true);
+        Finish(writing[1], stats, true);
+
+        stats.total_time = Since(start);
+        return stats;
+    }
+
+
+    // LU factorization with partial pivoting, P A = L U, of a square matrix on disk,
+    // overwritten by the factors as by Lapack's getrf. ipiv(i) is the row (0-based)
+    // interchanged with row i. Left-looking: each panel of columns is loaded once,
+    // updated with all panels to its left (streamed, the next one read ahead),
+    // factored in memory and written back. Panel widths follow from the budget.
+    inline OutOfCoreStats OutOfCoreLU(const DiskMatrix& A, std::vector<size_t>& ipiv, size_t budget_bytes) {
+        using namespace detail;
+        if (A.Rows() != A.Cols()) throw std::invalid_argument("Matrix must be square");
+
+        OutOfCoreStats stats;
+        auto start = Clock::now();
+        const size_t n = A.Rows();
+        ipiv.resize(n);
+
+        // current panel, two left panels and a small block
+        size_t w = budget_bytes / (4 * n * sizeof(double));
+        if (w < 1) throw std::invalid_argument("Memory budget too small");
+        w = std::min(w, n);
+        const size_t npanels = (n + w - 1) / w;
+        auto first = [&](size_t p) { return p * w; };
+        auto next = [&](size_t p) { return std::min(n, (p+1) * w); };
+
+        Matrix<double> panel(n, w), left[2] = { Matrix<double>(n, w), Matrix<double>(n, w) }, uneg(w, w);
+
+        auto swap_rows = [](MatrixView<double> M, size_t r1, size_t r2) {
+            if (r1 == r2) return;
+            for (size_t j = 0; j < M.Cols(); ++j)
+                std::swap(M(r1, j), M(r2, j));
+        };
+
+        // rows [k0, n) of the columns of panel k
+        auto read_left = [&](size_t kp, int b) {
+            const size_t k0 = first(kp), k1 = next(kp);
+            return std::async(std::launch::async, [&, k0, k1, b] {
+                IOResult r;
+                r.bytes = A.TimedRead(k0, k0, MatrixView<double>(left[b]).RowRange(0, n - k0).ColRange(0, k1 - k0), r.seconds);
+                return r;
+            });
+        };
+
+        for (size_t jp = 0; jp < npanels; ++jp) {
+            const size_t j0 = first(jp), j1 = next(jp), wj = j1 - j0;
+            MatrixView<double> P = MatrixView<double>(panel).ColRange(0, wj);
+
+            std::future<IOResult> reading;
+            if (jp > 0) reading = read_left(0, 0);
+
+            auto io = Clock::now();
+            double secs = 0;
+            stats.bytes_read += A.TimedRead(0, j0, P, secs);
+            stats.io_time += secs;
+            stats.wait_time += Since(io);
+
+            // interchanges of the panels to the left
+            for (size_t r = 0; r < j0; ++r)
+                swap_rows(P, r, ipiv[r]);
+
+            auto cstart = Clock::now();
+            for (size_t kp = 0; kp < jp; ++kp) {
+                const size_t k0 = first(kp), k1 = next(kp), wk = k1 - k0;
+                stats.compute_time += Since(cstart);
+                Finish(reading, stats, false);
+                if (kp + 1 < jp) reading = read_left(kp + 1, int((kp + 1) % 2));
+                cstart = Clock::now();
+
+                MatrixView<double> L = MatrixView<double>(left[kp % 2]).RowRange(0, n - k0).ColRange(0, wk);
+                for (size_t r = k1; r < j0; ++r)    // interchanges from later panels
+                    swap_rows(L, r - k0, ipiv[r] - k0);
+
+                // P(k0:k1, :) = L_kk^{-1} P(k0:k1, :), unit lower triangular
+                for (size_t c = 0; c < wk; ++c)
+                    for (size_t r = c + 1; r < wk; ++r) {
+                        double l = L(r, c);
+                        if (l != 0.0)
+                            for (size_t j = 0; j < wj; ++j)
+                                P(k0 + r, j) -= l * P(k0 + c, j);
+                    }
+
+                // P(k1:n, :) -= L(k1:n, :) * P(k0:k1, :)
+                if (k1 < n) {
+                    MatrixView<double> U = MatrixView<double>(uneg).RowRange(0, wk).ColRange(0, wj);
+                    U = -P.RowRange(k0, k1);
+                    AddMatMat(L.RowRange(wk, n - k0), U, P.RowRange(k1, n));
+                }
+            }
+
+            // factor rows j0..n of the panel
+            for (size_t c = 0; c < wj; ++c) {
+                const size_t col = j0 + c;
+                size_t piv = col;
+                for (size_t r = col + 1; r < n; ++r)
+                    if (std::abs(P(r, c)) > std::abs(P(piv, c)))
+                        piv = r;
+                ipiv[col] = piv;
+                if (P(piv, c) == 0.0) throw std::runtime_error("Matrix is singular");
+                swap_rows(P, col, piv);
+
+                const double inv = 1.0 / P(col, c);
+                for (size_t r = col + 1; r < n; ++r)
+                    P(r, c) *= inv;
+                for (size_t j = c + 1; j < wj; ++j) {
+                    const double u = P(col, j);
+                    if (u != 0.0)
+                        for (size_t r = col + 1; r < n; ++r)
+                            P(r, j) -= P(r, c) * u;
+                }
+            }
+            stats.compute_time += Since(cstart);
+
+            io = Clock::now();
+            secs = 0;
+            stats.bytes_written += A.TimedWrite(0, j0, P, secs);
+            stats.io_time += secs;
+            stats.wait_time += Since(io);
+        }
+
+        // interchanges of later panels applied to the L part of earlier ones
+        for (size_t kp = 0; kp + 1 < npanels; ++kp) {
+            const size_t k0 = first(kp), k1 = next(kp);
+            MatrixView<double> L = MatrixView<double>(left[0]).RowRange(0, n - k1).ColRange(0, k1 - k0);
+            auto io = Clock::now();
+            double secs = 0;
+            stats.bytes_read += A.TimedRead(k1, k0, L, secs);
+            for (size_t r = k1; r < n; ++r)
+                swap_rows(L, r - k1, ipiv[r] - k1);
+            stats.bytes_written += A.TimedWrite(k1, k0, L, secs);
+            stats.io_time += secs;
+            stats.wait_time += Since(io);
+        }
+
+        stats.total_time = Since(start);
+        return stats;
+    }
+}
+
+#endif
@@ -0,0 +1,210 @@
+#ifndef FILE_PARTITION
+#define FILE_PARTITION
+
+#include <algorithm>
+#include <mutex>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "../NamePending-HPC/src/taskmanager.hpp"
+#include "numa.hpp"
+
+// Static work split shared by the parallel kernels and the parallel constructors.
+// Pages are placed on the NUMA node of the thread touching them first, so filling
+// a container with the same partition a kernel uses later keeps each thread's
+// data local to its socket. Matrices are split along the outer dimension
+// (columns of a column-major matrix), so that every task owns whole pages.
+// With thread pinning enabled (see numa.hpp) task nr always runs on the same CPU.
+//
+// ParallelFor starts from the same split, but a task that runs out of work
+// steals half of the remaining range of another one. So the kernels stay local
+// while the load is even, and slow cores, shared nodes or uneven work per index
+// only move the tails. Containers are still filled with ParallelRanges, which
+// keeps first touch deterministic.
+//
+// The task manager is one process-wide pool, started and stopped by every
+// parallel region. Only one thread may drive it at a time: a region opened
+// while another thread holds the pool (an asynchronous product, a Python
+// thread running without the GIL, a task of an outer region) runs its ranges
+// one after the other on the calling thread instead.
+
+namespace Mathlib {
+
+    // Tag for parallel evaluation: A*B | Parallel, Vector(n, Parallel, 0.0), ...
+    class T_Parallel { };
+    static constexpr T_Parallel Parallel;
+
+    // Default number of tasks of the parallel kernels
+    constexpr size_t DEFAULT_NTASKS = 8;
+
+    // Fills of fewer elements run on the calling thread
+    constexpr size_t PARALLEL_INIT_MIN = size_t(1) << 16;
+
+    inline size_t InitTasks(size_t elements) {
+        return elements < PARALLEL_INIT_MIN ? 1 : DEFAULT_NTASKS;
+    }
+
+    // Range [first, next) of task nr out of 'size', ceil(n/size) items per task,
+    // rounded up to a multiple of granularity
+    inline std::pair<size_t, size_t> StaticPartition(size_t n, size_t nr, size_t size, size_t granularity = 1) {
+        size_t chunk = (n + size - 1) / size;
+        chunk = (chunk + granularity - 1) / granularity * granularity;
+        const size_t first = std::min(n, nr * chunk);
+        return { first, std::min(n, first + chunk) };
+    }
+
+    namespace detail {
+        inline std::mutex& WorkerPoolMutex() {
+            static std::mutex mutex;
+            return mutex;
+        }
+    }
+
+    // Exclusive use of the task manager's workers, if they are free. Never
+    // blocks, so a task of a running region cannot wait for its own pool.
+    class WorkerPoolLease {
+        bool owns = false;
+
+        static bool& HeldHere() {
+            thread_local bool held = false;
+            return held;
+        }
+
+    public:
+        WorkerPoolLease() {
+            if (!HeldHere() && detail::WorkerPoolMutex().try_lock())
+                owns = HeldHere() = true;
+        }
+
+        ~WorkerPoolLease() {
+            if (!owns) return;
+            HeldHere() = false;
+            detail::WorkerPoolMutex().unlock();
+        }
+
+        WorkerPoolLease(const WorkerPoolLease&) = delete;
+        WorkerPoolLease& operator=(const WorkerPoolLease&) = delete;
+
+        explicit operator bool() const { return owns; }
+    };
+
+    // Calls func(first, next) for the non-empty ranges of StaticPartition(n, ., ntasks)
+    template <typename FUNC>
+    void ParallelRanges(size_t n, size_t ntasks, FUNC func, size_t granularity = 1) {
+        if (ntasks <= 1) {
+            if (n > 0) func(size_t(0), n);
+            return;
+        }
+        WorkerPoolLease pool;
+        if (!pool) {
+            for (size_t nr = 0; nr < ntasks; ++nr) {
+                auto [first, next] = StaticPartition(n, nr, ntasks, granularity);
+                if (first < next) func(first, next);
+            }
+            return;
+        }
+        ASC_HPC::StartWorkers(ntasks-1);
+        ASC_HPC::RunParallel(ntasks, [&](int nr, int size) {
+            auto [first, next] = StaticPartition(n, nr, size, granularity);
+            if (first < next) {
+                PinThread pin(TaskCpu(nr));
+                func(first, next);
+            }
+        });
+        ASC_HPC::StopWorkers();
+    }
+
+
+    namespace detail {
+        // Remaining range of a task: the owner takes chunks from the front, thieves the back half
+        struct alignas(64) StealRange {
+            std::mutex mutex;
+            size_t first = 0, next = 0;
+        };
+
+        // Set on the tasks of a ParallelFor, nested loops then run on their task
+        inline bool& InsideParallelFor() {
+            thread_local bool inside = false;
+            return inside;
+        }
+
+        inline size_t RoundUp(size_t x, size_t granularity) {
+            return (x + granularity - 1) / granularity * granularity;
+        }
+
+        // ParallelFor with the initial ranges part(nr, ntasks), which must start at
+        // multiples of granularity. Chunks shrink with the remaining work (a quarter
+        // of it, at least granularity), stolen ranges are split on granularity too.
+        template <typename PART, typename FUNC>
+        void StealingLoop(size_t ntasks, PART part, FUNC func, size_t granularity) {
+            std::vector<StealRange> ranges(ntasks);
+            for (size_t nr = 0; nr < ntasks; ++nr)
+                std::tie(ranges[nr].first, ranges[nr].next) = part(nr, ntasks);
+
+            auto take = [&](StealRange& r) {
+                std::lock_guard<std::mutex> guard(r.mutex);
+                const size_t first = r.first;
+                r.first = std::min(r.next, RoundUp(first + std::max<size_t>((r.next - first) / 4, 1), granularity));
+                return std::pair<size_t, size_t>(first, r.first);
+            };
+            auto steal = [&](StealRange& r) {
+                std::lock_guard<std::mutex> guard(r.mutex);
+                size_t split = RoundUp(r.first + (r.next - r.first) / 2, granularity);
+                if (split >= r.next) split = r.first;
+                const size_t next = r.next;
+                r.next = split;
+                return std::pair<size_t, size_t>(split, next);
+            };
+
+            WorkerPoolLease pool;
+            if (!pool) {
+                for (auto& r : ranges)
+                    if (r.first < r.next) func(r.first, r.next);
+                return;
+            }
+            ASC_HPC::StartWorkers(ntasks-1);
+            ASC_HPC::RunParallel(ntasks, [&](int nr, int size) {
+                PinThread pin(TaskCpu(nr));
+                InsideParallelFor() = true;
+                StealRange& own = ranges[nr];
+                while (true) {
+                    auto [first, next] = take(own);
+                    if (first < next) {
+                        func(first, next);
+                        continue;
+                    }
+                    bool stolen = false;
+                    for (int k = 1; k < size && !stolen; ++k) {
+                        auto [sfirst, snext] = steal(ranges[(nr + k) % size]);
+                        if (sfirst < snext) {
+                            std::lock_guard<std::mutex> guard(own.mutex);
+                            own.first = sfirst;
+                            own.next = snext;
+                            stolen = true;
+                        }
+                    }
+                    if (!stolen) break;
+                }
+                InsideParallelFor() = false;
+            });
+            ASC_HPC::StopWorkers();
+        }
+    }
+
+    // Calls func(first, next) on disjoint ranges covering [0, n), with work stealing
+    // between ntasks tasks. Range boundaries are multiples of granularity (or n).
+    // Inside another ParallelFor the whole range runs on the calling task.
+    template <typename FUNC>
+    void ParallelFor(size_t n, size_t ntasks, FUNC func, size_t granularity = 1) {
+        if (ntasks <= 1 || n <= granularity || detail::InsideParallelFor()) {
+            if (n > 0) func(size_t(0), n);
+            return;
+        }
+        detail::StealingLoop(ntasks, [&](size_t nr, size_t size) {
+            return StaticPartition(n, nr, size, granularity);
+        }, func, granularity);
+    }
+}
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef FILE_PROFILE
+#define FILE_PROFILE
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Kernel instrumentation, compiled in with -DMATHLIB_PROFILE (cmake -DMATHLIB_PROFILE=ON).
+// A kernel opens a scope per call,
+//     MATHLIB_PROFILE_SCOPE("AddMatMat", 2.0*m*n*k, 8.0*(m*k + k*n + 2*m*n));
+// which counts the call, its flops and bytes and the time until the end of the
+// scope. Without MATHLIB_PROFILE the macro expands to nothing and its arguments
+// are not evaluated.
+//
+// Each thread counts into its own block, written only by that thread, so the
+// scopes take no locks and share no cache lines. When a thread ends, its block
+// is added to the totals of the ended threads and dropped. ProfileReport() sums
+// these totals and the blocks of the running threads.
+
+namespace Mathlib {
+
+    struct KernelProfile {
+        std::string name;
+        uint64_t calls = 0;
+        double flops = 0;
+        double bytes = 0;
+        double seconds = 0;
+    };
+
+#ifdef MATHLIB_PROFILE
+    constexpr bool PROFILING = true;
+
+    // Kernels beyond this number are not counted
+    constexpr size_t PROFILE_MAX_KERNELS = 64;
+
+    namespace detail {
+        // Written by the owning thread only, atomic so that reports may read while it counts
+        struct KernelCounter {
+            std::atomic<uint64_t> calls{ 0 }, nanoseconds{ 0 };
+            std::atomic<double> flops{ 0 }, bytes{ 0 };
+        };
+
+        struct ThreadCounters {
+            KernelCounter kernels[PROFILE_MAX_KERNELS];
+        };
+
+        class ProfileRegistry {
+            std::mutex mutex;
+            std::vector<std::string> names;
+            std::vector<ThreadCounters*> threads;
+            ThreadCounters retired;     // sums of the ended threads
+
+            // only under the mutex
+            template <typename T>
+            static void Add(std::atomic<T>& a, const std::atomic<T>& b) {
+                a.store(a.load(std::memory_order_relaxed) + b.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+
+            static void Clear(ThreadCounters& t) {
+                for (auto& c : t.kernels) {
+                    c.calls.store(0, std::memory_order_relaxed);
+                    c.nanoseconds.store(0, std::memory_order_relaxed);
+                    c.flops.store(0, std::memory_order_relaxed);
+                    c.bytes.store(0, std::memory_order_relaxed);
+                }
+            }
+
+        public:
+            size_t Kernel(const char* name) {
+                std::lock_guard<std::mutex> guard(mutex);
+                for (size_t i = 0; i < names.size(); ++i)
+                    if (names[i] == name) return i;
+                names.push_back(name);
+                return names.size() - 1;
+            }
+
+            void AddThread(ThreadCounters* counters) {
+                std::lock_guard<std::mutex> guard(mutex);
+                threads.push_back(counters);
+            }
+
+            // Called by the ending thread, which does not count any more
+            void RetireThread(ThreadCounters* counters) {
+                std::lock_guard<std::mutex> guard(mutex);
+                for (size_t i = 0; i < PROFILE_MAX_KERNELS; ++i) {
+                    const KernelCounter& c = counters->kernels[i];
+                    KernelCounter& r = retired.kernels[i];
+                    Add(r.calls, c.calls);
+                    Add(r.nanoseconds, c.nanoseconds);
+                    Add(r.flops, c.flops);
+                    Add(r.bytes, c.bytes);
+                }
+                threads.erase(std::remove(threads.begin(), threads.end(), counters), threads.end());
+            }
+
+            std::vector<KernelProfile> Report() {
+                std::lock_guard<std::mutex> guard(mutex);
+                std::vector<KernelProfile> res(std::min(names.size(), PROFILE_MAX_KERNELS));
+                for (size_t i = 0; i < res.size(); ++i) {
+                    res[i].name = names[i];
+                    auto add = [&](const KernelCounter& c) {
+                        res[i].calls += c.calls.load(std::memory_order_relaxed);
+                        res[i].flops += c.flops.load(std::memory_order_relaxed);
+                        res[i].bytes += c.bytes.load(std::memory_order_relaxed);
+                        res[i].seconds += 1e-9 * double(c.nanoseconds.load(std::memory_order_relaxed));
+                    };
+                    add(retired.kernels[i]);
+                    for (auto t : threads) add(t->kernels[i]);
+                }
+                return res;
+            }
+
+            // Not exact while kernels are running
+            void Reset() {
+                std::lock_guard<std::mutex> guard(mutex);
+                Clear(retired);
+                for (auto t : threads) Clear(*t);
+            }
+        };
+
+        inline ProfileRegistry& GetProfileRegistry() {
+            static ProfileRegistry registry;
+            return registry;
+        }
+
+        // The block of one thread, registered while the thread runs
+        class ThreadBlock {
+            ThreadCounters counters;
+
+        public:
+            ThreadBlock() { GetProfileRegistry().AddThread(&counters); }
+            ~ThreadBlock() { GetProfileRegistry().RetireThread(&counters); }
+            ThreadBlock(const ThreadBlock&) = delete;
+            ThreadBlock& operator=(const ThreadBlock&) = delete;
+
+            ThreadCounters& Counters() { return counters; }
+        };
+
+        inline ThreadCounters& MyCounters() {
+            thread_local ThreadBlock block;
+            return block.Counters();
+        }
+
+        // Single writer: load and store instead of a locked read-modify-write
+        template <typename T>
+        void Bump(std::atomic<T>& a, T x) {
+            a.store(a.load(std::memory_order_relaxed) + x, std::memory_order_relaxed);
+        }
+
+        class ProfileScope {
+            KernelCounter* counter = nullptr;
+            std::chrono::steady_clock::time_point start;
+
+        public:
+            ProfileScope(size_t kernel, double flops, double bytes) {
+                if (kernel >= PROFILE_MAX_KERNELS) return;
+                counter = &MyCounters().kernels[kernel];
+                Bump(counter->calls, uint64_t(1));
+                Bump(counter->flops, flops);
+                Bump(counter->bytes, bytes);
+                start = std::chrono::steady_clock::now();
+            }
+
+            ~ProfileScope() {
+                if (!counter) return;
+                auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+                Bump(counter->nanoseconds, uint64_t(ns.count()));
+            }
+
+            ProfileScope(const ProfileScope&) = delete;
+            ProfileScope& operator=(const ProfileScope&) = delete;
+        };
+    }
+
+    // Counters of all kernels called so far, summed over the threads
+    inline std::vector<KernelProfile> ProfileReport() { return detail::GetProfileRegistry().Report(); }
+
+    inline void ResetProfile() { detail::GetProfileRegistry().Reset(); }
+
+#define MATHLIB_PROFILE_CONCAT2(a, b) a##b
+#define MATHLIB_PROFILE_CONCAT(a, b) MATHLIB_PROFILE_CONCAT2(a, b)
+#define MATHLIB_PROFILE_SCOPE(name, flops, bytes)                                                       \
+    static const size_t MATHLIB_PROFILE_CONCAT(mathlib_kernel_, __LINE__) =                             \
+        ::Mathlib::detail::GetProfileRegistry().Kernel(name);                                           \
+    ::Mathlib::detail::ProfileScope MATHLIB_PROFILE_CONCAT(mathlib_scope_, __LINE__)(                    \
+        MATHLIB_PROFILE_CONCAT(mathlib_kernel_, __LINE__), double(flops), double(bytes))
+
+#else
+    constexpr bool PROFILING = false;
+
+    inline std::vector<KernelProfile> ProfileReport() { return { }; }
+
+    inline void ResetProfile() { }
+
+#define MATHLIB_PROFILE_SCOPE(name, flops, bytes) ((void)0)
+
+#endif
+}
+
+#endif
@@ -0,0 +1,406 @@
+#ifndef FILE_SERIALIZE
+#define FILE_SERIALIZE
+
+#include <array>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "mapped.hpp"
+
+// Saving and loading matrices and vectors.
+//
+// The native format is the one of MappedMatrix (see mapped.hpp): a header with
+// element type, ordering, shape and leading dimension, the data at a page-aligned
+// offset, and optionally (FLAG_CHECKSUMS) a table of CRC-32 checksums over chunks
+// of the data behind it. MatrixWriter writes such files sequentially, Save() is the
+// one-call version. Load() copies into a Matrix and checks the checksums,
+// MappedMatrix::Open() returns a view of the file without reading it.
+//
+// SaveNpy() writes the NumPy .npy format with the data page-aligned, so
+// np.load(filename, mmap_mode='r') maps it, and OpenNpy() maps it from C++.
+
+namespace Mathlib {
+
+    struct SaveOptions {
+        bool checksums = true;
+        size_t chunk_bytes = size_t(1) << 20;   // data bytes per checksum
+    };
+
+    // Follows the checksum table: "NPCHKSUM", chunk size, number of chunks, then one uint32 per chunk
+    struct ChecksumHeader {
+        static constexpr char MAGIC[8] = { 'N', 'P', 'C', 'H', 'K', 'S', 'U', 'M' };
+        char magic[8];
+        uint64_t chunk_bytes;
+        uint64_t chunks;
+    };
+
+    // CRC-32 (as zlib), crc of the preceding bytes for continuation
+    inline uint32_t Crc32(const void* data, size_t bytes, uint32_t crc = 0) {
+        static const std::array<uint32_t, 256> table = [] {
+            std::array<uint32_t, 256> t;
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                t[i] = c;
+            }
+            return t;
+        }();
+        auto p = static_cast<const unsigned char*>(data);
+        crc = ~crc;
+        for (size_t i = 0; i < bytes; ++i)
+            crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+
+
+    namespace detail {
+        // Sequential writer of a native file: header, data in storage order, checksums
+        template <typename T>
+        class StreamWriter {
+            std::FILE* file = nullptr;
+            std::string filename;
+            SaveOptions options;
+            size_t total, written = 0;      // in elements
+            size_t in_chunk = 0;            // bytes of the current chunk
+            uint32_t crc = 0;
+            std::vector<uint32_t> crcs;
+
+        public:
+            StreamWriter(const std::string& _filename, uint32_t ordering, uint32_t flags,
+                         size_t rows, size_t cols, size_t inner, size_t outer, SaveOptions _options)
+                : filename(_filename), options(_options), total(inner * outer) {
+                if (options.checksums && options.chunk_bytes == 0)
+                    throw std::invalid_argument("Checksum chunk size must be positive");
+                file = std::fopen(filename.c_str(), "wb");
+                if (!file) throw std::runtime_error("Cannot create " + filename);
+
+                MappedHeader h{};
+                std::memcpy(h.magic, MappedHeader::MAGIC, sizeof(h.magic));
+                h.version = MappedHeader::VERSION;
+                h.dtype = uint32_t(DTypeOf<T>());
+                h.ordering = ordering;
+                h.flags = flags | (options.checksums ? MappedHeader::FLAG_CHECKSUMS : 0);
+                h.rows = rows;
+                h.cols = cols;
+                h.dist = inner;
+                h.data_offset = MappedDataOffset();
+                std::vector<char> head(h.data_offset, 0);
+                std::memcpy(head.data(), &h, sizeof(h));
+                Put(head.data(), head.size());
+            }
+
+            StreamWriter(const StreamWriter&) = delete;
+            StreamWriter& operator=(const StreamWriter&) = delete;
+
+            ~StreamWriter() {
+                if (file) std::fclose(file);   // unfinished, the file stays incomplete
+            }
+
+            void Put(const void* data, size_t bytes) {
+                if (std::fwrite(data, 1, bytes, file) != bytes)
+                    throw std::runtime_error("Write to " + filename + " failed");
+            }
+
+            size_t Remaining() const { return total - written; }
+
+            // Next n elements of the data
+            void Write(const T* data, size_t n) {
+                if (n > Remaining()) throw std::out_of_range("More data than the declared size");
+                Put(data, n * sizeof(T));
+                written += n;
+                if (!options.checksums) return;
+
+                auto p = reinterpret_cast<const char*>(data);
+                size_t bytes = n * sizeof(T);
+                while (bytes > 0) {
+                    size_t part = std::min(bytes, options.chunk_bytes - in_chunk);
+                    crc = Crc32(p, part, crc);
+                    p += part;
+                    bytes -= part;
+                    in_chunk += part;
+                    if (in_chunk == options.chunk_bytes) {
+                        crcs.push_back(crc);
+                        crc = 0;
+                        in_chunk = 0;
+                    }
+                }
+            }
+
+            void Close() {
+                if (!file) return;
+                if (written != total) throw std::runtime_error("Incomplete data for " + filename);
+                if (options.checksums) {
+                    if (in_chunk > 0) crcs.push_back(crc);
+                    ChecksumHeader c{};
+                    std::memcpy(c.magic, ChecksumHeader::MAGIC, sizeof(c.magic));
+                    c.chunk_bytes = options.chunk_bytes;
+                    c.chunks = crcs.size();
+                    Put(&c, sizeof(c));
+                    Put(crcs.data(), crcs.size() * sizeof(uint32_t));
+                }
+                int err = std::fclose(file);
+                file = nullptr;
+                if (err != 0) throw std::runtime_error("Write to " + filename + " failed");
+            }
+        };
+    }
+
+
+    // Writes a matrix part by part: Append() takes the next columns (ColMajor)
+    // or rows (RowMajor), Close() finishes the file
+    template <typename T, ORDERING ORD = ColMajor>
+    class MatrixWriter {
+        detail::StreamWriter<T> writer;
+        size_t inner;
+
+    public:
+        MatrixWriter(const std::string& filename, size_t rows, size_t cols, SaveOptions options = {})
+            : writer(filename, ORD, 0, rows, cols, ORD == ColMajor ? rows : cols,
+                     ORD == ColMajor ? cols : rows, options),
+              inner(ORD == ColMajor ? rows : cols) { }
+
+        void Append(const MatrixView<T, ORD>& block) {
+            const size_t binner = (ORD == ColMajor) ? block.Rows() : block.Cols();
+            const size_t bouter = (ORD == ColMajor) ? block.Cols() : block.Rows();
+            if (binner != inner)
+                throw std::invalid_argument(ORD == ColMajor ? "Block must have all rows" : "Block must have all columns");
+            if (binner * bouter > writer.Remaining())
+                throw std::out_of_range("More data than the declared size");
+            for (size_t k = 0; k < bouter; ++k)
+                writer.Write(block.Data() + k * block.Dist(), inner);
+        }
+
+        void Close() { writer.Close(); }
+    };
+
+
+    template <typename T, ORDERING ORD>
+    void Save(const std::string& filename, const MatrixView<T, ORD>& A, SaveOptions options = {}) {
+        MatrixWriter<T, ORD> writer(filename, A.Rows(), A.Cols(), options);
+        writer.Append(A);
+        writer.Close();
+    }
+
+    template <typename T, typename TDIST>
+    void Save(const std::string& filename, const VectorView<T, TDIST>& v, SaveOptions options = {}) {
+        detail::StreamWriter<T> writer(filename, ColMajor, MappedHeader::FLAG_VECTOR, v.Size(), 1, v.Size(), 1, options);
+        if (v.Dist() == 1)
+            writer.Write(v.Data(), v.Size());
+        else
+            for (size_t i = 0; i < v.Size(); ++i)
+                writer.Write(&v(i), 1);
+        writer.Close();
+    }
+
+
+    // Checks the chunk checksums of a mapped native file; true also without checksums
+    inline bool VerifyChecksums(const MappedFile& file, size_t elem_size) {
+        const MappedHeader& h = file.Header();
+        if (!(h.flags & MappedHeader::FLAG_CHECKSUMS)) return true;
+
+        const uint64_t outer = (h.flags & MappedHeader::FLAG_VECTOR) ? 1 : (h.ordering == ColMajor ? h.cols : h.rows);
+        const size_t bytes = h.dist * outer * elem_size;
+        const size_t table = h.data_offset + bytes;
+        if (table + sizeof(ChecksumHeader) > file.Size()) return false;
+        ChecksumHeader c;
+        std::memcpy(&c, file.Data() + table, sizeof(c));
+        if (std::memcmp(c.magic, ChecksumHeader::MAGIC, sizeof(c.magic)) != 0 || c.chunk_bytes == 0
+            || c.chunks != (bytes + c.chunk_bytes - 1) / c.chunk_bytes
+            || table + sizeof(c) + c.chunks * sizeof(uint32_t) > file.Size())
+            return false;
+
+        const char* data = file.Data() + h.data_offset;
+        const char* crcs = file.Data() + table + sizeof(c);
+        for (size_t i = 0; i < c.chunks; ++i) {
+            uint32_t expected;
+            std::memcpy(&expected, crcs + i * sizeof(uint32_t), sizeof(expected));
+            const size_t first = i * c.chunk_bytes;
+            if (Crc32(data + first, std::min<size_t>(c.chunk_bytes, bytes - first)) != expected)
+                return false;
+        }
+        return true;
+    }
+
+    template <typename T, ORDERING ORD>
+    bool VerifyChecksums(const MappedMatrix<T, ORD>& A) { return VerifyChecksums(A.File(), sizeof(T)); }
+
+    template <typename T>
+    bool VerifyChecksums(const MappedVector<T>& v) { return VerifyChecksums(v.File(), sizeof(T)); }
+
+
+    // Reads a native file into memory, checking the checksums
+    template <typename T, ORDERING ORD = ColMajor>
+    Matrix<T, ORD> Load(const std::string& filename) {
+        auto mapped = MappedMatrix<T, ORD>::Open(filename);
+        if (!VerifyChecksums(mapped))
+            throw std::runtime_error("Checksum mismatch in " + filename);
+        Matrix<T, ORD> A(mapped.Rows(), mapped.Cols());
+        A = mapped;
+        return A;
+    }
+
+    template <typename T>
+    Vector<T> LoadVector(const std::string& filename) {
+        auto mapped = MappedVector<T>::Open(filename);
+        if (!VerifyChecksums(mapped))
+            throw std::runtime_error("Checksum mismatch in " + filename);
+        Vector<T> v(mapped.Size());
+        v = mapped;
+        return v;
+    }
+
+
+    namespace detail {
+        template <typename T> const char* NpyDescr();
+        template <> inline const char* NpyDescr<float>()    { return "<f4"; }
+        template <> inline const char* NpyDescr<double>()   { return "<f8"; }
+        template <> inline const char* NpyDescr<int32_t>()  { return "<i4"; }
+        template <> inline const char* NpyDescr<int64_t>()  { return "<i8"; }
+        template <> inline const char* NpyDescr<uint64_t>() { return "<u8"; }
+
+        constexpr char NPY_MAGIC[6] = { '\x93', 'N', 'U', 'M', 'P', 'Y' };
+
+        // Magic, version 1.0, header length and the header dict padded with
+        // spaces, so that the data starts at PAGE_SIZE
+        inline std::string NpyPreamble(const char* descr, bool fortran, const std::string& shape) {
+            std::string dict = std::string("{'descr': '") + descr + "', 'fortran_order': "
+                + (fortran ? "True" : "False") + ", 'shape': " + shape + ", }";
+            const size_t len = PAGE_SIZE - 10;
+            if (dict.size() + 1 > len) throw std::runtime_error("NPY header too long");
+            dict.append(len - dict.size() - 1, ' ');
+            dict += '\n';
+            std::string pre(NPY_MAGIC, sizeof(NPY_MAGIC));
+            pre += char(1);
+            pre += char(0);
+            pre += char(len & 0xff);
+            pre += char(len >> 8);
+            return pre + dict;
+        }
+
+        struct NpyInfo {
+            std::string descr;
+            bool fortran = false;
+            std::vector<size_t> shape;
+            size_t offset = 0;
+        };
+
+        inline NpyInfo ParseNpy(const MappedFile& file) {
+            const char* p = file.Data();
+            if (file.Size() < 10 || std::memcmp(p, NPY_MAGIC, sizeof(NPY_MAGIC)) != 0)
+                throw std::runtime_error("Not an NPY file");
+            size_t len, start;
+            auto byte = [&](size_t i) { return size_t(static_cast<unsigned char>(p[i])); };
+            if (p[6] == 1) {
+                len = byte(8) | byte(9) << 8;
+                start = 10;
+            }
+            else if ((p[6] == 2 || p[6] == 3) && file.Size() >= 12) {
+                len = byte(8) | byte(9) << 8 | byte(10) << 16 | byte(11) << 24;
+                start = 12;
+            }
+            else throw std::runtime_error("Unsupported NPY version");
+            if (start + len > file.Size()) throw std::runtime_error("NPY file is truncated");
+
+            NpyInfo info;
+            const std::string dict(p + start, len);
+            info.offset = start + len;
+
+            // position found in the header, npos means a malformed header
+            auto found = [](size_t pos, const char* what) {
+                if (pos == std::string::npos) throw std::runtime_error(std::string("NPY header ") + what);
+                return pos;
+            };
+            auto value = [&](const std::string& key) {
+                size_t pos = dict.find("'" + key + "'");
+                if (pos == std::string::npos) throw std::runtime_error("NPY header without " + key);
+                return found(dict.find(':', pos), "without value") + 1;
+            };
+            size_t pos = found(dict.find('\'', value("descr")), "with invalid descr");
+            const size_t close = found(dict.find('\'', pos + 1), "with invalid descr");
+            info.descr = dict.substr(pos + 1, close - pos - 1);
+            pos = found(dict.find_first_not_of(' ', value("fortran_order")), "with invalid fortran_order");
+            info.fortran = dict.compare(pos, 4, "True") == 0;
+            pos = found(dict.find('(', value("shape")), "with invalid shape");
+            const size_t end = found(dict.find(')', pos), "with invalid shape");
+            for (size_t i = pos + 1; i < end; ) {
+                size_t next = dict.find(',', i);
+                if (next == std::string::npos || next > end) next = end;
+                const std::string item = dict.substr(i, next - i);
+                if (item.find_first_not_of(' ') != std::string::npos) {
+                    try { info.shape.push_back(std::stoull(item)); }
+                    catch (std::logic_error&) { throw std::runtime_error("NPY header with invalid shape"); }
+                }
+                i = next + 1;
+            }
+            return info;
+        }
+
+        template <typename T>
+        // rows x cols elements after the header, the shape comes from the file and may be anything
+        void CheckNpy(const NpyInfo& info, const MappedFile& file, size_t rows, size_t cols) {
+            if (info.descr != NpyDescr<T>())
+                throw std::runtime_error("NPY file has a different element type (" + info.descr + ")");
+            if (info.offset > file.Size() || (cols && rows > (file.Size() - info.offset) / sizeof(T) / cols))
+                throw std::runtime_error("NPY file is truncated");
+        }
+    }
+
+
+    // Contiguous copy in .npy format (fortran_order for ColMajor)
+    template <typename T, ORDERING ORD>
+    void SaveNpy(const std::string& filename, const MatrixView<T, ORD>& A) {
+        const std::string shape = "(" + std::to_string(A.Rows()) + ", " + std::to_string(A.Cols()) + ")";
+        const size_t inner = (ORD == ColMajor) ? A.Rows() : A.Cols();
+        const size_t outer = (ORD == ColMajor) ? A.Cols() : A.Rows();
+
+        std::FILE* file = std::fopen(filename.c_str(), "wb");
+        if (!file) throw std::runtime_error("Cannot create " + filename);
+        const std::string pre = detail::NpyPreamble(detail::NpyDescr<T>(), ORD == ColMajor, shape);
+        bool ok = std::fwrite(pre.data(), 1, pre.size(), file) == pre.size();
+        for (size_t k = 0; ok && k < outer; ++k)
+            ok = std::fwrite(A.Data() + k * A.Dist(), sizeof(T), inner, file) == inner;
+        ok = (std::fclose(file) == 0) && ok;
+        if (!ok) throw std::runtime_error("Write to " + filename + " failed");
+    }
+
+    template <typename T, typename TDIST>
+    void SaveNpy(const std::string& filename, const VectorView<T, TDIST>& v) {
+        std::FILE* file = std::fopen(filename.c_str(), "wb");
+        if (!file) throw std::runtime_error("Cannot create " + filename);
+        const std::string pre = detail::NpyPreamble(detail::NpyDescr<T>(), false, "(" + std::to_string(v.Size()) + ",)");
+        bool ok = std::fwrite(pre.data(), 1, pre.size(), file) == pre.size();
+        if (v.Dist() == 1)
+            ok = ok && std::fwrite(v.Data(), sizeof(T), v.Size(), file) == v.Size();
+        else
+            for (size_t i = 0; ok && i < v.Size(); ++i)
+                ok = std::fwrite(&v(i), sizeof(T), 1, file) == 1;
+        ok = (std::fclose(file) == 0) && ok;
+        if (!ok) throw std::runtime_error("Write to " + filename + " failed");
+    }
+
+    // Maps a 2-d .npy file without reading it. fortran_order must match ORD.
+    template <typename T, ORDERING ORD = ColMajor>
+    MappedMatrix<T, ORD> OpenNpy(const std::string& filename, MapMode mode = MapMode::ReadOnly) {
+        MappedFile file(filename, mode);
+        const detail::NpyInfo info = detail::ParseNpy(file);
+        if (info.shape.size() != 2) throw std::runtime_error("NPY file does not hold a matrix");
+        const size_t rows = info.shape[0], cols = info.shape[1];
+        if (info.fortran != (ORD == ColMajor) && rows > 1 && cols > 1)
+            throw std::runtime_error("NPY file has a different ordering");
+        detail::CheckNpy<T>(info, file, rows, cols);
+        return MappedMatrix<T, ORD>(std::move(file), rows, cols, (ORD == ColMajor) ? rows : cols, info.offset);
+    }
+
+    template <typename T>
+    MappedVector<T> OpenNpyVector(const std::string& filename, MapMode mode = MapMode::ReadOnly) {
+        MappedFile file(filename, mode);
+        const detail::NpyInfo info = detail::ParseNpy(file);
+        if (info.shape.size() != 1) throw std::runtime_error("NPY file does not hold a vector");
+        detail::CheckNpy<T>(info, file, info.shape[0], 1);
+        return MappedVector<T>(std::move(file), info.shape[0], info.offset);
+    }
+}
+
+#endif
@@ -0,0 +1,737 @@
+#ifndef FILE_SPARSE_MATRIX
+#define FILE_SPARSE_MATRIX
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "matrix.hpp"
+#include "profile.hpp"
+
+namespace Mathlib {
+
+    // Below this many non-zeros the sparse kernels run single-threaded,
+    // starting the workers costs more than the product itself.
+    constexpr size_t SPARSE_PARALLEL_NNZ = 50000;
+    constexpr size_t SPARSE_NTASKS = 8;
+
+    // Split [0, rows) into 'size' ranges with roughly the same number of non-zeros.
+    // rowptr has rows+1 entries, the range for task 'nr' is returned as [first, next).
+    inline std::pair<size_t, size_t> PartitionRowsByNnz(const size_t* rowptr, size_t rows, size_t nr, size_t size) {
+        const size_t nnz = rowptr[rows];
+        auto split = [&](size_t k) -> size_t {
+            if (k == 0) return 0;
+            if (k == size) return rows;
+            return std::lower_bound(rowptr, rowptr + rows, (nnz * k) / size) - rowptr;
+        };
+        return { split(nr), split(nr + 1) };
+    }
+
+    // Call func(first, next) on row ranges, in parallel if the matrix is big enough.
+    // Tasks start from ranges of equal nnz and steal rows when they run out.
+    template <typename FUNC>
+    void ParallelOverRows(const size_t* rowptr, size_t rows, FUNC func) {
+        if (rowptr[rows] < SPARSE_PARALLEL_NNZ || detail::InsideParallelFor()) {
+            func(size_t(0), rows);
+            return;
+        }
+
+        detail::StealingLoop(SPARSE_NTASKS, [&](size_t nr, size_t size) {
+            return PartitionRowsByNnz(rowptr, rows, nr, size);
+        }, func, 1);
+    }
+
+
+
+
+    // Single row of a CSR matrix, seen as a (mostly zero) vector expression
+    template <typename T>
+    class SparseRowView : public VecExpr<SparseRowView<T>> {
+        size_t size{}, nnz{};
+        const T* vals{};
+        const size_t* cols{};
+
+    public:
+        SparseRowView(size_t _size, size_t _nnz, const T* _vals, const size_t* _cols)
+            : size(_size), nnz(_nnz), vals(_vals), cols(_cols) { }
+
+        size_t Size() const { return size; }
+        size_t NonZeros() const { return nnz; }
+        const T* Values() const { return vals; }
+        const size_t* ColIndices() const { return cols; }
+
+        T operator()(size_t i) const {
+            auto pos = std::lower_bound(cols, cols + nnz, i);
+            return (pos != cols + nnz && *pos == i) ? vals[pos - cols] : T(0);
+        }
+    };
+
+    // Dot product only touching the non-zeros of the sparse row
+    template <typename T, typename E>
+    auto Dot(const SparseRowView<T>& a, const VecExpr<E>& b) {
+        std::decay_t<decltype(a.Values()[0] * b(0))> result(0);
+        for (size_t j = 0; j < a.NonZeros(); ++j)
+            result = result + a.Values()[j] * b(a.ColIndices()[j]);
+        return result;
+    }
+
+
+
+
+    // Compressed sparse row matrix. Column indices are sorted and unique within each row.
+    template <typename T>
+    class SparseMatrixView : public MatExpr<SparseMatrixView<T>> {
+    protected:
+        size_t rows{}, cols{};
+        T* vals{};
+        size_t* colind{};
+        size_t* rowptr{};
+
+    public:
+        SparseMatrixView() = default;
+        SparseMatrixView(const SparseMatrixView&) = default;
+        SparseMatrixView(size_t r, size_t c, size_t* _rowptr, size_t* _colind, T* _vals)
+            : rows(r), cols(c), vals(_vals), colind(_colind), rowptr(_rowptr) { }
+
+        size_t Rows() const { return rows; }
+        size_t Cols() const { return cols; }
+        size_t NonZeros() const { return rows ? rowptr[rows] : 0; }
+
+        T*      Values()     const { return vals; }
+        size_t* ColIndices() const { return colind; }
+        size_t* RowPtr()     const { return rowptr; }
+
+        auto Row(size_t r) const {
+            return SparseRowView<T>(cols, rowptr[r+1]-rowptr[r], vals + rowptr[r], colind + rowptr[r]);
+        }
+
+        T operator()(size_t r, size_t c) const { return Row(r)(c); }
+
+        // i-th entry of this * x
+        template <typename EV>
+        auto MultRow(size_t i, const EV& x) const { return Dot(Row(i), x); }
+    };
+
+
+
+
+    template <typename T>
+    class SparseMatrix : public SparseMatrixView<T> {
+        typedef SparseMatrixView<T> BASE;
+        using BASE::rows;
+        using BASE::cols;
+        using BASE::vals;
+        using BASE::colind;
+        using BASE::rowptr;
+
+        Vector<size_t> rowptr_mem;
+        Vector<size_t> colind_mem;
+        Vector<T> vals_mem;
+
+        void SetPointers() {
+            rowptr = rowptr_mem.Data();
+            colind = colind_mem.Data();
+            vals = vals_mem.Data();
+        }
+
+    public:
+        // Empty pattern, rows x cols with room for nnz entries.
+        // The caller fills RowPtr(), ColIndices() and Values().
+        SparseMatrix(size_t r, size_t c, size_t nnz)
+            : rowptr_mem(r+1), colind_mem(nnz), vals_mem(nnz) {
+            rows = r;
+            cols = c;
+            SetPointers();
+            rowptr_mem = size_t(0);
+        }
+
+        SparseMatrix(const SparseMatrix& other)
+            : BASE(other), rowptr_mem(other.rowptr_mem), colind_mem(other.colind_mem), vals_mem(other.vals_mem) {
+            SetPointers();
+        }
+
+        SparseMatrix(SparseMatrix&& other)
+            : BASE(other), rowptr_mem(std::move(other.rowptr_mem)), colind_mem(std::move(other.colind_mem)),
+              vals_mem(std::move(other.vals_mem)) {
+            SetPointers();
+            other.rows = other.cols = 0;
+            other.SetPointers();
+        }
+
+        SparseMatrix& operator=(SparseMatrix&& other) {
+            if (this != &other) {
+                rows = other.rows;
+                cols = other.cols;
+                rowptr_mem = std::move(other.rowptr_mem);
+                colind_mem = std::move(other.colind_mem);
+                vals_mem = std::move(other.vals_mem);
+                SetPointers();
+                other.rows = other.cols = 0;
+                other.SetPointers();
+            }
+            return *this;
+        }
+
+        SparseMatrix& operator=(const SparseMatrix& other) {
+            if (this != &other)
+                *this = SparseMatrix(other);
+            return *this;
+        }
+    };
+
+
+
+
+    // Block compressed sparse row matrix with dense BS x BS blocks (each stored column-major).
+    // Rows and columns are counted in scalar entries, the pattern in blocks.
+    template <typename T, size_t BS>
+    class BlockSparseMatrixView : public MatExpr<BlockSparseMatrixView<T, BS>> {
+    protected:
+        size_t brows{}, bcols{};
+        T* vals{};
+        size_t* colind{};
+        size_t* rowptr{};
+
+    public:
+        BlockSparseMatrixView() = default;
+        BlockSparseMatrixView(const BlockSparseMatrixView&) = default;
+        BlockSparseMatrixView(size_t _brows, size_t _bcols, size_t* _rowptr, size_t* _colind, T* _vals)
+            : brows(_brows), bcols(_bcols), vals(_vals), colind(_colind), rowptr(_rowptr) { }
+
+        static constexpr size_t BlockSize() { return BS; }
+        size_t Rows() const { return brows * BS; }
+        size_t Cols() const { return bcols * BS; }
+        size_t BlockRows() const { return brows; }
+        size_t BlockCols() const { return bcols; }
+        size_t NonZeroBlocks() const { return brows ? rowptr[brows] : 0; }
+
+        T*      Values()     const { return vals; }
+        size_t* ColIndices() const { return colind; }
+        size_t* RowPtr()     const { return rowptr; }
+
+        // Dense view of the k-th stored block
+        MatrixView<T, ColMajor> Block(size_t k) const { return MatrixView<T, ColMajor>(BS, BS, vals + k*BS*BS); }
+
+        T operator()(size_t r, size_t c) const {
+            size_t br = r / BS, bc = c / BS;
+            auto first = colind + rowptr[br], next = colind + rowptr[br+1];
+            auto pos = std::lower_bound(first, next, bc);
+            if (pos == next || *pos != bc) return T(0);
+            return Block(pos - colind)(r % BS, c % BS);
+        }
+
+        template <typename EV>
+        auto MultRow(size_t i, const EV& x) const {
+            size_t br = i / BS, ii = i % BS;
+            std::decay_t<decltype(vals[0] * x(0))> result(0);
+            for (size_t k = rowptr[br]; k < rowptr[br+1]; ++k)
+                for (size_t jj = 0; jj < BS; ++jj)
+                    result = result + vals[k*BS*BS + jj*BS + ii] * x(colind[k]*BS + jj);
+            return result;
+        }
+    };
+
+
+
+
+    template <typename T, size_t BS>
+    class BlockSparseMatrix : public BlockSparseMatrixView<T, BS> {
+        typedef BlockSparseMatrixView<T, BS> BASE;
+        using BASE::brows;
+        using BASE::bcols;
+        using BASE::vals;
+        using BASE::colind;
+        using BASE::rowptr;
+
+        Vector<size_t> rowptr_mem;
+        Vector<size_t> colind_mem;
+        Vector<T> vals_mem;
+
+        void SetPointers() {
+            rowptr = rowptr_mem.Data();
+            colind = colind_mem.Data();
+            vals = vals_mem.Data();
+        }
+
+    public:
+        // Empty pattern with brows x bcols blocks and room for nnzb blocks
+        BlockSparseMatrix(size_t _brows, size_t _bcols, size_t nnzb)
+            : rowptr_mem(_brows+1), colind_mem(nnzb), vals_mem(nnzb*BS*BS) {
+            brows = _brows;
+            bcols = _bcols;
+            SetPointers();
+            rowptr_mem = size_t(0);
+        }
+
+        BlockSparseMatrix(const BlockSparseMatrix& other)
+            : BASE(other), rowptr_mem(other.rowptr_mem), colind_mem(other.colind_mem), vals_mem(other.vals_mem) {
+            SetPointers();
+        }
+
+        BlockSparseMatrix(BlockSparseMatrix&& other)
+            : BASE(other), rowptr_mem(std::move(other.rowptr_mem)), colind_mem(std::move(other.colind_mem)),
+              vals_mem(std::move(other.vals_mem)) {
+            SetPointers();
+            other.brows = other.bcols = 0;
+            other.SetPointers();
+        }
+
+        BlockSparseMatrix& operator=(BlockSparseMatrix&& other) {
+            if (this != &other) {
+                brows = other.brows;
+                bcols = other.bcols;
+                rowptr_mem = std::move(other.rowptr_mem);
+                colind_mem = std::move(other.colind_mem);
+                vals_mem = std::move(other.vals_mem);
+                SetPointers();
+                other.brows = other.bcols = 0;
+                other.SetPointers();
+            }
+            return *this;
+        }
+
+        BlockSparseMatrix& operator=(const BlockSparseMatrix& other) {
+            if (this != &other)
+                *this = BlockSparseMatrix(other);
+            return *this;
+        }
+
+        // Convert a CSR matrix, every BS x BS block containing a non-zero is stored densely.
+        // Rows and columns of the CSR matrix must be multiples of BS.
+        static BlockSparseMatrix FromSparse(const SparseMatrixView<T>& csr) {
+            if (csr.Rows() % BS != 0 || csr.Cols() % BS != 0)
+                throw std::invalid_argument("Matrix size must be a multiple of the block size");
+
+            const size_t nbr = csr.Rows() / BS;
+            const size_t* rp = csr.RowPtr();
+            const size_t* ci = csr.ColIndices();
+
+            // Block columns of one block row: merge of the (sorted) column lists of its BS rows
+            auto block_cols = [&](size_t br, std::vector<size_t>& out) {
+                out.clear();
+                for (size_t r = br*BS; r < (br+1)*BS; ++r)
+                    for (size_t k = rp[r]; k < rp[r+1]; ++k)
+                        out.push_back(ci[k] / BS);
+                std::sort(out.begin(), out.end());
+                out.erase(std::unique(out.begin(), out.end()), out.end());
+            };
+
+            // First pass: count blocks per block row
+            std::vector<size_t> counts(nbr+1, 0);
+            ParallelOverRows(rp, csr.Rows(), [&](size_t first, size_t next) {
+                std::vector<size_t> bc;
+                for (size_t br = (first + BS - 1) / BS; br*BS < next; ++br) {
+                    block_cols(br, bc);
+                    counts[br+1] = bc.size();
+                }
+            });
+            for (size_t br = 0; br < nbr; ++br)
+                counts[br+1] += counts[br];
+
+            BlockSparseMatrix bsr(nbr, csr.Cols() / BS, counts[nbr]);
+            std::copy(counts.begin(), counts.end(), bsr.RowPtr());
+            bsr.vals_mem = T(0);
+
+            // Second pass: fill pattern and block values
+            ParallelOverRows(rp, csr.Rows(), [&](size_t first, size_t next) {
+                std::vector<size_t> bc;
+                for (size_t br = (first + BS - 1) / BS; br*BS < next; ++br) {
+                    block_cols(br, bc);
+                    size_t* bci = bsr.ColIndices() + counts[br];
+                    std::copy(bc.begin(), bc.end(), bci);
+                    for (size_t r = br*BS; r < (br+1)*BS; ++r)
+                        for (size_t k = rp[r]; k < rp[r+1]; ++k) {
+                            size_t kb = std::lower_bound(bci, bci + bc.size(), ci[k] / BS) - bsr.ColIndices();
+                            bsr.Block(kb)(r % BS, ci[k] % BS) = csr.Values()[k];
+                        }
+                }
+            });
+            return bsr;
+        }
+    };
+
+
+
+
+    // Assembles a SparseMatrix from (row, col, value) triplets. Duplicates are summed.
+    template <typename T>
+    class SparseMatrixBuilder {
+        size_t rows, cols;
+        std::vector<size_t> trows, tcols;
+        std::vector<T> tvals;
+
+    public:
+        SparseMatrixBuilder(size_t r, size_t c) : rows(r), cols(c) { }
+
+        void Reserve(size_t n) {
+            trows.reserve(n);
+            tcols.reserve(n);
+            tvals.reserve(n);
+        }
+
+        void Add(size_t r, size_t c, T val) {
+            if (r >= rows || c >= cols) throw std::out_of_range("Triplet index out of range");
+            trows.push_back(r);
+            tcols.push_back(c);
+            tvals.push_back(val);
+        }
+
+        size_t NumTriplets() const { return tvals.size(); }
+
+        SparseMatrix<T> Build() const {
+            const size_t n = tvals.size();
+            const size_t ntasks = (n < SPARSE_PARALLEL_NNZ) ? 1 : SPARSE_NTASKS;
+            // func(t) for the tasks t, parallel unless nested in another parallel region
+            auto run = [&](auto func) {
+                ParallelRanges(ntasks, ntasks, [&](size_t first, size_t next) {
+                    for (size_t t = first; t < next; ++t) func(t);
+                });
+            };
+            auto chunk = [&](size_t t) {
+                return std::pair<size_t, size_t>(n * t / ntasks, n * (t+1) / ntasks);
+            };
+
+            // Per-task row histograms. offsets[t*rows + r] becomes the position
+            // where task t writes its first entry of row r, which keeps the scatter stable.
+            std::vector<size_t> offsets(ntasks * rows, 0);
+            run([&](size_t t) {
+                auto [first, next] = chunk(t);
+                size_t* cnt = offsets.data() + t*rows;
+                for (size_t k = first; k < next; ++k)
+                    cnt[trows[k]]++;
+            });
+
+            std::vector<size_t> rowstart(rows+1, 0);
+            size_t pos = 0;
+            for (size_t r = 0; r < rows; ++r) {
+                rowstart[r] = pos;
+                for (size_t t = 0; t < ntasks; ++t) {
+                    size_t c = offsets[t*rows + r];
+                    offsets[t*rows + r] = pos;
+                    pos += c;
+                }
+            }
+            rowstart[rows] = pos;
+
+            std::vector<size_t> scols(n);
+            std::vector<T> svals(n);
+            run([&](size_t t) {
+                auto [first, next] = chunk(t);
+                size_t* off = offsets.data() + t*rows;
+                for (size_t k = first; k < next; ++k) {
+                    size_t dst = off[trows[k]]++;
+                    scols[dst] = tcols[k];
+                    svals[dst] = tvals[k];
+                }
+            });
+
+            // Sort each row by column and sum duplicates in place, rowcount gets the compressed length
+            std::vector<size_t> rowcount(rows+1, 0);
+            ParallelOverRows(rowstart.data(), rows, [&](size_t first, size_t next) {
+                std::vector<size_t> perm, ctmp;
+                std::vector<T> tmp;
+                for (size_t r = first; r < next; ++r) {
+                    size_t b = rowstart[r], e = rowstart[r+1];
+                    perm.resize(e-b);
+                    std::iota(perm.begin(), perm.end(), b);
+                    std::stable_sort(perm.begin(), perm.end(), [&](size_t i, size_t j) { return scols[i] < scols[j]; });
+                    tmp.assign(perm.size(), T(0));
+                    ctmp.resize(perm.size());
+                    size_t m = 0;
+                    for (size_t k = 0; k < perm.size(); ++k) {
+                        if (m > 0 && ctmp[m-1] == scols[perm[k]])
+                            tmp[m-1] = tmp[m-1] + svals[perm[k]];
+                        else {
+                            ctmp[m] = scols[perm[k]];
+                            tmp[m] = svals[perm[k]];
+                            ++m;
+                        }
+                    }
+                    std::copy(ctmp.begin(), ctmp.begin() + m, scols.begin() + b);
+                    std::copy(tmp.begin(), tmp.begin() + m, svals.begin() + b);
+                    rowcount[r+1] = m;
+                }
+            });
+            for (size_t r = 0; r < rows; ++r)
+                rowcount[r+1] += rowcount[r];
+
+            SparseMatrix<T> mat(rows, cols, rowcount[rows]);
+            std::copy(rowcount.begin(), rowcount.end(), mat.RowPtr());
+            ParallelOverRows(rowcount.data(), rows, [&](size_t first, size_t next) {
+                for (size_t r = first; r < next; ++r) {
+                    size_t len = rowcount[r+1] - rowcount[r];
+                    std::copy_n(scols.begin() + rowstart[r], len, mat.ColIndices() + rowcount[r]);
+                    std::copy_n(svals.begin() + rowstart[r], len, mat.Values() + rowcount[r]);
+                }
+            });
+            return mat;
+        }
+    };
+
+
+
+
+    // Sparse matrix - vector product, evaluated by MultSparseMatVec on assignment
+    template <typename TM, typename EV>
+    class SparseMatVecExpr : public VecExpr<SparseMatVecExpr<TM, EV>> {
+        TM mat;
+        EV vec;
+
+    public:
+        SparseMatVecExpr(TM _mat, EV _vec) : mat(_mat), vec(_vec) { }
+
+        auto operator()(size_t i) const { return mat.MultRow(i, vec); }
+        size_t Size() const { return mat.Rows(); }
+        const TM& Mat() const { return mat; }
+        const EV& Vec() const { return vec; }
+    };
+
+    template <typename T, typename EV>
+    auto operator*(const SparseMatrixView<T>& m, const VecExpr<EV>& v) {
+        return SparseMatVecExpr<SparseMatrixView<T>, EV>(m, v.Downcast());
+    }
+
+    template <typename T, size_t BS, typename EV>
+    auto operator*(const BlockSparseMatrixView<T, BS>& m, const VecExpr<EV>& v) {
+        return SparseMatVecExpr<BlockSparseMatrixView<T, BS>, EV>(m, v.Downcast());
+    }
+
+
+    // Sparse matrix - dense matrix product, evaluated by MultSparseMatMat on assignment
+    template <typename TM, typename EM>
+    class SparseMatMatExpr : public MatExpr<SparseMatMatExpr<TM, EM>> {
+        TM a;
+        EM b;
+
+    public:
+        SparseMatMatExpr(TM _a, EM _b) : a(_a), b(_b) { }
+
+        auto operator()(size_t r, size_t c) const { return a.MultRow(r, b.Col(c)); }
+        size_t Rows() const { return a.Rows(); }
+        size_t Cols() const { return b.Cols(); }
+        const TM& Left() const { return a; }
+        const EM& Right() const { return b; }
+    };
+
+    template <typename T, typename EM>
+    auto operator*(const SparseMatrixView<T>& a, const MatExpr<EM>& b) {
+        return SparseMatMatExpr<SparseMatrixView<T>, EM>(a, b.Downcast());
+    }
+
+    template <typename T, size_t BS, typename EM>
+    auto operator*(const BlockSparseMatrixView<T, BS>& a, const MatExpr<EM>& b) {
+        return SparseMatMatExpr<BlockSparseMatrixView<T, BS>, EM>(a, b.Downcast());
+    }
+
+
+
+
+    // Dot product of a CSR row with a strided array. For double the products are
+    // accumulated in SIMD registers, the x-entries are gathered into a small buffer.
+    template <typename T>
+    inline T SparseRowDot(const T* vals, const size_t* cols, size_t nnz, const T* x, size_t dx) {
+        size_t j = 0;
+        T sum(0);
+        if constexpr (std::is_same_v<T, double>) {
+            SIMD<double, 4> acc(0.0);
+            for (; j + 4 <= nnz; j += 4) {
+                double xg[4] = { x[cols[j]*dx], x[cols[j+1]*dx], x[cols[j+2]*dx], x[cols[j+3]*dx] };
+                acc = fma(SIMD<double, 4>(const_cast<double*>(vals + j)), SIMD<double, 4>(xg), acc);
+            }
+            double part[4];
+            acc.store(part);
+            sum = (part[0] + part[1]) + (part[2] + part[3]);
+        }
+        for (; j < nnz; ++j)
+            sum = sum + vals[j] * x[cols[j]*dx];
+        return sum;
+    }
+
+    namespace detail {
+        template <typename TM, typename T, typename TDX, typename TDY>
+        void CheckMatVec(const TM& A, const VectorView<T, TDX>& x, const VectorView<T, TDY>& y) {
+            if (x.Size() != A.Cols() || y.Size() != A.Rows())
+                throw std::invalid_argument("Matrix and vector sizes do not match");
+        }
+
+        // True if the memory spanned by the two vectors intersects
+        template <typename T, typename TDX, typename TDY>
+        bool SharesMemory(const VectorView<T, TDX>& x, const VectorView<T, TDY>& y) {
+            if (x.Size() == 0 || y.Size() == 0) return false;
+            const T* xend = x.Data() + (x.Size() - 1) * x.Dist() + 1;
+            const T* yend = y.Data() + (y.Size() - 1) * y.Dist() + 1;
+            return x.Data() < yend && y.Data() < xend;
+        }
+
+        // y = A*x through a temporary, for y overlapping x
+        template <typename TM, typename T, typename TDX, typename TDY>
+        void MultSparseMatVecAliased(TM A, VectorView<T, TDX> x, VectorView<T, TDY> y) {
+            Vector<T> tmp(y.Size());
+            MultSparseMatVec(A, x, VectorView<T>(tmp));
+            y = static_cast<const VecExpr<VectorView<T>>&>(tmp);
+        }
+    }
+
+    // y = A*x for contiguous or strided x, y; x = A*x goes through a temporary
+    template <typename T, typename TDX, typename TDY>
+    void MultSparseMatVec(SparseMatrixView<T> A, VectorView<T, TDX> x, VectorView<T, TDY> y) {
+        detail::CheckMatVec(A, x, y);
+        if (detail::SharesMemory(x, y)) return detail::MultSparseMatVecAliased(A, x, y);
+        MATHLIB_PROFILE_SCOPE("SpMV", 2.0 * A.NonZeros(),
+                              (sizeof(T) + sizeof(size_t)) * A.NonZeros() + sizeof(size_t) * A.Rows() + sizeof(T) * (A.Rows() + A.Cols()));
+        const size_t* rp = A.RowPtr();
+        const size_t* ci = A.ColIndices();
+        const T* va = A.Values();
+        const T* px = x.Data();
+        T* py = y.Data();
+        const size_t dx = x.Dist(), dy = y.Dist();
+
+        ParallelOverRows(rp, A.Rows(), [&](size_t first, size_t next) {
+            for (size_t i = first; i < next; ++i)
+                py[i*dy] = SparseRowDot(va + rp[i], ci + rp[i], rp[i+1]-rp[i], px, dx);
+        });
+    }
+
+    // y = A*x for block-CSR, each block is applied as BS column-axpys
+    template <typename T, size_t BS, typename TDX, typename TDY>
+    void MultSparseMatVec(BlockSparseMatrixView<T, BS> A, VectorView<T, TDX> x, VectorView<T, TDY> y) {
+        detail::CheckMatVec(A, x, y);
+        if (detail::SharesMemory(x, y)) return detail::MultSparseMatVecAliased(A, x, y);
+        const size_t* rp = A.RowPtr();
+        const size_t* ci = A.ColIndices();
+        const T* va = A.Values();
+        const T* px = x.Data();
+        T* py = y.Data();
+        const size_t dx = x.Dist(), dy = y.Dist();
+
+        // Partition block rows by number of blocks
+        ParallelOverRows(rp, A.BlockRows(), [&](size_t first, size_t next) {
+            for (size_t br = first; br < next; ++br) {
+                T ysum[BS];
+                if constexpr (std::is_same_v<T, double> && (BS == 2 || BS == 4 || BS == 8)) {
+                    SIMD<double, BS> acc(0.0);
+                    for (size_t k = rp[br]; k < rp[br+1]; ++k) {
+                        const double* blk = va + k*BS*BS;
+                        const double* xb = px + ci[k]*BS*dx;
+                        for (size_t jj = 0; jj < BS; ++jj)
+                            acc = fma(SIMD<double, BS>(const_cast<double*>(blk + jj*BS)), SIMD<double, BS>(xb[jj*dx]), acc);
+                    }
+                    acc.store(ysum);
+                }
+                else {
+                    for (size_t ii = 0; ii < BS; ++ii)
+                        ysum[ii] = T(0);
+                    for (size_t k = rp[br]; k < rp[br+1]; ++k)
+                        for (size_t jj = 0; jj < BS; ++jj)
+                            for (size_t ii = 0; ii < BS; ++ii)
+                                ysum[ii] = ysum[ii] + va[k*BS*BS + jj*BS + ii] * px[(ci[k]*BS + jj)*dx];
+                }
+                for (size_t ii = 0; ii < BS; ++ii)
+                    py[(br*BS + ii)*dy] = ysum[ii];
+            }
+        });
+    }
+
+    // Any other vector expression on the right is evaluated into a temporary first
+    template <typename TM, typename EV, typename T, typename TDY>
+    void MultSparseMatVec(TM A, const VecExpr<EV>& x, VectorView<T, TDY> y) {
+        Vector<T> tmp(x);
+        MultSparseMatVec(A, VectorView<T>(tmp), y);
+    }
+
+
+    // y(0..n) += a * x(0..n), with strides
+    template <typename T>
+    inline void SparseAxpy(size_t n, T a, const T* x, size_t dx, T* y, size_t dy) {
+        size_t j = 0;
+        if constexpr (std::is_same_v<T, double>) {
+            if (dx == 1 && dy == 1) {
+                SIMD<double, 4> av(a);
+                for (; j + 4 <= n; j += 4)
+                    fma(av, SIMD<double, 4>(const_cast<double*>(x + j)), SIMD<double, 4>(y + j)).store(y + j);
+            }
+        }
+        for (; j < n; ++j)
+            y[j*dy] = y[j*dy] + a * x[j*dx];
+    }
+
+    namespace detail {
+        template <typename TM, typename T, ORDERING OB, ORDERING OC>
+        void CheckMatMat(const TM& A, const MatrixView<T, OB>& B, const MatrixView<T, OC>& C) {
+            if (B.Rows() != A.Cols() || C.Rows() != A.Rows() || C.Cols() != B.Cols())
+                throw std::invalid_argument("Matrix dimensions do not match for multiplication");
+        }
+
+        // True if the memory spanned by the two matrices intersects
+        template <typename T, ORDERING OB, ORDERING OC>
+        bool SharesMemory(const MatrixView<T, OB>& B, const MatrixView<T, OC>& C) {
+            auto end = [](const auto& m, size_t inner, size_t outer) { return m.Data() + (outer - 1) * m.Dist() + inner; };
+            if (B.Rows() == 0 || B.Cols() == 0 || C.Rows() == 0 || C.Cols() == 0) return false;
+            const T* bend = (OB == ColMajor) ? end(B, B.Rows(), B.Cols()) : end(B, B.Cols(), B.Rows());
+            const T* cend = (OC == ColMajor) ? end(C, C.Rows(), C.Cols()) : end(C, C.Cols(), C.Rows());
+            return B.Data() < cend && C.Data() < bend;
+        }
+
+        // C = A*B through a temporary, for C overlapping B
+        template <typename TM, typename T, ORDERING OB, ORDERING OC>
+        void MultSparseMatMatAliased(TM A, MatrixView<T, OB> B, MatrixView<T, OC> C) {
+            Matrix<T, OC> tmp(C.Rows(), C.Cols());
+            MultSparseMatMat(A, B, MatrixView<T, OC>(tmp));
+            C = static_cast<const MatExpr<MatrixView<T, OC>>&>(tmp);
+        }
+    }
+
+    // C = A*B, rows of C are linear combinations of rows of B; X = A*X goes through a temporary
+    template <typename T, ORDERING OB, ORDERING OC>
+    void MultSparseMatMat(SparseMatrixView<T> A, MatrixView<T, OB> B, MatrixView<T, OC> C) {
+        detail::CheckMatMat(A, B, C);
+        if (detail::SharesMemory(B, C)) return detail::MultSparseMatMatAliased(A, B, C);
+        const size_t* rp = A.RowPtr();
+        const size_t* ci = A.ColIndices();
+        const T* va = A.Values();
+        const size_t n = C.Cols();
+
+        ParallelOverRows(rp, A.Rows(), [&](size_t first, size_t next) {
+            for (size_t i = first; i < next; ++i) {
+                auto crow = C.Row(i);
+                crow = T(0);
+                for (size_t k = rp[i]; k < rp[i+1]; ++k) {
+                    auto brow = B.Row(ci[k]);
+                    SparseAxpy(n, va[k], brow.Data(), brow.Dist(), crow.Data(), crow.Dist());
+                }
+            }
+        });
+    }
+
+    template <typename T, size_t BS, ORDERING OB, ORDERING OC>
+    void MultSparseMatMat(BlockSparseMatrixView<T, BS> A, MatrixView<T, OB> B, MatrixView<T, OC> C) {
+        detail::CheckMatMat(A, B, C);
+        if (detail::SharesMemory(B, C)) return detail::MultSparseMatMatAliased(A, B, C);
+        const size_t* rp = A.RowPtr();
+        const size_t* ci = A.ColIndices();
+        const size_t n = C.Cols();
+
+        ParallelOverRows(rp, A.BlockRows(), [&](size_t first, size_t next) {
+            for (size_t br = first; br < next; ++br) {
+                C.RowRange(br*BS, (br+1)*BS) = T(0);
+                for (size_t k = rp[br]; k < rp[br+1]; ++k) {
+                    auto blk = A.Block(k);
+                    for (size_t jj = 0; jj < BS; ++jj) {
+                        auto brow = B.Row(ci[k]*BS + jj);
+                        for (size_t ii = 0; ii < BS; ++ii) {
+                            auto crow = C.Row(br*BS + ii);
+                            SparseAxpy(n, blk(ii, jj), brow.Data(), brow.Dist(), crow.Data(), crow.Dist());
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    template <typename TM, typename EM, typename T, ORDERING OC>
+    void MultSparseMatMat(TM A, const MatExpr<EM>& B, MatrixView<T, OC> C) {
+        Matrix<T, RowMajor> tmp(B);
+        MultSparseMatMat(A, MatrixView<T, RowMajor>(tmp), C);
+    }
+}
+
+#endif
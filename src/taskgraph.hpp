@@ -0,0 +1,155 @@
+#ifndef FILE_TASKGRAPH
+#define FILE_TASKGRAPH
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "partition.hpp"
+
+// Dependency driven execution of task graphs, for tiled algorithms where a
+// fork-join per step leaves cores idle behind the panel factorization.
+// Tasks are added in program order and declare the tiles (any address, usually
+// the first element of a tile) they read and write. A task depends on the last
+// earlier writer of every tile it reads or writes, and, when writing, on the
+// earlier readers since that writer. Run() executes the graph on the task
+// manager workers: a task starts as soon as its predecessors have finished,
+// the ready task with the highest priority first, so work on the critical path
+// (the next panel) runs ahead of the bulk updates of the current step.
+
+namespace Mathlib {
+
+    class TaskGraph {
+        struct Task {
+            std::function<void()> func;
+            int priority;
+            size_t npred = 0;
+            std::vector<size_t> successors;
+
+            Task(std::function<void()> _func, int _priority) : func(std::move(_func)), priority(_priority) { }
+        };
+
+        struct Access {
+            size_t writer = NONE;
+            std::vector<size_t> readers;
+        };
+
+        static constexpr size_t NONE = size_t(-1);
+
+        std::vector<Task> tasks;
+        std::unordered_map<const void*, Access> tiles;
+
+        void AddEdge(size_t from, size_t to) {
+            if (from == NONE || from == to) return;
+            auto& succ = tasks[from].successors;
+            if (!succ.empty() && succ.back() == to) return;   // edges to 'to' are added consecutively
+            succ.push_back(to);
+            tasks[to].npred++;
+        }
+
+    public:
+        // Adds func, returns its number. A tile in both lists counts as written.
+        size_t Add(std::function<void()> func, const std::vector<const void*>& reads,
+                   const std::vector<const void*>& writes, int priority = 0) {
+            const size_t id = tasks.size();
+            tasks.emplace_back(std::move(func), priority);
+
+            for (const void* t : reads) {
+                auto& acc = tiles[t];
+                AddEdge(acc.writer, id);
+            }
+            for (const void* t : writes) {
+                auto& acc = tiles[t];
+                AddEdge(acc.writer, id);
+                for (size_t r : acc.readers) AddEdge(r, id);
+            }
+            for (const void* t : reads)
+                tiles[t].readers.push_back(id);
+            for (const void* t : writes) {
+                auto& acc = tiles[t];
+                acc.writer = id;
+                acc.readers.clear();
+            }
+            return id;
+        }
+
+        size_t Size() const { return tasks.size(); }
+
+        // Number of tasks id waits for
+        size_t Predecessors(size_t id) const { return tasks[id].npred; }
+
+        // Executes all tasks with ntasks workers and empties the graph.
+        // After an exception in a task the tasks not yet started are skipped,
+        // and the first exception is rethrown.
+        void Run(size_t ntasks = DEFAULT_NTASKS) {
+            const size_t n = tasks.size();
+            // highest priority first, among equal ones the task added first
+            auto later = [this](size_t a, size_t b) {
+                if (tasks[a].priority != tasks[b].priority) return tasks[a].priority < tasks[b].priority;
+                return a > b;
+            };
+            std::priority_queue<size_t, std::vector<size_t>, decltype(later)> ready(later);
+            std::vector<size_t> remaining(n);
+            for (size_t i = 0; i < n; ++i) {
+                remaining[i] = tasks[i].npred;
+                if (remaining[i] == 0) ready.push(i);
+            }
+
+            std::mutex mutex;
+            std::condition_variable wakeup;
+            size_t finished = 0;
+            std::exception_ptr error;
+
+            auto worker = [&]() {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (true) {
+                    wakeup.wait(lock, [&]() { return !ready.empty() || finished == n; });
+                    if (ready.empty()) return;
+                    const size_t id = ready.top();
+                    ready.pop();
+                    const bool skip = bool(error);
+                    lock.unlock();
+
+                    std::exception_ptr failed;
+                    if (!skip) {
+                        try { tasks[id].func(); }
+                        catch (...) { failed = std::current_exception(); }
+                    }
+
+                    lock.lock();
+                    if (failed && !error) error = failed;
+                    finished++;
+                    for (size_t s : tasks[id].successors)
+                        if (--remaining[s] == 0) ready.push(s);
+                    wakeup.notify_all();
+                }
+            };
+
+            // on the calling thread if the workers are busy, see partition.hpp
+            std::optional<WorkerPoolLease> pool;
+            if (ntasks > 1 && n > 1) pool.emplace();
+            if (!pool || !*pool)
+                worker();
+            else {
+                ASC_HPC::StartWorkers(ntasks-1);
+                ASC_HPC::RunParallel(ntasks, [&](int nr, int) {
+                    PinThread pin(TaskCpu(nr));
+                    worker();
+                });
+                ASC_HPC::StopWorkers();
+            }
+
+            tasks.clear();
+            tiles.clear();
+            if (error) std::rethrow_exception(error);
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,495 @@
+#ifndef FILE_TEXTIO
+#define FILE_TEXTIO
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "sparse_matrix.hpp"
+#include "format.hpp"
+
+// Reading and writing matrices as text: dense text (one row per line, values
+// separated by blanks or commas, '#' starts a comment line) and Matrix Market
+// (.mtx) files. The whole file is read at once and split into chunks at line
+// boundaries. The chunks are parsed in parallel with std::from_chars and the
+// values go straight into the Matrix, or into triplets for the
+// SparseMatrixBuilder. The writers format row ranges in parallel with
+// std::to_chars, shortest round-trip form by default. Without floating point
+// from_chars (no __cpp_lib_to_chars, see format.hpp) floats are read with strtod.
+
+namespace Mathlib {
+
+    // Texts (and estimated outputs) below this size are handled by the calling thread
+    constexpr size_t TEXT_PARALLEL_BYTES = size_t(1) << 20;
+
+    namespace detail {
+        inline size_t TextTasks(size_t bytes) { return bytes < TEXT_PARALLEL_BYTES ? 1 : DEFAULT_NTASKS; }
+
+        inline std::string ReadFile(const std::string& filename) {
+            std::ifstream in(filename, std::ios::binary);
+            if (!in) throw std::runtime_error("Cannot open " + filename);
+            in.seekg(0, std::ios::end);
+            std::string text(size_t(in.tellg()), '\0');
+            in.seekg(0);
+            in.read(&text[0], text.size());
+            if (!in) throw std::runtime_error("Read from " + filename + " failed");
+            return text;
+        }
+
+        inline void WriteFile(const std::string& filename, const std::vector<std::string>& parts) {
+            std::ofstream out(filename, std::ios::binary);
+            if (!out) throw std::runtime_error("Cannot create " + filename);
+            for (auto& part : parts)
+                out.write(part.data(), part.size());
+            if (!out) throw std::runtime_error("Write to " + filename + " failed");
+        }
+
+        // n+1 offsets cutting text into n pieces at line starts
+        inline std::vector<size_t> SplitLines(std::string_view text, size_t n) {
+            std::vector<size_t> cuts{ 0 };
+            for (size_t k = 1; k < n; ++k) {
+                size_t pos = text.find('\n', std::max(cuts.back(), text.size() * k / n));
+                cuts.push_back(pos == std::string_view::npos ? text.size() : pos + 1);
+            }
+            cuts.push_back(text.size());
+            return cuts;
+        }
+
+        inline size_t LineOf(std::string_view text, const char* pos) {
+            return 1 + std::count(text.data(), pos, '\n');
+        }
+
+        struct TextCursor {
+            const char* p;
+            const char* end;
+
+            // blanks: space, tab, comma, \r
+            void SkipBlanks() {
+                while (p < end && (*p == ' ' || *p == '\t' || *p == ',' || *p == '\r'))
+                    ++p;
+            }
+            bool AtLineEnd() {
+                SkipBlanks();
+                return p == end || *p == '\n';
+            }
+            // Empty line or comment
+            bool SkipLine(char comment) {
+                return AtLineEnd() || *p == comment;
+            }
+            void NextLine() {
+                while (p < end && *p != '\n') ++p;
+                if (p < end) ++p;
+            }
+            template <typename T>
+            bool Number(T& val) {
+                SkipBlanks();
+                if (p < end && *p == '+') ++p;
+#ifndef __cpp_lib_to_chars
+                if constexpr (std::is_floating_point_v<T>)
+                    return Float(val);
+                else
+#endif
+                {
+                    auto res = std::from_chars(p, end, val);
+                    if (res.ec != std::errc()) return false;
+                    p = res.ptr;
+                    return true;
+                }
+            }
+#ifndef __cpp_lib_to_chars
+            // strtod and friends on a terminated copy of the token, which ends at a blank or line end
+            template <typename T>
+            bool Float(T& val) {
+                char buf[64];
+                size_t len = 0;
+                while (p + len < end && len + 1 < sizeof(buf) && !std::isspace(static_cast<unsigned char>(p[len])) && p[len] != ',')
+                    ++len;
+                std::memcpy(buf, p, len);
+                buf[len] = '\0';
+                char* stop = buf;
+                errno = 0;
+                T x;
+                if constexpr (std::is_same_v<T, float>) x = std::strtof(buf, &stop);
+                else if constexpr (std::is_same_v<T, double>) x = std::strtod(buf, &stop);
+                else x = std::strtold(buf, &stop);
+                if (stop == buf || (errno == ERANGE && std::isinf(x))) return false;
+                val = x;
+                p += stop - buf;
+                return true;
+            }
+#endif
+        };
+
+        // Runs func(chunk) for chunks 0..n-1 in parallel. func returns the error
+        // position or nullptr, the first error in text order is thrown.
+        template <typename FUNC>
+        void ParseChunks(std::string_view text, size_t n, const std::string& what, FUNC func) {
+            std::vector<const char*> errors(n, nullptr);
+            ParallelRanges(n, n, [&](size_t first, size_t next) {
+                for (size_t c = first; c < next; ++c)
+                    errors[c] = func(c);
+            });
+            for (const char* err : errors)
+                if (err) throw std::runtime_error("Line " + std::to_string(LineOf(text, err)) + ": " + what);
+        }
+
+        // Formats n items in parallel chunks, func(first, next, out)
+        template <typename FUNC>
+        std::vector<std::string> FormatChunks(size_t n, size_t ntasks, FUNC func) {
+            std::vector<std::string> parts(ntasks);
+            ParallelRanges(ntasks, ntasks, [&](size_t first, size_t next) {
+                for (size_t t = first; t < next; ++t) {
+                    auto [begin, end] = StaticPartition(n, t, ntasks);
+                    func(begin, end, parts[t]);
+                }
+            });
+            return parts;
+        }
+
+        inline std::string Concat(const std::vector<std::string>& parts) {
+            size_t size = 0;
+            for (auto& part : parts)
+                size += part.size();
+            std::string text;
+            text.reserve(size);
+            for (auto& part : parts)
+                text += part;
+            return text;
+        }
+    }
+
+
+    // Dense text, rows x cols from the number of data lines and the values in the first one
+    template <typename T = double, ORDERING ORD = ColMajor>
+    Matrix<T, ORD> ParseText(std::string_view text, size_t ntasks = 0) {
+        using detail::TextCursor;
+        if (ntasks == 0) ntasks = detail::TextTasks(text.size());
+        const auto cuts = detail::SplitLines(text, ntasks);
+
+        // data lines per chunk, then the first row of each chunk
+        std::vector<size_t> first_row(ntasks + 1, 0);
+        detail::ParseChunks(text, ntasks, "", [&](size_t c) -> const char* {
+            TextCursor cur{ text.data() + cuts[c], text.data() + cuts[c+1] };
+            size_t lines = 0;
+            for (; cur.p < cur.end; cur.NextLine())
+                if (!cur.SkipLine('#')) ++lines;
+            first_row[c+1] = lines;
+            return nullptr;
+        });
+        for (size_t c = 0; c < ntasks; ++c)
+            first_row[c+1] += first_row[c];
+
+        size_t cols = 0;
+        TextCursor cur{ text.data(), text.data() + text.size() };
+        while (cur.p < cur.end && cur.SkipLine('#'))
+            cur.NextLine();
+        for (T val; !cur.AtLineEnd(); ++cols)
+            if (!cur.Number(val))
+                throw std::runtime_error("Line " + std::to_string(detail::LineOf(text, cur.p)) + ": not a number");
+
+        Matrix<T, ORD> A(first_row[ntasks], cols);
+        detail::ParseChunks(text, ntasks, "expected " + std::to_string(cols) + " numbers", [&](size_t c) -> const char* {
+            TextCursor cur{ text.data() + cuts[c], text.data() + cuts[c+1] };
+            for (size_t i = first_row[c]; cur.p < cur.end; cur.NextLine()) {
+                if (cur.SkipLine('#')) continue;
+                for (size_t j = 0; j < cols; ++j)
+                    if (!cur.Number(A(i, j))) return cur.p;
+                if (!cur.AtLineEnd()) return cur.p;
+                ++i;
+            }
+            return nullptr;
+        });
+        return A;
+    }
+
+    template <typename T = double, ORDERING ORD = ColMajor>
+    Matrix<T, ORD> ReadText(const std::string& filename, size_t ntasks = 0) {
+        return ParseText<T, ORD>(detail::ReadFile(filename), ntasks);
+    }
+
+    namespace detail {
+        template <typename T, ORDERING ORD>
+        std::vector<std::string> FormatTextParts(const MatrixView<T, ORD>& A, int precision, char separator) {
+            return FormatChunks(A.Rows(), TextTasks(A.Rows() * A.Cols() * 16), [&](size_t first, size_t next, std::string& out) {
+                for (size_t i = first; i < next; ++i) {
+                    for (size_t j = 0; j < A.Cols(); ++j) {
+                        if (j > 0) out += separator;
+                        AppendNumber(out, A(i, j), precision);
+                    }
+                    out += '\n';
+                }
+            });
+        }
+    }
+
+    // One row per line. precision < 0: shortest form that reads back exactly, otherwise %g
+    template <typename T, ORDERING ORD>
+    std::string FormatText(const MatrixView<T, ORD>& A, int precision = -1, char separator = ' ') {
+        return detail::Concat(detail::FormatTextParts(A, precision, separator));
+    }
+
+    template <typename T, ORDERING ORD>
+    void WriteText(const std::string& filename, const MatrixView<T, ORD>& A, int precision = -1, char separator = ' ') {
+        detail::WriteFile(filename, detail::FormatTextParts(A, precision, separator));
+    }
+
+
+    // Matrix Market banner and size line
+    struct MatrixMarketInfo {
+        bool coordinate = true;      // false: array (dense, column by column)
+        std::string field;           // real, double, integer, pattern
+        std::string symmetry;        // general, symmetric, skew-symmetric
+        size_t rows = 0, cols = 0, entries = 0;
+        size_t data_offset = 0;      // first byte after the size line
+    };
+
+    inline MatrixMarketInfo ParseMatrixMarketHeader(std::string_view text) {
+        MatrixMarketInfo info;
+        size_t eol = text.find('\n');
+        std::string banner(text.substr(0, eol));
+        std::transform(banner.begin(), banner.end(), banner.begin(), [](unsigned char c) { return std::tolower(c); });
+
+        std::vector<std::string> words;
+        for (size_t pos = 0; pos < banner.size(); ) {
+            size_t start = banner.find_first_not_of(" \t\r", pos);
+            if (start == std::string::npos) break;
+            size_t stop = std::min(banner.find_first_of(" \t\r", start), banner.size());
+            words.push_back(banner.substr(start, stop - start));
+            pos = stop;
+        }
+        if (words.size() != 5 || words[0] != "%%matrixmarket" || words[1] != "matrix")
+            throw std::runtime_error("Not a Matrix Market matrix file");
+        if (words[2] != "coordinate" && words[2] != "array")
+            throw std::runtime_error("Unknown Matrix Market format " + words[2]);
+        info.coordinate = words[2] == "coordinate";
+        info.field = words[3];
+        info.symmetry = words[4];
+        if (info.field != "real" && info.field != "double" && info.field != "integer" && info.field != "pattern")
+            throw std::runtime_error("Unsupported Matrix Market field " + info.field);
+        if (info.symmetry != "general" && info.symmetry != "symmetric" && info.symmetry != "skew-symmetric")
+            throw std::runtime_error("Unsupported Matrix Market symmetry " + info.symmetry);
+        if (info.field == "pattern" && !info.coordinate)
+            throw std::runtime_error("Matrix Market pattern files must be in coordinate format");
+
+        detail::TextCursor cur{ text.data() + std::min(eol, text.size()), text.data() + text.size() };
+        cur.NextLine();
+        while (cur.p < cur.end && cur.SkipLine('%'))
+            cur.NextLine();
+        if (!cur.Number(info.rows) || !cur.Number(info.cols)
+            || (info.coordinate && !cur.Number(info.entries)) || !cur.AtLineEnd())
+            throw std::runtime_error("Line " + std::to_string(detail::LineOf(text, cur.p)) + ": invalid size line");
+        if (!info.coordinate)
+            info.entries = (info.symmetry == "general") ? info.rows * info.cols
+                : (info.symmetry == "symmetric") ? info.rows * (info.rows + 1) / 2 : info.rows * (info.rows - 1) / 2;
+        if (info.symmetry != "general" && info.rows != info.cols)
+            throw std::runtime_error("Symmetric Matrix Market matrix must be square");
+        cur.NextLine();
+        info.data_offset = cur.p - text.data();
+        return info;
+    }
+
+    namespace detail {
+        // Triplets of a coordinate file, symmetric entries mirrored
+        template <typename T>
+        struct MarketTriplets {
+            std::vector<size_t> rows, cols;
+            std::vector<T> vals;
+            size_t entries = 0;     // lines read
+        };
+
+        template <typename T>
+        std::vector<MarketTriplets<T>> ParseMarketCoordinates(std::string_view text, const MatrixMarketInfo& info, size_t ntasks) {
+            const std::string_view data = text.substr(info.data_offset);
+            if (ntasks == 0) ntasks = TextTasks(data.size());
+            const auto cuts = SplitLines(data, ntasks);
+            const bool pattern = info.field == "pattern";
+            const bool mirror = info.symmetry != "general";
+            const T sign = (info.symmetry == "skew-symmetric") ? T(-1) : T(1);
+
+            std::vector<MarketTriplets<T>> parts(ntasks);
+            ParseChunks(text, ntasks, "invalid entry", [&](size_t c) -> const char* {
+                TextCursor cur{ data.data() + cuts[c], data.data() + cuts[c+1] };
+                auto& part = parts[c];
+                const size_t expected = (info.entries * (cuts[c+1] - cuts[c])) / std::max<size_t>(1, data.size()) + 16;
+                part.rows.reserve(expected);
+                part.cols.reserve(expected);
+                part.vals.reserve(expected);
+                for (; cur.p < cur.end; cur.NextLine()) {
+                    if (cur.SkipLine('%')) continue;
+                    size_t i, j;
+                    T val = T(1);
+                    if (!cur.Number(i) || !cur.Number(j) || (!pattern && !cur.Number(val)) || !cur.AtLineEnd()
+                        || i < 1 || i > info.rows || j < 1 || j > info.cols)
+                        return cur.p;
+                    part.rows.push_back(i-1);
+                    part.cols.push_back(j-1);
+                    part.vals.push_back(val);
+                    ++part.entries;
+                    if (mirror && i != j) {
+                        part.rows.push_back(j-1);
+                        part.cols.push_back(i-1);
+                        part.vals.push_back(sign * val);
+                    }
+                }
+                return nullptr;
+            });
+            return parts;
+        }
+    }
+
+    // Coordinate file into CSR, duplicates are summed
+    template <typename T = double>
+    SparseMatrix<T> ParseMatrixMarket(std::string_view text, size_t ntasks = 0) {
+        const MatrixMarketInfo info = ParseMatrixMarketHeader(text);
+        if (!info.coordinate)
+            throw std::runtime_error("Matrix Market array file, use ReadMatrixMarketDense");
+        auto parts = detail::ParseMarketCoordinates<T>(text, info, ntasks);
+
+        SparseMatrixBuilder<T> builder(info.rows, info.cols);
+        size_t total = 0, stored = 0;
+        for (auto& part : parts)
+            total += part.vals.size();
+        builder.Reserve(total);
+        for (auto& part : parts) {
+            for (size_t k = 0; k < part.vals.size(); ++k)
+                builder.Add(part.rows[k], part.cols[k], part.vals[k]);
+            stored += part.entries;
+        }
+        if (stored != info.entries)
+            throw std::runtime_error("Matrix Market file has " + std::to_string(stored) + " entries, expected "
+                                     + std::to_string(info.entries));
+        return builder.Build();
+    }
+
+    template <typename T = double>
+    SparseMatrix<T> ReadMatrixMarket(const std::string& filename, size_t ntasks = 0) {
+        return ParseMatrixMarket<T>(detail::ReadFile(filename), ntasks);
+    }
+
+    // Array or coordinate file into a dense matrix
+    template <typename T = double, ORDERING ORD = ColMajor>
+    Matrix<T, ORD> ParseMatrixMarketDense(std::string_view text, size_t ntasks = 0) {
+        using detail::TextCursor;
+        const MatrixMarketInfo info = ParseMatrixMarketHeader(text);
+        Matrix<T, ORD> A(info.rows, info.cols);
+        A = T(0);
+
+        if (info.coordinate) {
+            size_t stored = 0;
+            for (auto& part : detail::ParseMarketCoordinates<T>(text, info, ntasks)) {
+                for (size_t k = 0; k < part.vals.size(); ++k)
+                    A(part.rows[k], part.cols[k]) += part.vals[k];
+                stored += part.entries;
+            }
+            if (stored != info.entries)
+                throw std::runtime_error("Matrix Market file has " + std::to_string(stored) + " entries, expected "
+                                         + std::to_string(info.entries));
+            return A;
+        }
+
+        // values column by column (lower triangle for symmetric), counted per chunk first
+        const std::string_view data = text.substr(info.data_offset);
+        if (ntasks == 0) ntasks = detail::TextTasks(data.size());
+        const auto cuts = detail::SplitLines(data, ntasks);
+        std::vector<size_t> first(ntasks + 1, 0);
+        detail::ParseChunks(text, ntasks, "not a number", [&](size_t c) -> const char* {
+            TextCursor cur{ data.data() + cuts[c], data.data() + cuts[c+1] };
+            T val;
+            for (; cur.p < cur.end; cur.NextLine()) {
+                if (cur.SkipLine('%')) continue;
+                while (!cur.AtLineEnd()) {
+                    if (!cur.Number(val)) return cur.p;
+                    ++first[c+1];
+                }
+            }
+            return nullptr;
+        });
+        for (size_t c = 0; c < ntasks; ++c)
+            first[c+1] += first[c];
+        if (first[ntasks] != info.entries)
+            throw std::runtime_error("Matrix Market file has " + std::to_string(first[ntasks]) + " entries, expected "
+                                     + std::to_string(info.entries));
+
+        std::vector<T> vals(info.entries);
+        detail::ParseChunks(text, ntasks, "not a number", [&](size_t c) -> const char* {
+            TextCursor cur{ data.data() + cuts[c], data.data() + cuts[c+1] };
+            for (size_t k = first[c]; cur.p < cur.end; cur.NextLine()) {
+                if (cur.SkipLine('%')) continue;
+                while (!cur.AtLineEnd())
+                    if (!cur.Number(vals[k++])) return cur.p;
+            }
+            return nullptr;
+        });
+
+        if (info.symmetry == "general") {
+            for (size_t j = 0, k = 0; j < info.cols; ++j)
+                for (size_t i = 0; i < info.rows; ++i)
+                    A(i, j) = vals[k++];
+        }
+        else {
+            const bool skew = info.symmetry == "skew-symmetric";
+            for (size_t j = 0, k = 0; j < info.cols; ++j)
+                for (size_t i = skew ? j + 1 : j; i < info.rows; ++i, ++k) {
+                    A(i, j) = vals[k];
+                    A(j, i) = skew ? -vals[k] : vals[k];
+                }
+        }
+        return A;
+    }
+
+    template <typename T = double, ORDERING ORD = ColMajor>
+    Matrix<T, ORD> ReadMatrixMarketDense(const std::string& filename, size_t ntasks = 0) {
+        return ParseMatrixMarketDense<T, ORD>(detail::ReadFile(filename), ntasks);
+    }
+
+    namespace detail {
+        template <typename T>
+        const char* MarketField() { return std::is_integral_v<T> ? "integer" : "real"; }
+    }
+
+    // Coordinate format, general symmetry
+    template <typename T>
+    void WriteMatrixMarket(const std::string& filename, const SparseMatrixView<T>& A, int precision = -1) {
+        std::string head = std::string("%%MatrixMarket matrix coordinate ") + detail::MarketField<T>() + " general\n";
+        head += std::to_string(A.Rows()) + " " + std::to_string(A.Cols()) + " " + std::to_string(A.NonZeros()) + "\n";
+        auto parts = detail::FormatChunks(A.Rows(), detail::TextTasks(A.NonZeros() * 24), [&](size_t first, size_t next, std::string& out) {
+            for (size_t i = first; i < next; ++i)
+                for (size_t k = A.RowPtr()[i]; k < A.RowPtr()[i+1]; ++k) {
+                    detail::AppendNumber(out, i + 1);
+                    out += ' ';
+                    detail::AppendNumber(out, A.ColIndices()[k] + 1);
+                    out += ' ';
+                    detail::AppendNumber(out, A.Values()[k], precision);
+                    out += '\n';
+                }
+        });
+        parts.insert(parts.begin(), head);
+        detail::WriteFile(filename, parts);
+    }
+
+    // Array format, general symmetry
+    template <typename T, ORDERING ORD>
+    void WriteMatrixMarket(const std::string& filename, const MatrixView<T, ORD>& A, int precision = -1) {
+        std::string head = std::string("%%MatrixMarket matrix array ") + detail::MarketField<T>() + " general\n";
+        head += std::to_string(A.Rows()) + " " + std::to_string(A.Cols()) + "\n";
+        auto parts = detail::FormatChunks(A.Cols(), detail::TextTasks(A.Rows() * A.Cols() * 16), [&](size_t first, size_t next, std::string& out) {
+            for (size_t j = first; j < next; ++j)
+                for (size_t i = 0; i < A.Rows(); ++i) {
+                    detail::AppendNumber(out, A(i, j), precision);
+                    out += '\n';
+                }
+        });
+        parts.insert(parts.begin(), head);
+        detail::WriteFile(filename, parts);
+    }
+}
+
+#endif
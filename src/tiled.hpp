@@ -0,0 +1,107 @@
+#ifndef FILE_TILED
+#define FILE_TILED
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "matrix.hpp"
+#include "profile.hpp"
+#include "taskgraph.hpp"
+
+// Tiled factorizations on the task graph runtime. The matrix is split into
+// square tiles, every step of the algorithm becomes one task per tile, and the
+// trailing updates of step k overlap with the panel of step k+1.
+
+namespace Mathlib {
+
+    // Default tile size of the tiled factorizations, a multiple of the AddMatMat block
+    constexpr size_t FACTOR_TILE = 192;
+
+    namespace detail {
+        // thrown by a tile task to stop the graph, not visible outside
+        struct NotPositiveDefinite { };
+    }
+
+    // Cholesky factorization A = L L^T of a symmetric positive definite matrix.
+    // Reads the lower triangle of a and overwrites it with L, the strictly upper
+    // triangle is not referenced (like Lapack's dpotrf with 'L').
+    // Returns 0, or k > 0 if the leading minor of order k is not positive definite.
+    //
+    // Per step k: POTRF of the diagonal tile, TRSM of the tiles below it, then
+    // SYRK and GEMM updates of the trailing tiles. The GEMM updates run on the
+    // AddMatMat kernel; the TRSM tasks also store -L_ik^T, so that every update
+    // is a plain C += A*B on column-major tiles.
+    inline integer TiledCholesky(MatrixView<double, ColMajor> a, size_t tile = FACTOR_TILE, size_t ntasks = DEFAULT_NTASKS) {
+        if (a.Rows() != a.Cols()) throw std::invalid_argument("Cholesky factorization needs a square matrix");
+        if (tile == 0) throw std::invalid_argument("Tile size must be positive");
+        const size_t n = a.Rows();
+        MATHLIB_PROFILE_SCOPE("TiledCholesky", double(n) * n * n / 3.0, 8.0 * n * n);
+        const size_t nt = (n + tile - 1) / tile;
+        auto first = [&](size_t i) { return i * tile; };
+        auto next = [&](size_t i) { return std::min(n, (i + 1) * tile); };
+        auto A = [&](size_t i, size_t j) {
+            return a.RowRange(first(i), next(i)).ColRange(first(j), next(j));
+        };
+
+        // neg[i*nt+k] = -L_ik^T for i > k, empty otherwise
+        std::vector<Matrix<double, ColMajor>> neg;
+        neg.reserve(nt * nt);
+        for (size_t i = 0; i < nt; ++i)
+            for (size_t k = 0; k < nt; ++k) {
+                if (i > k) neg.emplace_back(next(k) - first(k), next(i) - first(i));
+                else neg.emplace_back(0, 0);
+            }
+
+        std::atomic<integer> info{ 0 };
+        TaskGraph graph;
+        // tasks writing column j have priority -j: the next panel runs ahead of later columns
+        for (size_t k = 0; k < nt; ++k) {
+            graph.Add([&, k]() {
+                MatrixView<double, ColMajor> akk = A(k, k);
+                char uplo = 'L';
+                integer nk = integer(akk.Rows()), lda = integer(akk.Dist()), err = 0;
+                dpotrf_(&uplo, &nk, akk.Data(), &lda, &err);
+                if (err > 0) {
+                    info = integer(first(k)) + err;
+                    throw detail::NotPositiveDefinite();
+                }
+            }, { }, { &a(first(k), first(k)) }, -int(k));
+
+            for (size_t i = k + 1; i < nt; ++i)
+                graph.Add([&, i, k]() {
+                    MatrixView<double, ColMajor> lkk = A(k, k), aik = A(i, k);
+                    char side = 'R', uplo = 'L', trans = 'T', diag = 'N';
+                    integer m = integer(aik.Rows()), nk = integer(aik.Cols());
+                    integer lda = integer(lkk.Dist()), ldb = integer(aik.Dist());
+                    double one = 1.0;
+                    dtrsm_(&side, &uplo, &trans, &diag, &m, &nk, &one, lkk.Data(), &lda, aik.Data(), &ldb);
+                    neg[i * nt + k] = -1.0 * aik.Transpose();
+                }, { &a(first(k), first(k)) }, { &a(first(i), first(k)), neg[i * nt + k].Data() }, -int(k));
+
+            for (size_t j = k + 1; j < nt; ++j) {
+                graph.Add([&, j, k]() {
+                    MatrixView<double, ColMajor> ljk = A(j, k), ajj = A(j, j);
+                    char uplo = 'L', trans = 'N';
+                    integer nj = integer(ajj.Rows()), nk = integer(ljk.Cols());
+                    integer lda = integer(ljk.Dist()), ldc = integer(ajj.Dist());
+                    double minus = -1.0, one = 1.0;
+                    dsyrk_(&uplo, &trans, &nj, &nk, &minus, ljk.Data(), &lda, &one, ajj.Data(), &ldc);
+                }, { &a(first(j), first(k)) }, { &a(first(j), first(j)) }, -int(j));
+
+                for (size_t i = j + 1; i < nt; ++i)
+                    graph.Add([&, i, j, k]() {
+                        AddMatMat(A(i, k), neg[j * nt + k], A(i, j));
+                    }, { &a(first(i), first(k)), neg[j * nt + k].Data() }, { &a(first(i), first(j)) }, -int(j));
+            }
+        }
+
+        try {
+            graph.Run(ntasks);
+        }
+        catch (detail::NotPositiveDefinite&) { }
+        return info;
+    }
+}
+
+#endif
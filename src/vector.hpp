@@ -3,9 +3,15 @@
 
 #include "mathlib.hpp"
 #include "expression.hpp"
+#include "memory.hpp"
+#include "partition.hpp"
+#include "format.hpp"
 
 namespace Mathlib
 {
+	template <typename TM, typename EV>
+	class SparseMatVecExpr;
+
 	template<typename T, typename TDIST = std::integral_constant<size_t, 1>>
 	class VectorView : public VecExpr<VectorView<T, TDIST>> {
 	protected:
@@ -29,12 +35,40 @@ namespace Mathlib
 			return *this;
 		}
 
+		// Assignment from sparse matrix-vector product, see sparse_matrix.hpp
+		template<typename TM, typename EV>
+		VectorView& operator=(const SparseMatVecExpr<TM, EV>& expr) {
+			MultSparseMatVec(expr.Mat(), expr.Vec(), *this);
+			return *this;
+		}
+
 		VectorView& operator=(T scal) {
 			for (size_t i = 0; i < size; ++i)
 				data[dist*i] = scal;
 			return *this;
 		}
 
+		// In-place updates, one pass over the data without temporaries
+		template<typename E>
+		VectorView& operator+=(const VecExpr<E>& other) {
+			for (size_t i = 0; i < size; ++i)
+				data[dist*i] += other(i);
+			return *this;
+		}
+
+		template<typename E>
+		VectorView& operator-=(const VecExpr<E>& other) {
+			for (size_t i = 0; i < size; ++i)
+				data[dist*i] -= other(i);
+			return *this;
+		}
+
+		VectorView& operator*=(T scal) {
+			for (size_t i = 0; i < size; ++i)
+				data[dist*i] *= scal;
+			return *this;
+		}
+
 		T* Data() const { return data; }
 		size_t Size() const { return size; }
 		auto Dist() const { return dist; }
@@ -71,26 +105,52 @@ namespace Mathlib
 		typedef VectorView<T> BASE;
 		using BASE::size;
 		using BASE::data;
+		Allocator* alloc;   // owner of data
+		size_t capacity;    // allocated elements, >= size
 
-	public:
-		Vector(size_t size_) : VectorView<T>() { 
-			size = size_; 
-			T* data_;
-			try {
-				data_ = new T[size_];
-			} catch (std::bad_alloc&) {
-				throw std::runtime_error("Memory allocation failed");
+		void Swap(Vector& other) {
+			std::swap(size, other.size);
+			std::swap(data, other.data);
+			std::swap(alloc, other.alloc);
+			std::swap(capacity, other.capacity);
+		}
+
+		template <typename FUNC>
+		void FillParallel(FUNC f) {
+			ParallelRanges(size, InitTasks(size), [&](size_t first, size_t next) {
+				for (size_t i = first; i < next; ++i)
+					data[i] = f(i);
+			});
+		}
+
+		template <typename E>
+		Vector& AssignResized(const E& other) {
+			const size_t n = other.Size();
+			if (n > capacity) {
+				// evaluate before releasing the old buffer, other may refer to it
+				Vector tmp(n, *alloc);
+				tmp.BASE::operator=(other);
+				Swap(tmp);
+				return *this;
 			}
-			*this = VectorView<T>(size, data_);
+			size = n;
+			BASE::operator=(other);
+			return *this;
 		}
 
+	public:
+		// Cache-line aligned storage from the current allocator, see memory.hpp.
+		// Elements of trivial types are left uninitialized and the pages untouched.
+		Vector(size_t size_) : Vector(size_, CurrentAllocator()) { }
+
+		Vector(size_t size_, Allocator& _alloc) : VectorView<T>(size_, AllocateBuffer<T>(size_, _alloc)), alloc(&_alloc), capacity(size_) { }
+
 		Vector(const Vector& other) : Vector(other.Size()) {
 			*this = other;
 		}
 
-		Vector(Vector&& other) : VectorView<T>(0, nullptr) {
-			std::swap(size, other.size);
-			std::swap(data, other.data);
+		Vector(Vector&& other) : VectorView<T>(0, nullptr), alloc(other.alloc), capacity(0) {
+			Swap(other);
 		}
 
 		template <typename T2>
@@ -98,30 +158,96 @@ namespace Mathlib
 			*this = other;
 		}
 
+		// Parallel first touch: each task fills the part it owns under StaticPartition
+		Vector(size_t size_, T_Parallel, const T& val) : Vector(size_) {
+			FillParallel([&](size_t) { return val; });
+		}
+
+		template <typename FUNC, typename = std::enable_if_t<std::is_invocable_v<FUNC, size_t>>>
+		Vector(size_t size_, T_Parallel, FUNC gen) : Vector(size_) {   // i -> value
+			FillParallel(gen);
+		}
+
+		template <typename E>
+		Vector(T_Parallel, const VecExpr<E>& expr) : Vector(expr.Size()) {
+			FillParallel([&](size_t i) { return expr(i); });
+		}
+
+		size_t Capacity() const { return capacity; }
+
+		// Grows the storage to at least n elements, keeping the values
+		void Reserve(size_t n) {
+			if (n <= capacity) return;
+			Vector tmp(n, *alloc);
+			for (size_t i = 0; i < size; ++i)
+				tmp.data[i] = std::move(data[i]);
+			tmp.size = size;
+			Swap(tmp);
+		}
+
+		// Keeps the first min(n, Size()) values, reallocates only if n > Capacity()
+		void Resize(size_t n) {
+			Reserve(n);
+			size = n;
+		}
+
+		// Assignments resize to the right-hand side and reuse the storage if it is large enough
+
 		using BASE::operator=;
+		template <typename E>
+		Vector& operator=(const VecExpr<E>& other) {
+			return AssignResized(other);
+		}
+
+		// Sparse matrix-vector product, resized like any other expression
+		template<typename TM, typename EV>
+		Vector& operator=(const SparseMatVecExpr<TM, EV>& expr) {
+			return AssignResized(expr);
+		}
+
+		// Copies the values (VectorView's own assignment would rebind the pointer)
+		Vector& operator=(const VectorView<T>& other) {
+			if (other.Data() == data && other.Size() == size) return *this;
+			return *this = static_cast<const VecExpr<VectorView<T>>&>(other);
+		}
+
 		Vector& operator=(const Vector& other) {
-			size = other.size;
-			for (size_t i = 0; i < size; i++)
-				data[i] = other(i);
-			return *this;
+			if (this == &other) return *this;
+			return *this = static_cast<const VectorView<T>&>(other);
 		}
 
 		Vector& operator=(Vector&& other) {
 			if (this == &other) return *this; // self-assignment check
-			delete[] data;
-			size = other.size;
-			data = other.data;
-			other.size = 0;
-			other.data = nullptr;
+			FreeBuffer(data, capacity, *alloc);
+			data = nullptr;
+			size = capacity = 0;
+			Swap(other);
 			return *this;
 		}
 
-		~Vector() { delete[] data; }
+		Allocator& GetAllocator() const { return *alloc; }
+
+		~Vector() { FreeBuffer(data, capacity, *alloc); }
 	};
 
 
 	template <typename T, typename TDIST>
 	std::ostream& operator<<(std::ostream& os, const VectorView<T, TDIST>& v) {
+		if (detail::FastFormattable<T>(os)) {
+			// format into a buffer, written in blocks
+			std::string buf;
+			const int prec = int(os.precision());
+			for (size_t i = 0; i < v.Size(); ++i) {
+				if (i > 0) buf += ", ";
+				detail::AppendNumber(buf, v(i), prec);
+				if (buf.size() >= 4096) {
+					os.write(buf.data(), buf.size());
+					buf.clear();
+				}
+			}
+			return os.write(buf.data(), buf.size());
+		}
+
 		if (v.Size() > 0)
 			os << v(0);
 		for (size_t i = 1; i < v.Size(); ++i)
@@ -0,0 +1,115 @@
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/async.hpp"
+using namespace Mathlib;
+
+
+static bool Close(const MatrixView<double, RowMajor>& x, const MatrixView<double, RowMajor>& y) {
+	for (size_t i = 0; i < x.Rows(); ++i)
+		for (size_t j = 0; j < x.Cols(); ++j)
+			if (std::abs(x(i, j) - y(i, j)) > 1e-9) return false;
+	return true;
+}
+
+
+TEST_CASE( "asynchronous products" ) {
+	const size_t n = 120;
+	Matrix<double, RowMajor> A(n, n), B(n, n), C(n, n), D(n, n), E(n, n), F(n, n);
+	for (size_t i = 0; i < n; ++i)
+		for (size_t j = 0; j < n; ++j) {
+			A(i, j) = 1.0 / (1.0 + double(i + j));
+			B(i, j) = double(i % 5) - double(j % 3);
+		}
+
+	// C = A*B, then E = C*A and F = B*A: E has to wait for C, F does not
+	auto hc = (A * B | Async).Into(C);
+	auto he = (C * A | Async).Into(E);
+	auto hf = (B * A | Async).Into(F);
+	he.Wait();
+	REQUIRE(hc.Ready());
+	hf.Wait();
+	REQUIRE(he.Ready());
+
+	Matrix<double, RowMajor> expected(n, n);
+	MultMatMatSmall(A, B, MatrixView<double, RowMajor>(expected));
+	REQUIRE(Close(C, expected));
+	MultMatMatSmall(C, A, MatrixView<double, RowMajor>(expected));
+	REQUIRE(Close(E, expected));
+	MultMatMatSmall(B, A, MatrixView<double, RowMajor>(expected));
+	REQUIRE(Close(F, expected));
+
+	// overwriting a factor waits for the products reading it
+	(A * B | Async).Into(D);
+	(B * B | Async).Into(A);
+	AsyncWait(A);
+	MultMatMatSmall(B, B, MatrixView<double, RowMajor>(expected));
+	REQUIRE(Close(A, expected));
+	AsyncWaitAll();
+
+	REQUIRE(AsyncHandle().Ready());
+	REQUIRE_THROWS_AS((A * B | Async).Into(C.RowRange(0, 10)), std::invalid_argument);
+	REQUIRE_THROWS_AS((A * B | Async).Into(A), std::invalid_argument);
+}
+
+
+TEST_CASE( "parallel kernels while the worker pool is busy" ) {
+	// products on background threads and on the calling thread share one pool
+	const size_t n = 300;
+	Matrix<double, RowMajor> A(n, n), B(n, n), expected(n, n);
+	for (size_t i = 0; i < n; ++i)
+		for (size_t j = 0; j < n; ++j) {
+			A(i, j) = double((i + 2*j) % 7) - 3.0;
+			B(i, j) = double((3*i + j) % 5) - 2.0;
+		}
+	MultMatMatSmall(A, B, MatrixView<double, RowMajor>(expected));
+
+	std::vector<Matrix<double, RowMajor>> C;
+	for (int k = 0; k < 4; ++k)
+		C.emplace_back(n, n);
+	for (auto& c : C)
+		(A * B | Async).Into(c);
+	Matrix<double, ColMajor> Ac(n, n), Bc(n, n), Dc(n, n);
+	Ac = A;
+	Bc = B;
+	Dc = 0.0;
+	AddMatMatParallel(Ac, Bc, Dc, 4);
+	AsyncWaitAll();
+	for (auto& c : C)
+		REQUIRE(Close(c, expected));
+	Matrix<double, RowMajor> D(n, n);
+	D = Dc;
+	REQUIRE(Close(D, expected));
+
+	// parallel loops started from several threads at once
+	std::vector<std::thread> threads;
+	std::vector<std::vector<int>> counts(4, std::vector<int>(5000, 0));
+	for (auto& cnt : counts)
+		threads.emplace_back([&cnt]() {
+			for (int rep = 0; rep < 50; ++rep)
+				ParallelFor(cnt.size(), 4, [&](size_t first, size_t next) {
+					for (size_t i = first; i < next; ++i) cnt[i]++;
+				});
+		});
+	for (auto& t : threads) t.join();
+	for (auto& cnt : counts)
+		for (int c : cnt)
+			REQUIRE(c == 50);
+
+	// a region opened while the pool is taken runs on the calling thread
+	WorkerPoolLease outer;
+	REQUIRE(bool(outer));
+	WorkerPoolLease inner;
+	REQUIRE(!inner);
+	std::vector<int> hit(1000, 0);
+	ParallelFor(hit.size(), 4, [&](size_t first, size_t next) {
+		for (size_t i = first; i < next; ++i) hit[i]++;
+	});
+	for (int h : hit)
+		REQUIRE(h == 1);
+}
@@ -0,0 +1,90 @@
+#include <cmath>
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/batched.hpp"
+using namespace Mathlib;
+
+
+TEST_CASE( "batched products" ) {
+	// small and large items, with a fixed number of tasks and automatically
+	for (size_t ntasks : { size_t(0), size_t(4) }) {
+		std::vector<Matrix<double>> A, B, C;
+		std::vector<MatrixView<double>> a, b, c;
+		const size_t sizes[] = { 4, 4, 3, 40, 1, 4, 64 };
+		for (size_t n : sizes) {
+			A.emplace_back(n, n + 1);
+			B.emplace_back(n + 1, n);
+			C.emplace_back(n, n);
+		}
+		for (size_t i = 0; i < A.size(); ++i) {
+			for (size_t r = 0; r < A[i].Rows(); ++r)
+				for (size_t s = 0; s < A[i].Cols(); ++s) {
+					A[i](r, s) = double(r + i) - 0.5 * double(s);
+					B[i](s, r) = 1.0 / (1.0 + double(r + s));
+				}
+			a.push_back(A[i]);
+			b.push_back(B[i]);
+			c.push_back(C[i]);
+		}
+
+		BatchedMultiply(a, b, c, ntasks);
+		for (size_t i = 0; i < A.size(); ++i) {
+			Matrix<double> expected(A[i].Rows(), B[i].Cols());
+			MultMatMatSmall(a[i], b[i], MatrixView<double>(expected));
+			bool same = true;
+			for (size_t r = 0; r < expected.Rows(); ++r)
+				for (size_t s = 0; s < expected.Cols(); ++s)
+					same = same && std::abs(C[i](r, s) - expected(r, s)) < 1e-10;
+			REQUIRE(same);
+		}
+	}
+
+	std::vector<MatrixView<double>> one(1), two(2);
+	REQUIRE_THROWS_AS(BatchedMultiply(one, two, two), std::invalid_argument);
+}
+
+
+TEST_CASE( "batched solve and dot" ) {
+	const size_t batch = 50;
+	std::vector<Matrix<double, RowMajor>> A;
+	std::vector<Vector<double>> X, B, Y;
+	std::vector<MatrixView<double, RowMajor>> a;
+	std::vector<VectorView<double, size_t>> x, b, y;
+	for (size_t i = 0; i < batch; ++i) {
+		const size_t n = (i == 7) ? 40 : 1 + i % 5;   // one item takes the Lapack path
+		A.emplace_back(n, n);
+		B.emplace_back(n);
+		X.emplace_back(n);
+		for (size_t r = 0; r < n; ++r) {
+			B[i](r) = double(r) + 1.0;
+			for (size_t s = 0; s < n; ++s)
+				A[i](r, s) = (r == s) ? 0.5 : 1.0 / (2.0 + double(r + 2 * s + i));
+		}
+	}
+	// a singular item
+	A[3] = 1.0;
+	for (size_t i = 0; i < batch; ++i) {
+		a.push_back(A[i]);
+		b.push_back(B[i]);
+		x.push_back(X[i]);
+	}
+
+	auto info = BatchedSolve(a, b, x, 4);
+	REQUIRE(info[3] > 0);
+	for (size_t i = 0; i < batch; ++i) {
+		if (i == 3) continue;
+		REQUIRE(info[i] == 0);
+		Vector<double> r(B[i].Size());
+		r = A[i] * X[i] - B[i];
+		double err = 0;
+		for (size_t k = 0; k < r.Size(); ++k)
+			err = std::max(err, std::abs(r(k)));
+		REQUIRE(err < 1e-10);
+	}
+
+	auto dots = BatchedDot(b, x);
+	REQUIRE(dots.size() == batch);
+	REQUIRE(std::abs(dots[10] - Dot(B[10], X[10])) < 1e-12);
+}
@@ -0,0 +1,41 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/matrix.hpp"
+#include "../src/hugepages.hpp"
+using namespace Mathlib;
+
+
+TEST_CASE( "huge page allocator" ) {
+	HugePageAllocator thp;
+
+	{
+		Matrix<double> A(1024, 1024, thp);       // 8 MB
+		Vector<double> x(100, thp);              // small, from the heap
+		REQUIRE(IsAligned(A.Data(), HUGE_PAGE_SIZE));
+		REQUIRE(IsAligned(x.Data(), CACHE_LINE));
+
+		A = 1.0;
+		x = 2.0;
+		REQUIRE(A(1023, 1023) == 1.0);
+
+		auto stats = thp.Stats();
+		REQUIRE(stats.allocations == 1);
+		REQUIRE(stats.explicit_bytes == 0);
+
+		// depends on the system setting (/sys/kernel/mm/transparent_hugepage/enabled)
+		size_t backed = thp.BackedBytes();
+		REQUIRE(backed <= 8u << 20);
+		REQUIRE(HugePageBytes(A.Data(), 8u << 20) == backed);
+	}
+	REQUIRE(thp.BackedBytes() == 0);
+
+	// Explicit huge pages fall back to transparent ones if the pool is empty
+	HugePageAllocator explicit_pages(HugePageMode::Explicit);
+	Vector<double> y(3 << 18, explicit_pages);   // 6 MB
+	y = 3.0;
+	REQUIRE(y(y.Size()-1) == 3.0);
+	auto stats = explicit_pages.Stats();
+	REQUIRE(stats.allocations == 1);
+	REQUIRE(stats.explicit_bytes + stats.fallbacks * HUGE_PAGE_SIZE > 0);
+}
@@ -0,0 +1,96 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/lazy.hpp"
+using namespace Mathlib;
+
+
+TEST_CASE( "lazy vector expressions" ) {
+	const size_t n = 1000;
+	Vector<double> a(n), b(n), c(n), d(n);
+	for (size_t i = 0; i < n; ++i) {
+		a(i) = double(i);
+		b(i) = 1.0;
+		c(i) = 0.5 * double(i);
+		d(i) = -2.0;
+	}
+	LazyVector<double> la(a), lb(b), lc(c), ld(d);
+
+	auto e = la + lb + 2.0 * lc;
+	REQUIRE(e.Terms().size() == 3);
+	Vector<double> r = e.Evaluate();
+	for (size_t i = 0; i < n; ++i)
+		REQUIRE(r(i) == 2.0 * double(i) + 1.0);
+
+	// terms on the same vector are merged
+	auto twice = la + la - 3.0 * la;
+	REQUIRE(twice.Terms().size() == 1);
+	REQUIRE(twice.Terms()[0].coef == -1.0);
+
+	// four terms take the blocked kernel, result written into one of the operands
+	auto four = la - lb + lc - 0.5 * ld;
+	four.Evaluate(a);
+	for (size_t i = 0; i < n; ++i)
+		REQUIRE(a(i) == 1.5 * double(i));
+
+	// strided operands and results, several tasks
+	Vector<double> s(2 * n);
+	LazyVector<double> even(s.Slice(0, 2)), odd(s.Slice(1, 2));
+	s = 1.0;
+	(3.0 * even - odd).Evaluate(s.Slice(1, 2), 4);
+	REQUIRE(s(0) == 1.0);
+	REQUIRE(s(1) == 2.0);
+	REQUIRE(s(2 * n - 1) == 2.0);
+
+	REQUIRE_THROWS_AS(la + LazyVector<double>(s), std::invalid_argument);
+	REQUIRE_THROWS_AS(e.Evaluate(s), std::invalid_argument);
+}
+
+
+TEST_CASE( "lazy matrix expressions" ) {
+	const size_t n = 20;
+	Matrix<double, RowMajor> A(n, n), B(n, n), C(n, n);
+	for (size_t i = 0; i < n; ++i)
+		for (size_t j = 0; j < n; ++j) {
+			A(i, j) = double(i) - double(j);
+			B(i, j) = 0.1 * double(i * j % 7);
+			C(i, j) = 1.0;
+		}
+	typedef LazyMatrix<double, RowMajor> Lazy;
+	Lazy la(A), lb(B), lc(C);
+
+	// (A+B)*(A-C) + 2B, the sums are evaluated once
+	Matrix<double, RowMajor> S(A + B), D(A - C);
+	Matrix<double, RowMajor> expected(n, n);
+	expected = S * D;
+	expected = expected + 2.0 * B;
+
+	auto e = (la + lb) * (la - lc) + 2.0 * lb;
+	REQUIRE(e.NumProducts() == 1);
+	REQUIRE(e.NumTerms() == 1);
+	Matrix<double, RowMajor> R = e.Evaluate();
+	bool same = true;
+	for (size_t i = 0; i < n; ++i)
+		for (size_t j = 0; j < n; ++j)
+			same = same && std::abs(R(i, j) - expected(i, j)) < 1e-12;
+	REQUIRE(same);
+
+	// product into one of its factors goes through a temporary
+	Matrix<double, RowMajor> P(A), Q(n, n);
+	Q = A * B;
+	(Lazy(P) * lb).Evaluate(P);
+	same = true;
+	for (size_t i = 0; i < n; ++i)
+		for (size_t j = 0; j < n; ++j)
+			same = same && std::abs(P(i, j) - Q(i, j)) < 1e-12;
+	REQUIRE(same);
+
+	// sub-matrices with a leading dimension larger than their width
+	auto left = A.ColRange(0, 5), right = B.ColRange(5, 10);
+	Matrix<double, RowMajor> T(n, 5);
+	(Lazy(left) - 3.0 * Lazy(right)).Evaluate(T);
+	REQUIRE(T(3, 4) == A(3, 4) - 3.0 * B(3, 9));
+
+	REQUIRE_THROWS_AS(Lazy(T) * la, std::invalid_argument);
+	REQUIRE_THROWS_AS(Lazy(T) + la, std::invalid_argument);
+}
@@ -0,0 +1,94 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/mapped.hpp"
+using namespace Mathlib;
+
+
+TEST_CASE( "mapped matrix" ) {
+	const std::string filename = "test_mapped_matrix.bin";
+	{
+		auto A = MappedMatrix<double, RowMajor>::Create(filename, 50, 40);
+		REQUIRE(A(49, 39) == 0.0);   // sparse file reads as zero
+		for (size_t i = 0; i < A.Rows(); ++i)
+			for (size_t j = 0; j < A.Cols(); ++j)
+				A(i, j) = double(i) + 0.01 * double(j);
+		REQUIRE(IsAligned(A.Data(), PAGE_SIZE));
+		A.Flush();
+	}
+
+	// Views, expressions and kernels work on the mapping
+	auto A = MappedMatrix<double, RowMajor>::Open(filename);
+	REQUIRE(A.Rows() == 50);
+	REQUIRE(A.Cols() == 40);
+	REQUIRE(A.Header().dtype == uint32_t(DType::Float64));
+	REQUIRE(A(3, 7) == 3.07);
+	REQUIRE(A.Row(10)(5) == 10.05);
+
+	Matrix<double, RowMajor> B(40, 20), C(50, 20);
+	B = 1.0;
+	C = A * B;
+	REQUIRE(std::abs(C(2, 0) - (40*2.0 + 0.01 * 780)) < 1e-10);
+	Vector<double> x(40), y(50);
+	x = 1.0;
+	y = A * x;
+	REQUIRE(std::abs(y(2) - C(2, 0)) < 1e-10);
+
+	// Copy-on-write changes stay private
+	{
+		auto P = MappedMatrix<double, RowMajor>::Open(filename, MapMode::CopyOnWrite);
+		P(0, 0) = 42.0;
+		REQUIRE(P(0, 0) == 42.0);
+	}
+	REQUIRE(A(0, 0) == 0.0);
+
+	// Read-write changes go to the file and are seen by other mappings
+	{
+		auto W = MappedMatrix<double, RowMajor>::Open(filename, MapMode::ReadWrite);
+		W.Row(0) = 7.0;
+	}
+	REQUIRE(A(0, 39) == 7.0);
+
+	// Wrong type or ordering
+	using ColMajorMapped = MappedMatrix<double, ColMajor>;
+	using FloatMapped = MappedMatrix<float, RowMajor>;
+	REQUIRE_THROWS_AS(ColMajorMapped::Open(filename), std::runtime_error);
+	REQUIRE_THROWS_AS(FloatMapped::Open(filename), std::runtime_error);
+	REQUIRE_THROWS_AS(MappedVector<double>::Open(filename), std::runtime_error);
+	REQUIRE_THROWS_AS(MappedMatrix<double>::Open("does_not_exist.bin"), std::runtime_error);
+
+	// A row distance whose size in bytes wraps around
+	{
+		uint64_t dist = UINT64_MAX / (50 * sizeof(double)) + 1;
+		FILE* f = std::fopen(filename.c_str(), "r+b");
+		REQUIRE(f);
+		std::fseek(f, long(offsetof(MappedHeader, dist)), SEEK_SET);
+		std::fwrite(&dist, sizeof(dist), 1, f);
+		std::fclose(f);
+	}
+	REQUIRE_THROWS_AS((MappedMatrix<double, RowMajor>::Open(filename)), std::runtime_error);
+
+	std::remove(filename.c_str());
+}
+
+
+TEST_CASE( "mapped vector" ) {
+	const std::string filename = "test_mapped_vector.bin";
+	{
+		auto v = MappedVector<float>::Create(filename, 1000);
+		Vector<float> w(1000);
+		for (size_t i = 0; i < w.Size(); ++i)
+			w(i) = float(i);
+		v = w;
+	}
+	auto v = MappedVector<float>::Open(filename);
+	REQUIRE(v.Size() == 1000);
+	REQUIRE(v(999) == 999.0f);
+	REQUIRE(Dot(v.Range(0, 3), v.Range(0, 3)) == 5.0f);
+
+	std::remove(filename.c_str());
+}
@@ -1,4 +1,5 @@
 #include <cstdint>
+#include <string>
 
 #define CATCH_CONFIG_MAIN
 #include <catch2/catch_test_macros.hpp>
@@ -123,4 +124,224 @@ TEST_CASE( "construction, copy, move, assignment" ) {
     run_1<double, RowMajor>(3, 3);
     run_1<double, ColMajor>(5, 3);
     run_1<double, RowMajor>(5, 3);
-}
\ No newline at end of file
+}
+
+
+template <ORDERING OA, ORDERING OB, ORDERING OC>
+void check_product(size_t m, size_t n, size_t k) {
+    Matrix<double, OA> A(m, k);
+    Matrix<double, OB> B(k, n);
+    Matrix<double, OC> C(m, n);
+    for (size_t i = 0; i < m; ++i)
+        for (size_t j = 0; j < k; ++j)
+            A(i, j) = 1.0 + double(i) - 0.5*double(j);
+    for (size_t i = 0; i < k; ++i)
+        for (size_t j = 0; j < n; ++j)
+            B(i, j) = double(i % 7) + 0.25*double(j);
+
+    C = 1e10;   // product must overwrite, not accumulate
+    C = A * B | Auto;
+
+    for (size_t i = 0; i < m; i += 3)
+        for (size_t j = 0; j < n; j += 3) {
+            double sum = 0;
+            for (size_t l = 0; l < k; ++l)
+                sum += A(i, l) * B(l, j);
+            REQUIRE(std::abs(C(i, j) - sum) <= 1e-9 * (1.0 + std::abs(sum)));
+        }
+}
+
+TEST_CASE( "matrix product backend dispatch" ) {
+    auto& th = GetDispatchThresholds();
+    auto saved = th;
+    th.small = 8;
+    th.parallel = 40;
+    th.lapack = 100;
+    th.threads = 4;
+
+    std::vector<MultBackend> chosen;
+    SetDispatchHook([&](MultBackend b, size_t, size_t, size_t) { chosen.push_back(b); });
+
+    check_product<ColMajor, ColMajor, ColMajor>(5, 4, 3);
+    check_product<ColMajor, ColMajor, ColMajor>(20, 20, 20);
+    check_product<RowMajor, RowMajor, RowMajor>(50, 45, 60);
+    check_product<ColMajor, ColMajor, ColMajor>(120, 110, 100);
+    check_product<RowMajor, ColMajor, ColMajor>(20, 20, 20);
+
+    REQUIRE(chosen.size() == 5);
+    REQUIRE(chosen[0] == MultBackend::Expression);
+    REQUIRE(chosen[1] == MultBackend::Native);
+    REQUIRE(chosen[2] == MultBackend::Parallel);
+    REQUIRE(chosen[3] == MultBackend::Lapack);
+    REQUIRE(chosen[4] == MultBackend::Lapack);   // mixed orderings are not handled natively
+
+    // Plain product follows the default policy
+    Matrix<double> A(30, 30), B(30, 30), C(30, 30);
+    A = 1.0;
+    B = 2.0;
+    C = A * B;
+    REQUIRE(chosen.size() == 5);
+    REQUIRE(C(3, 4) == 60.0);
+    SetDefaultMultPolicy(MultPolicy::Auto);
+    C = A * B;
+    REQUIRE(chosen.size() == 6);
+    REQUIRE(C(3, 4) == 60.0);
+    SetDefaultMultPolicy(MultPolicy::Native);
+
+    // Persisting thresholds
+    std::string filename = "dispatch_test.cfg";
+    REQUIRE(th.Save(filename));
+    DispatchThresholds loaded;
+    REQUIRE(loaded.Load(filename));
+    REQUIRE(loaded.parallel == 40);
+    REQUIRE(loaded.threads == 4);
+    std::remove(filename.c_str());
+
+    SetDispatchHook(nullptr);
+    th = saved;
+}
+
+
+TEST_CASE( "in-place updates" ) {
+    Matrix<double, RowMajor> A(4, 3), B(4, 3);
+    for (size_t i = 0; i < 4; ++i)
+        for (size_t j = 0; j < 3; ++j) {
+            A(i, j) = double(i + j);
+            B(i, j) = 1.0;
+        }
+    A += 3.0 * B;
+    A -= B;
+    A *= 2.0;
+    REQUIRE(A(0, 0) == 4.0);
+    REQUIRE(A(3, 2) == 14.0);
+
+    A.ColRange(1, 3) -= B.ColRange(0, 2);
+    REQUIRE(A(0, 0) == 4.0);
+    REQUIRE(A(0, 1) == 5.0);
+
+    // C += A*B accumulates, natively and with mixed orderings
+    Matrix<double, RowMajor> M(4, 4), C(4, 4);
+    Matrix<double, ColMajor> N(4, 4), D(4, 4);
+    M = 1.0;
+    N = 2.0;
+    C = 1.0;
+    D = 1.0;
+    C += M * M;
+    D += M * N;
+    REQUIRE(C(2, 3) == 5.0);
+    REQUIRE(D(2, 3) == 9.0);
+}
+
+
+TEST_CASE( "aligned and padded storage" ) {
+    Vector<double> v(13);
+    Matrix<double> a(7, 5);
+    REQUIRE(IsAligned(v.Data(), CACHE_LINE));
+    REQUIRE(IsAligned(a.Data(), CACHE_LINE));
+
+    // Non-trivial element types are constructed and destroyed
+    Vector<std::string> s(3);
+    s(1) = "abc";
+    REQUIRE(s(0).empty());
+    REQUIRE(s(1) == "abc");
+
+    REQUIRE(PaddedDist<double>(7) == 8);
+    REQUIRE(PaddedDist<double>(128) == 136);   // 1 KB stride is avoided
+    REQUIRE(PaddedDist<float>(100) == 112);
+
+    Matrix<double> p(128, 50, Padded);
+    Matrix<double, RowMajor> q(20, 7, Padded);
+    REQUIRE(p.Dist() == 136);
+    REQUIRE(q.Dist() == 8);
+    for (size_t i = 0; i < p.Rows(); ++i)
+        for (size_t j = 0; j < p.Cols(); ++j)
+            p(i, j) = double(i) - double(j);
+    q = 1.0;
+
+    // Copies and moves keep the leading dimension
+    Matrix<double> p2(p);
+    REQUIRE(p2.Dist() == 136);
+    REQUIRE(p2(127, 49) == 78.0);
+    Matrix<double> p3(2, 2);
+    p3 = p;
+    REQUIRE(p3.Dist() == 136);
+    REQUIRE(p3(5, 7) == -2.0);
+    Matrix<double> p4(3, 3);
+    p4 = std::move(p3);
+    REQUIRE(p4.Dist() == 136);
+    REQUIRE(p4(127, 0) == 127.0);
+
+    // Products into padded matrices
+    Matrix<double> b(50, 30), c(128, 30, Padded), cref(128, 30);
+    b = 0.5;
+    c = p * b;
+    cref = p * b | Lapack;
+    for (size_t i = 0; i < c.Rows(); ++i)
+        for (size_t j = 0; j < c.Cols(); ++j)
+            REQUIRE(std::abs(c(i, j) - cref(i, j)) < 1e-10);
+}
+
+
+// Counts calls, to check that assignments don't allocate
+class CountingAllocator : public HeapAllocator {
+public:
+    size_t allocations = 0;
+    void* Allocate(size_t bytes, size_t alignment) override {
+        ++allocations;
+        return HeapAllocator::Allocate(bytes, alignment);
+    }
+};
+
+TEST_CASE( "capacity reusing assignment" ) {
+    CountingAllocator counter;
+    ScopedAllocator use(counter);
+
+    Matrix<double> A(40, 30), B(30, 20), C(40, 20);
+    A = 1.0;
+    B = 0.5;
+    REQUIRE(counter.allocations == 3);
+
+    Matrix<double> D(40, 20);
+    for (int it = 0; it < 3; ++it) {
+        C = A * B;
+        D = C;
+        C = D + 2.0 * C;
+    }
+    REQUIRE(counter.allocations == 4);
+    REQUIRE(C(39, 19) == 45.0);
+
+    // Shrinking and growing within the capacity
+    D.Resize(10, 10);
+    REQUIRE(D.Capacity() == 800);
+    D.Resize(20, 40);
+    REQUIRE(counter.allocations == 4);
+    D.Reserve(1200);
+    REQUIRE(D.Capacity() == 1200);
+    REQUIRE(counter.allocations == 5);
+    D = A;
+    REQUIRE(D.Rows() == 40);
+    REQUIRE(D(0, 29) == 1.0);
+    REQUIRE(counter.allocations == 5);
+
+    // Assigning a view copies values instead of rebinding
+    Matrix<double> E(2, 2);
+    E = A.RowRange(0, 10).ColRange(0, 10);
+    REQUIRE(E.Rows() == 10);
+    REQUIRE(E.Data() != A.Data());
+    E = E.RowRange(2, 5);
+    REQUIRE(E.Rows() == 3);
+    REQUIRE(E(2, 9) == 1.0);
+}
+
+
+TEST_CASE( "parallel construction" ) {
+    Matrix<double> A(600, 500, Parallel, 1.0);
+    Matrix<double, RowMajor> B(500, 400, Parallel, [](size_t i, size_t j) { return double(i) - double(j); });
+    Matrix<double, RowMajor> C(Parallel, 2.0 * B);
+    REQUIRE(A(599, 499) == 1.0);
+    REQUIRE(B(10, 3) == 7.0);
+    REQUIRE(C(499, 0) == 998.0);
+
+    Matrix<double> D(3, 2, Parallel, 0.0);
+    REQUIRE(D(2, 1) == 0.0);
+}
@@ -0,0 +1,121 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "../src/matrix.hpp"
+using namespace Mathlib;
+
+
+TEST_CASE( "arena" ) {
+	Arena arena(1 << 16);
+
+	for (int round = 0; round < 3; ++round) {
+		{
+			ScopedAllocator use(arena);
+			Vector<double> x(1000), y(1000);
+			Matrix<double> A(100, 100);
+			REQUIRE(&x.GetAllocator() == &arena);
+			REQUIRE(&A.GetAllocator() == &arena);
+			REQUIRE(IsAligned(x.Data(), CACHE_LINE));
+			REQUIRE(IsAligned(y.Data(), CACHE_LINE));
+			REQUIRE(IsAligned(A.Data(), CACHE_LINE));
+
+			x = 1.0;
+			y = 2.0 * x + x;            // temporaries of the expression don't allocate
+			A = 1.0;
+			Vector<double> z = A * y;   // from the arena as well
+			REQUIRE(z(7) == 300.0);
+			REQUIRE(arena.LiveAllocations() == 4);
+		}
+		REQUIRE(arena.LiveAllocations() == 0);
+
+		// first round needs several chunks, later rounds reuse one merged chunk
+		size_t cap = arena.Capacity();
+		arena.Reset();
+		REQUIRE(arena.Capacity() == cap);
+	}
+
+	// Outside of the scope, objects come from the heap again
+	Vector<double> v(10);
+	REQUIRE(&v.GetAllocator() == &Heap());
+
+	// Objects must not outlive a reset
+	Vector<double> w(10, arena);
+	REQUIRE_THROWS_AS(arena.Reset(), std::runtime_error);
+}
+
+
+TEST_CASE( "pool allocator" ) {
+	PoolAllocator pool;
+	double* first;
+	{
+		Vector<double> v(100, pool);
+		first = v.Data();
+		REQUIRE(pool.CachedBytes() == 0);
+	}
+	REQUIRE(pool.CachedBytes() == 1024);
+
+	{
+		// same size class, recycled
+		Vector<double> v(90, pool);
+		REQUIRE(v.Data() == first);
+		REQUIRE(pool.CachedBytes() == 0);
+
+		// moved objects return their buffer to the pool they came from
+		Vector<double> h(5);
+		h = std::move(v);
+		REQUIRE(&h.GetAllocator() == &pool);
+	}
+	REQUIRE(pool.CachedBytes() == 1024);
+
+	Matrix<double> big(1000, 1000, pool);
+	REQUIRE(IsAligned(big.Data(), PAGE_SIZE));
+
+	pool.Release();
+	REQUIRE(pool.CachedBytes() == 0);
+
+	// Invert and Det use a per-thread workspace pool for their scratch matrix
+	Matrix<double> A(3, 3);
+	A = 0.0;
+	A(0, 0) = 2.0; A(1, 1) = 4.0; A(2, 2) = 8.0;
+	Matrix<double> Ainv = A.Invert();
+	REQUIRE(&Ainv.GetAllocator() == &Heap());
+	REQUIRE(Ainv(1, 1) == 0.25);
+	REQUIRE(A.Det() == 64.0);
+}
+
+
+TEST_CASE( "adopting allocator" ) {
+	// counts releases and deletion, the objects are freed on several threads
+	static std::atomic<int> released{ 0 }, deleted{ 0 };
+	struct Adopter : AdoptingAllocator {
+		using AdoptingAllocator::AdoptingAllocator;
+		void Release() override { released++; }
+		~Adopter() override { deleted++; }
+	};
+
+	for (int round = 0; round < 20; ++round) {
+		released = 0;
+		deleted = 0;
+		std::vector<double> buffer(64, 1.0);
+		auto* alloc = new Adopter(buffer.data(), buffer.size() * sizeof(double));
+		std::vector<Vector<double>> vecs;
+		vecs.reserve(8);   // the move constructor may throw, growing would copy
+		for (int k = 0; k < 8; ++k)
+			vecs.emplace_back(64, *alloc);
+		REQUIRE(vecs[0].Data() == buffer.data());
+		REQUIRE(vecs[1].Data() != buffer.data());
+
+		std::vector<std::thread> threads;
+		for (auto& v : vecs)
+			threads.emplace_back([w = std::move(v)]() mutable { Vector<double> drop(std::move(w)); });
+		for (auto& t : threads) t.join();
+		vecs.clear();
+
+		REQUIRE(released == 1);
+		REQUIRE(deleted == 1);
+	}
+}
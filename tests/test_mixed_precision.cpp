@@ -0,0 +1,104 @@
+#include <cstdint>
+#include <random>
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+
+#include "../src/mixed_precision.hpp"
+using namespace Mathlib;
+using Catch::Approx;
+
+template <ORDERING ORD>
+void run_refinement(size_t n) {
+	Matrix<double, ORD> A(n, n);
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+	for (size_t i = 0; i < n; ++i)
+		for (size_t j = 0; j < n; ++j)
+			A(i, j) = dist(gen) + ((i == j) ? double(n) : 0.0);
+
+	Vector<double> xref(n), b(n);
+	for (size_t i = 0; i < n; ++i)
+		xref(i) = std::sin(1.0 + i);
+	b = A * xref;
+
+	MixedPrecisionLU<ORD> solver(A);
+	auto res = solver.Solve(b);
+	REQUIRE(!res.fallback);
+	REQUIRE(res.iterations >= 1);
+	for (size_t i = 0; i < n; ++i)
+		REQUIRE(b(i) == Approx(xref(i)).epsilon(1e-12));
+}
+
+TEST_CASE( "float factorization refined to double accuracy" ) {
+	run_refinement<ColMajor>(50);
+	run_refinement<RowMajor>(50);
+}
+
+TEST_CASE( "fallback to double LU" ) {
+	// Hilbert matrix, far too ill-conditioned for single precision
+	size_t n = 10;
+	Matrix<double> H(n, n);
+	for (size_t i = 0; i < n; ++i)
+		for (size_t j = 0; j < n; ++j)
+			H(i, j) = 1.0 / (i + j + 1);
+
+	Vector<double> b(n);
+	b = 1.0;
+	MixedPrecisionLU<ColMajor> solver(H);
+	auto res = solver.Solve(b);
+	REQUIRE(res.fallback);
+
+	Vector<double> x(n);
+	x = 1.0;
+	LapackLU<ColMajor> lu(H);
+	lu.Solve(x);
+	for (size_t i = 0; i < n; ++i)
+		REQUIRE(b(i) == Approx(x(i)));
+}
+
+TEST_CASE( "singular matrix and wrong size" ) {
+	Matrix<double> A(3, 3);
+	A = 1.0;
+	Vector<double> b(3);
+	b = 1.0;
+	MixedPrecisionLU<ColMajor> solver(A);
+	REQUIRE_THROWS_AS(solver.Solve(b), std::runtime_error);
+	REQUIRE(b(0) == 1.0);
+
+	Vector<double> wrong(4);
+	wrong = 1.0;
+	REQUIRE_THROWS_AS(solver.Solve(wrong), std::invalid_argument);
+}
+
+TEST_CASE( "single precision LapackLU" ) {
+	Matrix<float, ColMajor> A(2, 2);
+	A(0, 0) = 2; A(0, 1) = 1;
+	A(1, 0) = 1; A(1, 1) = 3;
+	Vector<float> b(2);
+	b(0) = 3; b(1) = 4;
+	LapackLU<ColMajor, float> lu(A);
+	REQUIRE(lu.Info() == 0);
+	lu.Solve(b);
+	REQUIRE(b(0) == Approx(1.0f));
+	REQUIRE(b(1) == Approx(1.0f));
+}
+
+TEST_CASE( "LapackLU with several right hand sides and determinant" ) {
+	Matrix<double, RowMajor> A(3, 3);
+	A = 0.0;
+	A(0, 1) = 2; A(1, 0) = 1; A(2, 2) = 4; A(0, 2) = 1;
+	LapackLU<RowMajor> lu(A);
+	REQUIRE(lu.Det() == Approx(-8.0));
+
+	Matrix<double, ColMajor> B(3, 2), X(3, 2);
+	B = 1.0;
+	X = B;
+	lu.Solve(X);
+	Matrix<double, ColMajor> R(3, 2);
+	R = Matrix<double, ColMajor>(A) * X;
+	for (size_t i = 0; i < 3; ++i)
+		for (size_t j = 0; j < 2; ++j)
+			REQUIRE(R(i, j) == Approx(B(i, j)));
+}
@@ -0,0 +1,71 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/matrix.hpp"
+using namespace Mathlib;
+
+
+TEST_CASE( "topology" ) {
+	REQUIRE(ParseCpuList("0-3,8,10-11\n") == std::vector<int>{ 0, 1, 2, 3, 8, 10, 11 });
+	REQUIRE(ParseCpuList("").empty());
+
+	const auto& topo = GetNumaTopology();
+	REQUIRE(topo.Nodes() >= 1);
+	for (auto& cpus : topo.node_cpus)
+		REQUIRE(!cpus.empty());
+
+	REQUIRE(TaskCpu(0, AffinityMode::None) == -1);
+	REQUIRE(TaskCpu(0, AffinityMode::Compact) == topo.node_cpus[0][0]);
+	REQUIRE(TaskNode(0, AffinityMode::Scatter) == topo.cpu_node[topo.node_cpus[0][0]]);
+	for (size_t nr = 0; nr < 20; ++nr) {
+		int cpu = TaskCpu(nr, AffinityMode::Scatter);
+		REQUIRE(cpu >= 0);
+		REQUIRE(topo.cpu_node[cpu] >= 0);
+	}
+}
+
+
+TEST_CASE( "pinned parallel kernels" ) {
+	SetAffinity(AffinityMode::Compact);
+
+	size_t n = 300;
+	Matrix<double> A(n, n, Parallel, [](size_t i, size_t j) { return double(i % 5) - double(j % 3); });
+	Matrix<double> B(n, n, Parallel, 0.5);
+	Matrix<double> C(n, n, Parallel, 0.0);
+	AddMatMatParallel(A, B, C);
+
+	for (size_t i = 0; i < n; i += 37)
+		for (size_t j = 0; j < n; j += 41) {
+			double sum = 0;
+			for (size_t k = 0; k < n; ++k)
+				sum += A(i, k) * B(k, j);
+			REQUIRE(std::abs(C(i, j) - sum) < 1e-10);
+		}
+
+	SetAffinity(AffinityMode::None);
+}
+
+
+TEST_CASE( "numa allocator" ) {
+	NumaAllocator interleave(NumaPolicy::Interleave);
+	NumaAllocator local(NumaPolicy::Bind, GetNumaTopology().cpu_node[GetNumaTopology().node_cpus[0][0]]);
+
+	Matrix<double> A(500, 300, interleave);
+	Vector<double> x(10000, local);
+	REQUIRE(IsAligned(A.Data(), PAGE_SIZE));
+	A = 1.0;
+	x = 2.0;
+	REQUIRE(A(499, 299) == 1.0);
+	REQUIRE(x(9999) == 2.0);
+
+	int node = NumaNodeOf(x.Data());
+	REQUIRE(node >= -1);
+
+	// alignment above the page size
+	const size_t big = 16 * PAGE_SIZE;
+	void* p = interleave.Allocate(3 * PAGE_SIZE + 1, big);
+	REQUIRE(IsAligned(p, big));
+	static_cast<char*>(p)[3 * PAGE_SIZE] = 1;
+	interleave.Deallocate(p, 3 * PAGE_SIZE + 1);
+	REQUIRE_THROWS_AS(interleave.Allocate(64, 3 * PAGE_SIZE), std::invalid_argument);
+}
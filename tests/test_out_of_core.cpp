@@ -0,0 +1,120 @@
+#include <cstdio>
+#include <random>
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/out_of_core.hpp"
+using namespace Mathlib;
+
+
+static void FillRandom(MatrixView<double> A, unsigned seed) {
+	std::mt19937 gen(seed);
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+	for (size_t i = 0; i < A.Rows(); ++i)
+		for (size_t j = 0; j < A.Cols(); ++j)
+			A(i, j) = dist(gen);
+}
+
+static double MaxDiff(MatrixView<double> A, MatrixView<double> B) {
+	double diff = 0;
+	for (size_t i = 0; i < A.Rows(); ++i)
+		for (size_t j = 0; j < A.Cols(); ++j)
+			diff = std::max(diff, std::abs(A(i, j) - B(i, j)));
+	return diff;
+}
+
+
+TEST_CASE( "out-of-core multiplication" ) {
+	const size_t m = 70, k = 50, n = 60;
+	Matrix<double> A(m, k), B(k, n), C(m, n);
+	FillRandom(A, 1);
+	FillRandom(B, 2);
+	C = A * B;
+	{
+		auto fa = MappedMatrix<double>::Create("test_ooc_a.bin", m, k);
+		auto fb = MappedMatrix<double>::Create("test_ooc_b.bin", k, n);
+		fa = A;
+		fb = B;
+		MappedMatrix<double>::Create("test_ooc_c.bin", m, n);
+	}
+
+	auto dA = DiskMatrix::Open("test_ooc_a.bin", false);
+	auto dB = DiskMatrix::Open("test_ooc_b.bin", false);
+	auto dC = DiskMatrix::Open("test_ooc_c.bin");
+
+	// 16 x 16 tiles, partial tiles at all borders
+	const size_t budget = 6 * 16 * 16 * sizeof(double);
+	OutOfCoreStats stats = OutOfCoreMultiply(dA, dB, dC, budget);
+
+	auto result = MappedMatrix<double>::Open("test_ooc_c.bin");
+	REQUIRE(MaxDiff(result, C) < 1e-12);
+
+	// C is written once, A and B are read once per tile row/column of C at most
+	REQUIRE(stats.bytes_written == m * n * sizeof(double));
+	REQUIRE(stats.bytes_read > (m * k + k * n) * sizeof(double));
+	REQUIRE(stats.bytes_read < (m * k * 4 + k * n * 5) * sizeof(double));
+	REQUIRE(stats.OverlapEfficiency() >= 0.0);
+	REQUIRE(stats.OverlapEfficiency() <= 1.0);
+
+	REQUIRE_THROWS_AS(OutOfCoreMultiply(dA, dB, dC, 8), std::invalid_argument);
+	REQUIRE_THROWS_AS(OutOfCoreMultiply(dB, dA, dC, budget), std::invalid_argument);
+
+	std::remove("test_ooc_a.bin");
+	std::remove("test_ooc_b.bin");
+	std::remove("test_ooc_c.bin");
+}
+
+
+TEST_CASE( "out-of-core LU" ) {
+	const size_t n = 90;
+	Matrix<double> A(n, n);
+	FillRandom(A, 3);
+	{
+		auto fa = MappedMatrix<double>::Create("test_ooc_lu.bin", n, n);
+		fa = A;
+	}
+
+	// panels of 20 columns, the last one narrower
+	auto dA = DiskMatrix::Open("test_ooc_lu.bin");
+	std::vector<size_t> ipiv;
+	OutOfCoreStats stats = OutOfCoreLU(dA, ipiv, 4 * n * 20 * sizeof(double));
+	REQUIRE(ipiv.size() == n);
+	REQUIRE(stats.bytes_written >= n * n * sizeof(double));
+
+	// P A = L U
+	auto LU = MappedMatrix<double>::Open("test_ooc_lu.bin");
+	Matrix<double> L(n, n), U(n, n), PA(n, n);
+	L = 0.0;
+	U = 0.0;
+	for (size_t i = 0; i < n; ++i)
+		for (size_t j = 0; j < n; ++j) {
+			if (j < i) L(i, j) = LU(i, j);
+			else U(i, j) = LU(i, j);
+		}
+	L.Diag() = 1.0;
+
+	PA = A;
+	for (size_t i = 0; i < n; ++i) {
+		REQUIRE(ipiv[i] >= i);
+		for (size_t j = 0; j < n; ++j)
+			std::swap(PA(i, j), PA(ipiv[i], j));
+	}
+	Matrix<double> prod(n, n);
+	prod = L * U;
+	REQUIRE(MaxDiff(prod, PA) < 1e-10);
+
+	// same factors as with the whole matrix in one panel
+	Matrix<double> factors(n, n);
+	factors = LU;
+	{
+		auto fa = MappedMatrix<double>::Open("test_ooc_lu.bin", MapMode::ReadWrite);
+		fa = A;
+	}
+	std::vector<size_t> ipiv1;
+	OutOfCoreLU(dA, ipiv1, 4 * n * n * sizeof(double));
+	REQUIRE(ipiv1 == ipiv);
+	REQUIRE(MaxDiff(MappedMatrix<double>::Open("test_ooc_lu.bin"), factors) < 1e-10);
+
+	std::remove("test_ooc_lu.bin");
+}
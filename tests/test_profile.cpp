@@ -0,0 +1,65 @@
+#define MATHLIB_PROFILE
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+#include <thread>
+
+#include "../src/matrix.hpp"
+using namespace Mathlib;
+
+
+static KernelProfile Find(const std::string& name) {
+	for (auto& k : ProfileReport())
+		if (k.name == name) return k;
+	return KernelProfile();
+}
+
+
+TEST_CASE( "kernel profile" ) {
+	REQUIRE(PROFILING);
+	const size_t n = 48;
+	Matrix<double> A(n, n), B(n, n), C(n, n);
+	A = 1.0;
+	B = 2.0;
+	C = 0.0;
+
+	ResetProfile();
+	AddMatMat(A, B, C);
+	AddMatMat(A, B, C);
+	AddMatMatParallel(A, B, C, 4);
+	REQUIRE(C(3, 5) == 3 * 2.0 * n);
+
+	KernelProfile k = Find("AddMatMat");
+	REQUIRE(k.calls >= 3);   // the parallel version calls it on each column range
+	REQUIRE(k.flops == 3 * 2.0 * n * n * n);
+	REQUIRE(k.seconds > 0);
+	KernelProfile p = Find("AddMatMatParallel");
+	REQUIRE(p.calls == 1);
+	REQUIRE(p.bytes == 8.0 * 4 * n * n);
+
+	ResetProfile();
+	REQUIRE(Find("AddMatMat").calls == 0);
+}
+
+
+TEST_CASE( "kernel profile of ended threads" ) {
+	const size_t n = 16;
+	Matrix<double> A(n, n), B(n, n), C(n, n);
+	A = 1.0;
+	B = 1.0;
+	C = 0.0;
+
+	ResetProfile();
+	for (int i = 0; i < 3; ++i) {
+		std::thread t([&]() { AddMatMat(A, B, C); });
+		t.join();
+	}
+	REQUIRE(C(0, 0) == 3.0 * n);
+	KernelProfile k = Find("AddMatMat");
+	REQUIRE(k.calls == 3);
+	REQUIRE(k.flops == 3 * 2.0 * n * n * n);
+
+	ResetProfile();
+	REQUIRE(Find("AddMatMat").calls == 0);
+}
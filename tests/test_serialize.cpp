@@ -0,0 +1,160 @@
+#include <cstdio>
+#include <fstream>
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/serialize.hpp"
+using namespace Mathlib;
+
+
+TEST_CASE( "save and load" ) {
+	const std::string filename = "test_serialize.bin";
+	Matrix<double> A(37, 23);
+	for (size_t i = 0; i < A.Rows(); ++i)
+		for (size_t j = 0; j < A.Cols(); ++j)
+			A(i, j) = double(i) - 0.5 * double(j);
+
+	SaveOptions options;
+	options.chunk_bytes = 1000;   // several chunks, the last one partial
+	Save(filename, A, options);
+
+	Matrix<double> B = Load<double>(filename);
+	REQUIRE(B.Rows() == 37);
+	REQUIRE(B.Cols() == 23);
+	REQUIRE(B(36, 22) == A(36, 22));
+	REQUIRE(B(5, 7) == A(5, 7));
+
+	// Zero-copy view of the same file
+	{
+		auto M = MappedMatrix<double>::Open(filename);
+		REQUIRE(VerifyChecksums(M));
+		REQUIRE(M(5, 7) == A(5, 7));
+		REQUIRE((M.Header().flags & MappedHeader::FLAG_CHECKSUMS) != 0);
+	}
+
+	// A flipped byte is detected
+	{
+		std::fstream f(filename, std::ios::in | std::ios::out | std::ios::binary);
+		f.seekp(PAGE_SIZE + 3000);
+		f.put('\x42');
+	}
+	REQUIRE_THROWS_AS(Load<double>(filename), std::runtime_error);
+	REQUIRE_THROWS_AS((Load<double, RowMajor>(filename)), std::runtime_error);   // wrong ordering
+
+	// Without checksums
+	options.checksums = false;
+	Save(filename, A.RowRange(2, 10), options);
+	B = Load<double>(filename);
+	REQUIRE(B.Rows() == 8);
+	REQUIRE(B(0, 3) == A(2, 3));
+
+	std::remove(filename.c_str());
+}
+
+
+TEST_CASE( "streaming writer" ) {
+	const std::string filename = "test_serialize_stream.bin";
+	{
+		MatrixWriter<float, RowMajor> writer(filename, 100, 16);
+		Matrix<float, RowMajor> block(10, 16);
+		for (size_t b = 0; b < 10; ++b) {
+			for (size_t i = 0; i < 10; ++i)
+				for (size_t j = 0; j < 16; ++j)
+					block(i, j) = float(10 * b + i + j);
+			writer.Append(block);
+		}
+		REQUIRE_THROWS_AS(writer.Append(block), std::out_of_range);
+		writer.Close();
+	}
+	auto A = Load<float, RowMajor>(filename);
+	REQUIRE(A(99, 15) == 114.0f);
+	REQUIRE(A(42, 1) == 43.0f);
+
+	// Closing with missing data fails
+	{
+		MatrixWriter<float> writer(filename, 10, 10);
+		Matrix<float> part(10, 3);
+		part = 1.0f;
+		writer.Append(part);
+		REQUIRE_THROWS_AS(writer.Close(), std::runtime_error);
+	}
+
+	Vector<double> v(1000);
+	for (size_t i = 0; i < v.Size(); ++i)
+		v(i) = double(i);
+	Save(filename, v);
+	Vector<double> w = LoadVector<double>(filename);
+	REQUIRE(w.Size() == 1000);
+	REQUIRE(w(999) == 999.0);
+
+	std::remove(filename.c_str());
+}
+
+
+TEST_CASE( "npy export" ) {
+	const std::string filename = "test_serialize.npy";
+	Matrix<double> A(5, 3);
+	for (size_t i = 0; i < A.Rows(); ++i)
+		for (size_t j = 0; j < A.Cols(); ++j)
+			A(i, j) = 10.0 * double(i) + double(j);
+	SaveNpy(filename, A);
+
+	{
+		std::ifstream in(filename, std::ios::binary);
+		std::string head(PAGE_SIZE, ' ');
+		in.read(&head[0], PAGE_SIZE);
+		REQUIRE(head.compare(1, 5, "NUMPY") == 0);
+		REQUIRE(head.find("'descr': '<f8'") != std::string::npos);
+		REQUIRE(head.find("'fortran_order': True") != std::string::npos);
+		REQUIRE(head.find("'shape': (5, 3)") != std::string::npos);
+		REQUIRE(head.back() == '\n');
+	}
+
+	auto M = OpenNpy<double>(filename);
+	REQUIRE(M.Rows() == 5);
+	REQUIRE(M.Cols() == 3);
+	REQUIRE(M(4, 2) == 42.0);
+	REQUIRE(IsAligned(M.Data(), PAGE_SIZE));
+	REQUIRE_THROWS_AS((OpenNpy<double, RowMajor>(filename)), std::runtime_error);
+	REQUIRE_THROWS_AS(OpenNpy<float>(filename), std::runtime_error);
+
+	// Strided rows of a row-major matrix, C order
+	Matrix<double, RowMajor> R(4, 6);
+	R = 2.0;
+	R(3, 5) = 7.0;
+	SaveNpy(filename, R.ColRange(2, 6));
+	auto N = OpenNpy<double, RowMajor>(filename);
+	REQUIRE(N.Cols() == 4);
+	REQUIRE(N(3, 3) == 7.0);
+
+	Vector<float> v(10);
+	v = 1.5f;
+	SaveNpy(filename, v);
+	auto u = OpenNpyVector<float>(filename);
+	REQUIRE(u.Size() == 10);
+	REQUIRE(u(9) == 1.5f);
+
+	// Malformed headers
+	auto write = [&](const std::string& dict) {
+		std::string head = "\x93NUMPY\x01";
+		head += '\0';
+		head += char(dict.size() & 0xff);
+		head += char(dict.size() >> 8);
+		std::ofstream out(filename, std::ios::binary);
+		out << head << dict << std::string(64, '\0');
+	};
+	for (std::string dict : { "{'descr': '<f8', 'fortran_order':", "{'descr': '<f8', 'fortran_order': True, 'shape': (2, 3",
+	                          "{'descr': '<f8', 'fortran_order': True, 'shape': 2", "{'descr': '<f8, 'fortran_order': True}",
+	                          "{'descr': '<f8', 'fortran_order': True, 'shape': (x, 3), }" }) {
+		write(dict);
+		REQUIRE_THROWS_AS(OpenNpy<double>(filename), std::runtime_error);
+	}
+	// rows * cols wraps around to 0
+	write("{'descr': '<f8', 'fortran_order': True, 'shape': (9223372036854775808, 2), }");
+	REQUIRE_THROWS_AS(OpenNpy<double>(filename), std::runtime_error);
+	write("{'descr': '<f8', 'fortran_order': True, 'shape': (100,), }");
+	REQUIRE_THROWS_AS(OpenNpyVector<double>(filename), std::runtime_error);
+
+	std::remove(filename.c_str());
+}
@@ -0,0 +1,115 @@
+#include <cstdint>
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+
+#include "../src/sparse_matrix.hpp"
+#include "../src/iterative_solvers.hpp"
+using namespace Mathlib;
+using Catch::Approx;
+
+// Symmetric positive definite: 1D Laplacian plus diagonal shift
+SparseMatrix<double> Laplace(size_t n, double shift, double skew = 0) {
+	SparseMatrixBuilder<double> builder(n, n);
+	for (size_t i = 0; i < n; ++i) {
+		builder.Add(i, i, 2.0 + shift + 0.1 * (i % 3));
+		if (i > 0) builder.Add(i, i-1, -1.0 - skew);
+		if (i+1 < n) builder.Add(i, i+1, -1.0 + skew);
+	}
+	return builder.Build();
+}
+
+template <typename TOP>
+double ResidualNorm(const TOP& A, const Vector<double>& b, const Vector<double>& x) {
+	Vector<double> r(b.Size());
+	r = A * x;
+	r = b - r;
+	return std::sqrt(Dot(r, r));
+}
+
+TEST_CASE( "conjugate gradients" ) {
+	size_t n = 200;
+	auto A = Laplace(n, 0.01);
+	Vector<double> b(n), x(n);
+	for (size_t i = 0; i < n; ++i)
+		b(i) = std::cos(double(i));
+
+	x = 0.0;
+	auto res = CG(A, b, x, IdentityPreconditioner(), 1e-10, 1000);
+	REQUIRE(res.converged);
+	REQUIRE(ResidualNorm(A, b, x) <= 1e-8 * std::sqrt(Dot(b, b)));
+
+	x = 0.0;
+	auto resjac = CG(A, b, x, JacobiPreconditioner<double>(A), 1e-10, 1000);
+	REQUIRE(resjac.converged);
+	REQUIRE(ResidualNorm(A, b, x) <= 1e-8 * std::sqrt(Dot(b, b)));
+
+	// Zero right hand side
+	Vector<double> zero(n);
+	zero = 0.0;
+	x = 1.0;
+	REQUIRE(CG(A, zero, x).converged);
+	REQUIRE(x(0) == 0.0);
+}
+
+TEST_CASE( "BiCGStab and GMRES on non-symmetric sparse matrix" ) {
+	size_t n = 150;
+	auto A = Laplace(n, 0.5, 0.3);
+	Vector<double> b(n), x(n);
+	for (size_t i = 0; i < n; ++i)
+		b(i) = 1.0 + (i % 5);
+
+	x = 0.0;
+	auto res = BiCGStab(A, b, x, JacobiPreconditioner<double>(A), 1e-10, 1000);
+	REQUIRE(res.converged);
+	REQUIRE(ResidualNorm(A, b, x) <= 1e-8 * std::sqrt(Dot(b, b)));
+
+	x = 0.0;
+	auto resg = GMRES(A, b, x, IdentityPreconditioner(), 1e-10, 2000, 20);
+	REQUIRE(resg.converged);
+	REQUIRE(resg.iterations > 20); // needed at least one restart
+	REQUIRE(ResidualNorm(A, b, x) <= 1e-8 * std::sqrt(Dot(b, b)));
+}
+
+TEST_CASE( "GMRES breakdown on singular matrix" ) {
+	// A b = 0: the first Krylov vector is annihilated
+	Matrix<double> A(2, 2);
+	A = 0.0;
+	A(1, 1) = 1.0;
+	Vector<double> b(2), x(2);
+	b = 0.0;
+	b(0) = 1.0;
+
+	x = 0.0;
+	auto res = GMRES(A, b, x, IdentityPreconditioner(), 1e-10, 100);
+	REQUIRE(!res.converged);
+	REQUIRE(res.residual == Approx(1.0));
+	REQUIRE(!std::isnan(x(0)));
+	REQUIRE(!std::isnan(x(1)));
+}
+
+TEST_CASE( "dense operators and expression nodes" ) {
+	size_t n = 30;
+	Matrix<double> A(n, n), B(n, n);
+	for (size_t i = 0; i < n; ++i)
+		for (size_t j = 0; j < n; ++j) {
+			A(i, j) = (i == j) ? 4.0 : 1.0 / (1.0 + i + 2.0*j);
+			B(i, j) = (i == j) ? 1.0 : 0.0;
+		}
+	Vector<double> b(n), x(n);
+	for (size_t i = 0; i < n; ++i)
+		b(i) = double(i);
+
+	x = 0.0;
+	auto res = GMRES(A, b, x, JacobiPreconditioner<double>(A), 1e-12, 100, 50);
+	REQUIRE(res.converged);
+	REQUIRE(ResidualNorm(A, b, x) <= 1e-10 * std::sqrt(Dot(b, b)));
+
+	// Operator given as expression A + 2*B, never formed explicitly
+	x = 0.0;
+	auto res2 = BiCGStab(A + 2.0 * B, b, x);
+	REQUIRE(res2.converged);
+	Matrix<double> C = A + 2.0 * B;
+	REQUIRE(ResidualNorm(C, b, x) <= 1e-8 * std::sqrt(Dot(b, b)));
+}
@@ -0,0 +1,189 @@
+#include <cstdint>
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+
+#include "../src/sparse_matrix.hpp"
+using namespace Mathlib;
+using Catch::Approx;
+
+// 1D Laplacian with an extra entry per row, assembled with duplicates
+SparseMatrix<double> BuildTestMatrix(size_t n) {
+	SparseMatrixBuilder<double> builder(n, n);
+	for (size_t i = 0; i < n; ++i) {
+		builder.Add(i, i, 1.0);
+		builder.Add(i, i, 1.0); // duplicate, summed to 2
+		if (i > 0) builder.Add(i, i-1, -1.0);
+		if (i+1 < n) builder.Add(i, i+1, -1.0);
+		builder.Add(i, (i*7) % n, 0.5);
+	}
+	return builder.Build();
+}
+
+Matrix<double, RowMajor> ToDense(const SparseMatrixView<double>& s) {
+	Matrix<double, RowMajor> d(s.Rows(), s.Cols());
+	d = s;
+	return d;
+}
+
+TEST_CASE( "builder" ) {
+	SparseMatrixBuilder<double> builder(3, 4);
+	builder.Add(2, 3, 1.0);
+	builder.Add(0, 1, 2.0);
+	builder.Add(2, 0, 3.0);
+	builder.Add(0, 1, 4.0);
+	auto s = builder.Build();
+
+	REQUIRE(s.Rows() == 3);
+	REQUIRE(s.Cols() == 4);
+	REQUIRE(s.NonZeros() == 3);
+	REQUIRE(s(0, 1) == 6.0);
+	REQUIRE(s(2, 0) == 3.0);
+	REQUIRE(s(2, 3) == 1.0);
+	REQUIRE(s(1, 1) == 0.0);
+	REQUIRE(s.ColIndices()[1] == 0); // row 2 sorted by column
+	REQUIRE(s.ColIndices()[2] == 3);
+
+	REQUIRE_THROWS_AS(builder.Add(3, 0, 1.0), std::out_of_range);
+
+	// Large enough to take the parallel path
+	auto big = BuildTestMatrix(30000);
+	REQUIRE(big(0, 0) == Approx(2.5));
+	REQUIRE(big(5, 4) == -1.0);
+	REQUIRE(big(5, 6) == -1.0);
+
+	// Builders inside a parallel loop run on their task
+	std::vector<size_t> nnz(2, 0);
+	ParallelFor(2, 2, [&](size_t first, size_t next) {
+		for (size_t i = first; i < next; ++i)
+			nnz[i] = BuildTestMatrix(20000).NonZeros();
+	});
+	const size_t expected = BuildTestMatrix(20000).NonZeros();
+	REQUIRE(nnz[0] == expected);
+	REQUIRE(nnz[1] == expected);
+}
+
+TEST_CASE( "sparse matrix-vector product" ) {
+	for (size_t n : { 17, 40000 }) {
+		auto s = BuildTestMatrix(n);
+		Vector<double> x(n), y(n), yref(n);
+		for (size_t i = 0; i < n; ++i)
+			x(i) = std::sin(double(i));
+
+		y = s * x;
+		for (size_t i = 0; i < n; ++i) {
+			double sum = 0;
+			for (size_t k = s.RowPtr()[i]; k < s.RowPtr()[i+1]; ++k)
+				sum += s.Values()[k] * x(s.ColIndices()[k]);
+			REQUIRE(y(i) == Approx(sum));
+		}
+
+		// Expression on the right, strided result
+		Vector<double> z(2*n);
+		z = 0.0;
+		z.Slice(0, 2) = s * (x + x);
+		for (size_t i = 0; i < n; ++i)
+			REQUIRE(z(2*i) == Approx(2*y(i)));
+	}
+
+	// Part of a larger expression
+	auto s = BuildTestMatrix(10);
+	auto d = ToDense(s);
+	Vector<double> x(10), y(10);
+	x = 1.0;
+	y = s * x + x;
+	Vector<double> yref(10);
+	yref = d * x;
+	for (size_t i = 0; i < 10; ++i)
+		REQUIRE(y(i) == Approx(yref(i) + 1.0));
+
+	// the result is resized, x = s*x goes through a temporary
+	Vector<double> small(2);
+	small = s * x;
+	REQUIRE(small.Size() == 10);
+	REQUIRE(small(3) == Approx(yref(3)));
+	for (size_t i = 0; i < 10; ++i)
+		x(i) = double(i);
+	yref = d * x;
+	x = s * x;
+	for (size_t i = 0; i < 10; ++i)
+		REQUIRE(x(i) == Approx(yref(i)));
+
+	Vector<double> wrong(3);
+	REQUIRE_THROWS_AS(MultSparseMatVec(SparseMatrixView<double>(s), VectorView<double>(wrong), VectorView<double>(y)), std::invalid_argument);
+}
+
+TEST_CASE( "sparse matrix-matrix product" ) {
+	auto s = BuildTestMatrix(20);
+	auto d = ToDense(s);
+	Matrix<double, RowMajor> X(20, 5);
+	Matrix<double, ColMajor> Y(20, 5);
+	for (size_t i = 0; i < 20; ++i)
+		for (size_t j = 0; j < 5; ++j)
+			X(i, j) = double(i) - 2.0*double(j);
+
+	Y = s * X;
+	Matrix<double, ColMajor> Yref = d * X;
+	for (size_t i = 0; i < 20; ++i)
+		for (size_t j = 0; j < 5; ++j)
+			REQUIRE(Y(i, j) == Approx(Yref(i, j)));
+
+	// X = s*X goes through a temporary, wrong shapes throw
+	Matrix<double, RowMajor> Xref = d * X;
+	X = s * X;
+	for (size_t i = 0; i < 20; ++i)
+		for (size_t j = 0; j < 5; ++j)
+			REQUIRE(X(i, j) == Approx(Xref(i, j)));
+
+	Matrix<double, ColMajor> Wrong(19, 5);
+	REQUIRE_THROWS_AS(Wrong = s * X, std::invalid_argument);
+	Matrix<double, RowMajor> Short(10, 5);
+	REQUIRE_THROWS_AS(Y = s * Short, std::invalid_argument);
+}
+
+TEST_CASE( "block sparse matrix" ) {
+	auto s = BuildTestMatrix(24);
+	auto b = BlockSparseMatrix<double, 4>::FromSparse(s);
+	REQUIRE(b.Rows() == 24);
+	REQUIRE(b.BlockRows() == 6);
+	for (size_t i = 0; i < 24; ++i)
+		for (size_t j = 0; j < 24; ++j)
+			REQUIRE(b(i, j) == s(i, j));
+
+	Vector<double> x(24), y(24), yref(24);
+	for (size_t i = 0; i < 24; ++i)
+		x(i) = 1.0 + i;
+	y = b * x;
+	yref = s * x;
+	for (size_t i = 0; i < 24; ++i)
+		REQUIRE(y(i) == Approx(yref(i)));
+
+	Matrix<double, RowMajor> X(24, 3), Y(24, 3), Yref(24, 3);
+	for (size_t i = 0; i < 24; ++i)
+		for (size_t j = 0; j < 3; ++j)
+			X(i, j) = double(i*j) + 1.0;
+	Y = b * X;
+	Yref = s * X;
+	for (size_t i = 0; i < 24; ++i)
+		for (size_t j = 0; j < 3; ++j)
+			REQUIRE(Y(i, j) == Approx(Yref(i, j)));
+	X = b * X;
+	for (size_t i = 0; i < 24; ++i)
+		for (size_t j = 0; j < 3; ++j)
+			REQUIRE(X(i, j) == Approx(Yref(i, j)));
+	Matrix<double, RowMajor> Wrong(20, 3);
+	REQUIRE_THROWS_AS(Wrong = b * X, std::invalid_argument);
+
+	// copy and move assignment
+	auto c = BlockSparseMatrix<double, 4>::FromSparse(BuildTestMatrix(8));
+	c = b;
+	REQUIRE(c.Rows() == 24);
+	REQUIRE(c.Values() != b.Values());
+	REQUIRE(c(5, 4) == b(5, 4));
+	c = BlockSparseMatrix<double, 4>::FromSparse(BuildTestMatrix(8));
+	REQUIRE(c.Rows() == 8);
+	REQUIRE(c(3, 3) == s(3, 3));
+
+	REQUIRE_THROWS_AS((BlockSparseMatrix<double, 4>::FromSparse(BuildTestMatrix(10))), std::invalid_argument);
+}
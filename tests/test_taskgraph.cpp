@@ -0,0 +1,76 @@
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/tiled.hpp"
+using namespace Mathlib;
+
+
+TEST_CASE( "task graph dependencies" ) {
+	// x = 1; y = x + 1 and z = 2x read x; x = y + z
+	double x = 0, y = 0, z = 0;
+	TaskGraph graph;
+	graph.Add([&]() { x = 1; }, { }, { &x });
+	size_t ty = graph.Add([&]() { y = x + 1; }, { &x }, { &y });
+	size_t tz = graph.Add([&]() { z = 2 * x; }, { &x }, { &z });
+	size_t tx = graph.Add([&]() { x = y + z; }, { &y, &z }, { &x });
+	REQUIRE(graph.Predecessors(ty) == 1);
+	REQUIRE(graph.Predecessors(tz) == 1);
+	REQUIRE(graph.Predecessors(tx) == 3);   // y, z and the readers of x
+	graph.Run(4);
+	REQUIRE(x == 4);
+	REQUIRE(graph.Size() == 0);
+
+	// a chain of increments, run with several workers
+	std::atomic<int> independent{ 0 };
+	int counter = 0;
+	for (int i = 0; i < 100; ++i) {
+		graph.Add([&]() { counter++; }, { }, { &counter });
+		graph.Add([&]() { independent++; }, { }, { });
+	}
+	graph.Run(4);
+	REQUIRE(counter == 100);
+	REQUIRE(independent == 100);
+
+	// the first exception is rethrown, the dependent tasks are skipped
+	bool ran = false;
+	graph.Add([]() { throw std::runtime_error("failed"); }, { }, { &x });
+	graph.Add([&]() { ran = true; }, { &x }, { });
+	REQUIRE_THROWS_AS(graph.Run(2), std::runtime_error);
+	REQUIRE(!ran);
+}
+
+
+TEST_CASE( "tiled Cholesky" ) {
+	const size_t n = 250;
+	Matrix<double, ColMajor> A(n, n), L(n, n);
+	for (size_t i = 0; i < n; ++i)
+		for (size_t j = 0; j < n; ++j)
+			A(i, j) = (i == j) ? double(n) : 1.0 / (1.0 + double(i + j));
+
+	for (size_t ntasks : { size_t(1), size_t(4) }) {
+		L = A;
+		REQUIRE(TiledCholesky(L, 64, ntasks) == 0);
+		double err = 0;
+		for (size_t i = 0; i < n; ++i)
+			for (size_t j = 0; j <= i; ++j) {
+				double sum = 0;
+				for (size_t k = 0; k <= j; ++k)
+					sum += L(i, k) * L(j, k);
+				err = std::max(err, std::abs(sum - A(i, j)));
+			}
+		REQUIRE(err < 1e-10);
+		REQUIRE(L(0, n - 1) == A(0, n - 1));   // upper triangle untouched
+	}
+
+	// not positive definite in the third tile
+	L = A;
+	L(150, 150) = -1.0;
+	integer info = TiledCholesky(L, 64, 4);
+	REQUIRE(info == 151);
+
+	REQUIRE_THROWS_AS(TiledCholesky(A.ColRange(0, 10)), std::invalid_argument);
+}
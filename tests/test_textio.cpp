@@ -0,0 +1,144 @@
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/textio.hpp"
+using namespace Mathlib;
+
+
+TEST_CASE( "dense text" ) {
+	Matrix<double> A = ParseText("# comment\n1 2.5 -3\n\n4,5e-3,+6\r\n7 8 9\n");
+	REQUIRE(A.Rows() == 3);
+	REQUIRE(A.Cols() == 3);
+	REQUIRE(A(0, 1) == 2.5);
+	REQUIRE(A(1, 1) == 5e-3);
+	REQUIRE(A(1, 2) == 6.0);
+	REQUIRE(A(2, 0) == 7.0);
+
+	REQUIRE_THROWS_AS(ParseText("1 2 3\n4 5\n"), std::runtime_error);
+	REQUIRE_THROWS_AS(ParseText("1 2\n3 x\n"), std::runtime_error);
+
+	// Round trip, parsed in several chunks
+	Matrix<double, RowMajor> B(200, 7);
+	for (size_t i = 0; i < B.Rows(); ++i)
+		for (size_t j = 0; j < B.Cols(); ++j)
+			B(i, j) = 1.0 / (1.0 + i) - 0.1 * j;
+	std::string text = FormatText(B);
+	auto C = ParseText<double, RowMajor>(text, 4);
+	REQUIRE(C.Rows() == 200);
+	REQUIRE(C.Cols() == 7);
+	bool same = true;
+	for (size_t i = 0; i < B.Rows(); ++i)
+		for (size_t j = 0; j < B.Cols(); ++j)
+			same = same && C(i, j) == B(i, j);
+	REQUIRE(same);
+
+	const std::string filename = "test_textio.txt";
+	WriteText(filename, B.RowRange(10, 20), 3, ',');
+	auto D = ReadText<float>(filename);
+	REQUIRE(D.Rows() == 10);
+	REQUIRE(D(0, 0) == 0.0909f);   // 3 digits
+	std::remove(filename.c_str());
+
+	Matrix<int> I = ParseText<int>("1 2\n-3 4\n");
+	REQUIRE(I(1, 0) == -3);
+}
+
+
+TEST_CASE( "matrix market" ) {
+	const std::string general =
+		"%%MatrixMarket matrix coordinate real general\n"
+		"% comment\n"
+		"3 4 5\n"
+		"1 1 1.5\n"
+		"3 4 -2\n"
+		"2 2 3e2\n"
+		"1 1 0.5\n"
+		"2 3 7\n";
+	SparseMatrix<double> S = ParseMatrixMarket(general, 3);
+	REQUIRE(S.Rows() == 3);
+	REQUIRE(S.Cols() == 4);
+	REQUIRE(S.NonZeros() == 4);   // duplicates summed
+	REQUIRE(S(0, 0) == 2.0);
+	REQUIRE(S(1, 1) == 300.0);
+	REQUIRE(S(2, 3) == -2.0);
+
+	const std::string symmetric =
+		"%%MatrixMarket matrix coordinate pattern symmetric\n"
+		"3 3 3\n"
+		"1 1\n"
+		"3 1\n"
+		"3 2\n";
+	S = ParseMatrixMarket(symmetric);
+	REQUIRE(S.NonZeros() == 5);
+	REQUIRE(S(0, 2) == 1.0);
+	REQUIRE(S(2, 0) == 1.0);
+	REQUIRE(S(1, 2) == 1.0);
+
+	auto D = ParseMatrixMarketDense(symmetric);
+	REQUIRE(D(2, 1) == 1.0);
+	REQUIRE(D(1, 1) == 0.0);
+
+	const std::string array =
+		"%%MatrixMarket matrix array real skew-symmetric\n"
+		"3 3\n"
+		"1\n2\n3\n";
+	auto K = ParseMatrixMarketDense(array);
+	REQUIRE(K(1, 0) == 1.0);
+	REQUIRE(K(0, 1) == -1.0);
+	REQUIRE(K(2, 1) == 3.0);
+	REQUIRE(K(1, 2) == -3.0);
+	REQUIRE(K(0, 0) == 0.0);
+
+	REQUIRE_THROWS_AS(ParseMatrixMarket("%%MatrixMarket matrix coordinate complex general\n1 1 1\n1 1 1 0\n"), std::runtime_error);
+	REQUIRE_THROWS_AS(ParseMatrixMarket("%%MatrixMarket matrix coordinate real general\n2 2 2\n1 1 1\n"), std::runtime_error);
+	REQUIRE_THROWS_AS(ParseMatrixMarket("%%MatrixMarket matrix coordinate real general\n2 2 1\n3 1 1\n"), std::runtime_error);
+	REQUIRE_THROWS_AS(ParseMatrixMarket(array), std::runtime_error);
+
+	// Round trips through files
+	const std::string filename = "test_textio.mtx";
+	S = ParseMatrixMarket(general);
+	WriteMatrixMarket(filename, S);
+	auto S2 = ReadMatrixMarket(filename);
+	REQUIRE(S2.NonZeros() == 4);
+	REQUIRE(S2(1, 1) == 300.0);
+	REQUIRE(S2(0, 0) == 2.0);
+
+	Matrix<double> M(4, 3);
+	for (size_t i = 0; i < 4; ++i)
+		for (size_t j = 0; j < 3; ++j)
+			M(i, j) = 0.1 * i + j;
+	WriteMatrixMarket(filename, M);
+	auto M2 = ReadMatrixMarketDense<double, RowMajor>(filename);
+	REQUIRE(M2(3, 2) == M(3, 2));
+	REQUIRE(M2(1, 0) == M(1, 0));
+	std::remove(filename.c_str());
+}
+
+
+TEST_CASE( "stream output" ) {
+	Matrix<double> A(2, 2);
+	A(0, 0) = 1.0;
+	A(0, 1) = 0.5;
+	A(1, 0) = -3.0;
+	A(1, 1) = 1e-7;
+	std::ostringstream fast;
+	fast << A;
+	REQUIRE(fast.str() == "1 0.5 \n-3 1e-07 \n");
+
+	// stream formatting flags are honored
+	std::ostringstream fixed;
+	fixed << std::fixed << std::setprecision(2) << A;
+	REQUIRE(fixed.str() == "1.00 0.50 \n-3.00 0.00 \n");
+
+	Vector<double> v(3);
+	v(0) = 1.0 / 3.0;
+	v(1) = 2.0;
+	v(2) = -0.25;
+	std::ostringstream vs;
+	vs << v;
+	REQUIRE(vs.str() == "0.333333, 2, -0.25");
+}
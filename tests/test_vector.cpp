@@ -1,4 +1,6 @@
+#include <atomic>
 #include <cstdint>
+#include <vector>
 
 #define CATCH_CONFIG_MAIN
 #include <catch2/catch_test_macros.hpp>
@@ -141,6 +143,125 @@ TEST_CASE( "views" ) {
 
 
 
+TEST_CASE( "in-place updates" ) {
+	Vector<double> x(6), y(6);
+	for (size_t i = 0; i < x.Size(); ++i) {
+		x(i) = double(i);
+		y(i) = 1.0;
+	}
+	double* data = x.Data();
+
+	x += 2.0 * y;  // axpy
+	x -= y;
+	x *= 0.5;
+	REQUIRE(x.Data() == data);
+	for (size_t i = 0; i < x.Size(); ++i)
+		REQUIRE(x(i) == 0.5 * (double(i) + 1.0));
+
+	// on views, only the viewed entries change
+	x.Slice(0, 2) += x.Slice(1, 2);
+	REQUIRE(x(0) == 1.5);
+	REQUIRE(x(1) == 1.0);
+	REQUIRE(x(4) == 5.5);
+}
+
+TEST_CASE( "capacity, resize, reserve" ) {
+	Vector<double> v(4);
+	for (size_t i = 0; i < v.Size(); ++i)
+		v(i) = double(i);
+	REQUIRE(v.Capacity() == 4);
+
+	v.Reserve(10);
+	REQUIRE(v.Capacity() == 10);
+	REQUIRE(v.Size() == 4);
+	REQUIRE(v(3) == 3.0);
+	double* mem = v.Data();
+
+	// Assignments within the capacity keep the buffer
+	Vector<double> w(8);
+	w = 1.0;
+	v = w;
+	REQUIRE(v.Size() == 8);
+	REQUIRE(v.Data() == mem);
+	REQUIRE(v(7) == 1.0);
+
+	v = 2.0 * w.Range(0, 3);
+	REQUIRE(v.Size() == 3);
+	REQUIRE(v.Data() == mem);
+	REQUIRE(v(2) == 2.0);
+
+	v.Resize(10);
+	REQUIRE(v.Data() == mem);
+	REQUIRE(v(1) == 2.0);
+
+	// Growing beyond the capacity reallocates
+	Vector<double> big(20);
+	big = 3.0;
+	v = big;
+	REQUIRE(v.Size() == 20);
+	REQUIRE(v.Capacity() == 20);
+	REQUIRE(v(19) == 3.0);
+
+	// Assigning a view copies values instead of rebinding
+	Vector<double> u(3);
+	u = VectorView<double>(w);
+	REQUIRE(u.Size() == 8);
+	REQUIRE(u.Data() != w.Data());
+	u(0) = 5.0;
+	REQUIRE(w(0) == 1.0);
+}
+
+
+
+TEST_CASE( "parallel construction" ) {
+	const size_t n = 200000;   // above PARALLEL_INIT_MIN
+
+	Vector<double> zero(n, Parallel, 0.0);
+	Vector<double> idx(n, Parallel, [](size_t i) { return double(i); });
+	Vector<double> sum(Parallel, 2.0 * idx + zero);
+	REQUIRE(zero(n-1) == 0.0);
+	REQUIRE(idx(12345) == 12345.0);
+	REQUIRE(sum(n-1) == 2.0 * double(n-1));
+
+	Vector<int> small(5, Parallel, 7);
+	REQUIRE(small(4) == 7);
+
+	// Partition used by the fills and the parallel kernels
+	REQUIRE(StaticPartition(10, 0, 4) == std::pair<size_t, size_t>(0, 3));
+	REQUIRE(StaticPartition(10, 3, 4) == std::pair<size_t, size_t>(9, 10));
+	REQUIRE(StaticPartition(2, 3, 4).first == 2);
+}
+
+
+TEST_CASE( "work stealing loop" ) {
+	// uneven work: the last indices are expensive, every index must be visited once
+	const size_t n = 1000;
+	std::vector<std::atomic<int>> visits(n);
+	std::atomic<bool> aligned{ true };
+	ParallelFor(n, 4, [&](size_t first, size_t next) {
+		if (first % 8 != 0 || (next % 8 != 0 && next != n)) aligned = false;
+		for (size_t i = first; i < next; ++i) {
+			volatile double x = 0;
+			for (size_t k = 0; k < i * i / 100; ++k) x = x + 1.0;
+			visits[i]++;
+		}
+	}, 8);
+	bool once = true;
+	for (auto& v : visits) once = once && v == 1;
+	REQUIRE(once);
+	REQUIRE(aligned);
+
+	// nested loops run on the calling task
+	std::atomic<size_t> total{ 0 };
+	ParallelFor(16, 4, [&](size_t first, size_t next) {
+		for (size_t i = first; i < next; ++i)
+			ParallelFor(100, 4, [&](size_t f, size_t l) { total += l - f; });
+	});
+	REQUIRE(total == 1600);
+}
+
+
+
 TEST_CASE( "error handling" ) {
 	Vector<int> v1(5);
 	Vector<int> v2(3);